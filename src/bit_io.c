@@ -0,0 +1,263 @@
+/**
+ * Copyright (c) 2011-2014, Vasileios Daras. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+#include "bit_io.h"
+#include "huffman_tree.h"
+#include "huffman_code.h"
+
+#if !defined(BIT_IO_GENERIC_ONLY) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BIT_IO_BMI2 1
+#endif
+
+typedef int (*encode_kernel)(const unsigned char* bytes, unsigned int size, const unsigned int* const context_codes[256],
+                             unsigned char* bytes_out, unsigned int out_cap, unsigned int* produced);
+
+typedef int (*decode_kernel)(const unsigned int* const context_entries[256], const unsigned int* multi_entries,
+                             const unsigned char* bytes, unsigned int size, unsigned char* bytes_out, unsigned int symbols);
+
+static inline unsigned long long read_u64_be(const unsigned char* buffer) {
+    unsigned long long value = 0;
+    for(int i = 0; i < 8; i++) {
+        value = (value << 8) | buffer[i];
+    }
+    return value;
+}
+
+static inline void write_u32_be(unsigned char* buffer, unsigned int value) {
+    buffer[0] = (unsigned char) (value >> 24);
+    buffer[1] = (unsigned char) (value >> 16);
+    buffer[2] = (unsigned char) (value >> 8);
+    buffer[3] = (unsigned char) value;
+}
+
+/**
+ * Defines an encode kernel. Codes are added to a 64 bit buffer that is
+ * written out 32 bits at a time, which leaves room for one more code of
+ * BIT_IO_MAX_CODE_LENGTH bits, and only then checked against out_cap.
+ */
+#define DEFINE_ENCODE_KERNEL(name, attributes) \
+attributes static int name(const unsigned char* bytes, unsigned int size, \
+                           const unsigned int* const context_codes[256], unsigned char* bytes_out, \
+                           unsigned int out_cap, unsigned int* produced) { \
+    \
+    unsigned long long buffer = 0; \
+    int bits = 0; \
+    unsigned int written = 0; \
+    unsigned int prev = 0; \
+    \
+    for(unsigned int i = 0; i < size; i++) { \
+        unsigned int entry = context_codes[prev][bytes[i]]; \
+        unsigned int length = BIT_IO_CODE_LENGTH(entry); \
+        buffer = (buffer << length) | BIT_IO_CODE_BITS(entry); \
+        bits += length; \
+        prev = bytes[i]; \
+        \
+        if(bits >= 32) { \
+            if(out_cap - written < 4) { \
+                return HUFFMAN_ENCODING_ERROR; \
+            } \
+            bits -= 32; \
+            write_u32_be(bytes_out + written, (unsigned int) (buffer >> bits)); \
+            written += 4; \
+        } \
+    } \
+    \
+    if(out_cap - written < (unsigned int) (bits + 7) / 8) { \
+        return HUFFMAN_ENCODING_ERROR; \
+    } \
+    while(bits >= 8) { \
+        bits -= 8; \
+        bytes_out[written] = (unsigned char) (buffer >> bits); \
+        written++; \
+    } \
+    if(bits != 0) { \
+        bytes_out[written] = (unsigned char) (buffer << (8 - bits)); \
+        written++; \
+    } \
+    \
+    (*produced) = written; \
+    return HUFFMAN_SUCCESS; \
+}
+
+/**
+ * Decodes one symbol with the table of the previous symbol's context. Needs
+ * bit_buffer, buffered, context_entries, prev, bytes_out and produced from
+ * the enclosing decode kernel.
+ */
+#define DECODE_SYMBOL(bits) \
+    do { \
+        unsigned int entry = context_entries[prev][bit_buffer >> (64 - (bits))]; \
+        if(entry & HUFFMAN_CODE_LINK) { \
+            entry = context_entries[prev][HUFFMAN_CODE_ENTRY_VALUE(entry) \
+                    + (unsigned int) ((bit_buffer << (bits)) >> (64 - HUFFMAN_CODE_ENTRY_LENGTH(entry)))]; \
+        } \
+        int length = HUFFMAN_CODE_ENTRY_LENGTH(entry); \
+        if(length == 0 || length > buffered) { \
+            return HUFFMAN_ENCODING_ERROR; \
+        } \
+        prev = HUFFMAN_CODE_ENTRY_VALUE(entry); \
+        bytes_out[produced++] = prev; \
+        bit_buffer <<= length; \
+        buffered -= length; \
+    } while(0)
+
+/**
+ * Decodes the codes of a multi-symbol entry, or a single symbol as
+ * DECODE_SYMBOL does when the entry holds none, the codes run past the
+ * input, or fewer than HUFFMAN_CODE_MULTI_SYMBOLS symbols are left, since
+ * all of an entry's symbols are stored. Needs multi_entries on top of what
+ * DECODE_SYMBOL needs.
+ */
+#define DECODE_MULTI(bits) \
+    do { \
+        unsigned int multi = multi_entries[bit_buffer >> (64 - (bits))]; \
+        int multi_length = HUFFMAN_CODE_ENTRY_LENGTH(multi); \
+        if(HUFFMAN_CODE_MULTI_COUNT(multi) != 0 && multi_length <= buffered \
+           && symbols - produced >= HUFFMAN_CODE_MULTI_SYMBOLS) { \
+            bytes_out[produced] = (unsigned char) (multi >> 8); \
+            bytes_out[produced + 1] = (unsigned char) (multi >> 16); \
+            bytes_out[produced + 2] = (unsigned char) (multi >> 24); \
+            produced += HUFFMAN_CODE_MULTI_COUNT(multi); \
+            bit_buffer <<= multi_length; \
+            buffered -= multi_length; \
+        } else { \
+            DECODE_SYMBOL(bits); \
+        } \
+    } while(0)
+
+/**
+ * Defines a decode kernel for tables of a primary width of bits, so the
+ * shifts of the primary lookup are immediates, that decodes with step,
+ * DECODE_SYMBOL or DECODE_MULTI. The bit buffer holds at least 56 bits
+ * after a refill while the input lasts, enough for two codes of
+ * HUFFMAN_CODE_MAX_LENGTH bits, so two steps are taken per refill.
+ */
+#define DEFINE_DECODE_KERNEL(name, bits, step, attributes) \
+attributes static int name(const unsigned int* const context_entries[256], const unsigned int* multi_entries, \
+                           const unsigned char* bytes, unsigned int size, unsigned char* bytes_out, unsigned int symbols) { \
+    \
+    unsigned long long bit_buffer = 0; \
+    int buffered = 0; \
+    unsigned int bytes_read = 0; \
+    unsigned int prev = 0; \
+    unsigned int produced = 0; \
+    (void) multi_entries; \
+    \
+    while(produced < symbols) { \
+        if(bytes_read + 8 <= size) { \
+            /* Bytes that only partly fit are loaded again by the next refill. */ \
+            bit_buffer |= read_u64_be(bytes + bytes_read) >> buffered; \
+            bytes_read += (63 - buffered) >> 3; \
+            buffered |= 56; \
+        } else { \
+            while(buffered <= 56 && bytes_read < size) { \
+                bit_buffer |= (unsigned long long) bytes[bytes_read] << (56 - buffered); \
+                bytes_read++; \
+                buffered += 8; \
+            } \
+        } \
+        \
+        step(bits); \
+        if(produced < symbols) { \
+            step(bits); \
+        } \
+    } \
+    \
+    return HUFFMAN_SUCCESS; \
+}
+
+DEFINE_ENCODE_KERNEL(encode_generic, )
+DEFINE_DECODE_KERNEL(decode_generic_9, 9, DECODE_SYMBOL, )
+DEFINE_DECODE_KERNEL(decode_generic_10, 10, DECODE_SYMBOL, )
+DEFINE_DECODE_KERNEL(decode_generic_11, 11, DECODE_SYMBOL, )
+DEFINE_DECODE_KERNEL(decode_generic_12, 12, DECODE_SYMBOL, )
+DEFINE_DECODE_KERNEL(decode_multi_generic_9, 9, DECODE_MULTI, )
+DEFINE_DECODE_KERNEL(decode_multi_generic_10, 10, DECODE_MULTI, )
+DEFINE_DECODE_KERNEL(decode_multi_generic_11, 11, DECODE_MULTI, )
+DEFINE_DECODE_KERNEL(decode_multi_generic_12, 12, DECODE_MULTI, )
+
+/* Single-symbol kernels first, then multi-symbol kernels, each by table width. */
+static const decode_kernel generic_decoders[2][4] = {
+    { decode_generic_9, decode_generic_10, decode_generic_11, decode_generic_12 },
+    { decode_multi_generic_9, decode_multi_generic_10, decode_multi_generic_11, decode_multi_generic_12 }
+};
+
+#ifdef BIT_IO_BMI2
+
+/* The same kernels, with variable shifts compiled to SHLX and SHRX. */
+#define BMI2 __attribute__((target("bmi2")))
+
+DEFINE_ENCODE_KERNEL(encode_bmi2, BMI2)
+DEFINE_DECODE_KERNEL(decode_bmi2_9, 9, DECODE_SYMBOL, BMI2)
+DEFINE_DECODE_KERNEL(decode_bmi2_10, 10, DECODE_SYMBOL, BMI2)
+DEFINE_DECODE_KERNEL(decode_bmi2_11, 11, DECODE_SYMBOL, BMI2)
+DEFINE_DECODE_KERNEL(decode_bmi2_12, 12, DECODE_SYMBOL, BMI2)
+DEFINE_DECODE_KERNEL(decode_multi_bmi2_9, 9, DECODE_MULTI, BMI2)
+DEFINE_DECODE_KERNEL(decode_multi_bmi2_10, 10, DECODE_MULTI, BMI2)
+DEFINE_DECODE_KERNEL(decode_multi_bmi2_11, 11, DECODE_MULTI, BMI2)
+DEFINE_DECODE_KERNEL(decode_multi_bmi2_12, 12, DECODE_MULTI, BMI2)
+
+static const decode_kernel bmi2_decoders[2][4] = {
+    { decode_bmi2_9, decode_bmi2_10, decode_bmi2_11, decode_bmi2_12 },
+    { decode_multi_bmi2_9, decode_multi_bmi2_10, decode_multi_bmi2_11, decode_multi_bmi2_12 }
+};
+
+/* -1 until the processor is checked. Threads racing to check it store the same value. */
+static volatile int has_bmi2 = -1;
+
+static int cpu_has_bmi2() {
+    if(has_bmi2 < 0) {
+        __builtin_cpu_init();
+        has_bmi2 = __builtin_cpu_supports("bmi2") ? 1 : 0;
+    }
+    return has_bmi2;
+}
+
+#endif
+
+int bit_io_encode(const unsigned char* bytes, unsigned int size, const unsigned int* const context_codes[256],
+                  unsigned char* bytes_out, unsigned int out_cap, unsigned int* produced) {
+
+    encode_kernel kernel = encode_generic;
+#ifdef BIT_IO_BMI2
+    if(cpu_has_bmi2()) {
+        kernel = encode_bmi2;
+    }
+#endif
+
+    return kernel(bytes, size, context_codes, bytes_out, out_cap, produced);
+}
+
+int bit_io_decode(int table_bits, const unsigned int* const context_entries[256], const unsigned int* multi_entries,
+                  const unsigned char* bytes, unsigned int size, unsigned char* bytes_out, unsigned int symbols) {
+
+    if(table_bits < BIT_IO_MIN_TABLE_BITS || table_bits > BIT_IO_MAX_TABLE_BITS) {
+        return HUFFMAN_ENCODING_ERROR;
+    }
+
+    const decode_kernel (*kernels)[4] = generic_decoders;
+#ifdef BIT_IO_BMI2
+    if(cpu_has_bmi2()) {
+        kernels = bmi2_decoders;
+    }
+#endif
+
+    return kernels[multi_entries != NULL][table_bits - BIT_IO_MIN_TABLE_BITS](context_entries, multi_entries, bytes, size,
+                                                                              bytes_out, symbols);
+}
@@ -0,0 +1,78 @@
+/**
+ * Copyright (c) 2011-2014, Vasileios Daras. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+#ifndef BIT_IO_H
+#define BIT_IO_H
+
+/* Longest code bit_io_encode can write. */
+#define BIT_IO_MAX_CODE_LENGTH 27
+
+/**
+ * An encode table entry packs a code, most significant bit first, above its
+ * length in the low 5 bits, so a byte's code is found with a single load.
+ */
+#define BIT_IO_CODE(code, length) (((code) << 5) | (length))
+#define BIT_IO_CODE_LENGTH(entry) ((entry) & 0x1F)
+#define BIT_IO_CODE_BITS(entry) ((entry) >> 5)
+
+/* Primary widths of the decode tables bit_io_decode can read. */
+#define BIT_IO_MIN_TABLE_BITS 9
+#define BIT_IO_MAX_TABLE_BITS 12
+
+/**
+ * The bit I/O kernels come in a generic version and, on x86 processors that
+ * support BMI2, a version compiled to use its shift instructions. The
+ * version is picked on the first call and both produce identical output.
+ * Defining BIT_IO_GENERIC_ONLY leaves out the BMI2 version.
+ */
+
+/**
+ * Codes bytes most significant bit first, each with the code of the table
+ * of the byte before it. The first byte uses the table of context 0.
+ *
+ * @param bytes Bytes to code.
+ * @param size Number of bytes.
+ * @param context_codes Encode table of each context, indexed by byte, with codes of at most BIT_IO_MAX_CODE_LENGTH bits.
+ * @param bytes_out(out) Coded bytes, with the last byte padded with 0 bits.
+ * @param out_cap Size of bytes_out.
+ * @param produced(out) Number of coded bytes.
+ * @return HUFFMAN_ENCODING_ERROR if the coded bytes don't fit in out_cap bytes.
+ */
+int bit_io_encode(const unsigned char* bytes, unsigned int size, const unsigned int* const context_codes[256],
+                  unsigned char* bytes_out, unsigned int out_cap, unsigned int* produced);
+
+/**
+ * Decodes bytes coded by bit_io_encode with decode tables created by
+ * huffman_decode_table_create_codes. With multi_entries, runs of short codes
+ * are decoded a lookup at a time, which only holds when every context has
+ * the same table.
+ *
+ * @param table_bits Primary width of the tables, from BIT_IO_MIN_TABLE_BITS to BIT_IO_MAX_TABLE_BITS.
+ * @param context_entries Entries of each context's decode table.
+ * @param multi_entries Multi-symbol entries of the table every context has, or NULL to decode a symbol at a time.
+ * @param bytes Coded bytes.
+ * @param size Number of coded bytes.
+ * @param bytes_out(out) Decoded bytes.
+ * @param symbols Number of bytes to decode.
+ * @return HUFFMAN_ENCODING_ERROR if the coded bytes are invalid or run out.
+ */
+int bit_io_decode(int table_bits, const unsigned int* const context_entries[256], const unsigned int* multi_entries,
+                  const unsigned char* bytes, unsigned int size, unsigned char* bytes_out, unsigned int symbols);
+
+#endif //BIT_IO_H
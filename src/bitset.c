@@ -162,19 +162,64 @@ int bitset_copy_bits(bitset* copy_of, bitset** copy, int n_bits) {
 }
 
 
+/*
+ * Serialized bitsets are little-endian whatever the host: the size as 4 bytes
+ * followed by each bucket as 2 bytes. That is the layout little-endian hosts
+ * always wrote, so files written before it was fixed still read the same.
+ */
+static void write_header(unsigned int total_bits, unsigned char* bytes) {
+    for(unsigned int i = 0; i < sizeof(unsigned int); i++) {
+        bytes[i] = (unsigned char) (total_bits >> (8 * i));
+    }
+}
+
+static unsigned int read_header(const unsigned char* bytes) {
+    unsigned int total_bits = 0;
+    for(unsigned int i = 0; i < sizeof(unsigned int); i++) {
+        total_bits |= (unsigned int) bytes[i] << (8 * i);
+    }
+    return total_bits;
+}
+
+static void write_buckets(const unsigned short int* buckets, int buffer_size, unsigned char* bytes) {
+    for(int i = 0; i < buffer_size / SHORT_INT_SIZE; i++) {
+        bytes[2 * i] = (unsigned char) buckets[i];
+        bytes[2 * i + 1] = (unsigned char) (buckets[i] >> 8);
+    }
+}
+
+static void read_buckets(const unsigned char* bytes, int buffer_size, unsigned short int* buckets) {
+    for(int i = 0; i < buffer_size / SHORT_INT_SIZE; i++) {
+        buckets[i] = (unsigned short int) (bytes[2 * i] | bytes[2 * i + 1] << 8);
+    }
+}
+
 void bitset_serialize(bitset* bset, FILE* fp) {
 
-    fwrite(&bset->total_bits, 1, sizeof(unsigned int), fp);
+    unsigned char header[sizeof(unsigned int)];
+    write_header(bset->total_bits, header);
+    fwrite(header, 1, sizeof(unsigned int), fp);
 
     int buffer_size = calculate_buffer_size(bset->total_bits);
-    fwrite(bset->bit_buffer, buffer_size, 1, fp);
+    for(int i = 0; i < buffer_size / SHORT_INT_SIZE; i++) {
+        unsigned char bytes[2];
+        write_buckets(&bset->bit_buffer[i], SHORT_INT_SIZE, bytes);
+        fwrite(bytes, 1, 2, fp);
+    }
 }
 
 
-int bitset_deserialize(bitset** bset, FILE* fp) {
+int bitset_deserialize(bitset** bset, FILE* fp, unsigned int max_bits) {
 
-    int bitset_size;
-    fread(&bitset_size, 1, sizeof(unsigned int), fp);
+    unsigned char header[sizeof(unsigned int)];
+    if(fread(header, sizeof(unsigned int), 1, fp) != 1) {
+        return BITSET_OUT_OF_BOUNDS;
+    }
+
+    unsigned int bitset_size = read_header(header);
+    if(bitset_size > max_bits) {
+        return BITSET_OUT_OF_BOUNDS;
+    }
 
     bitset* out;
     int creation_status = bitset_create(&out, bitset_size);
@@ -183,9 +228,60 @@ int bitset_deserialize(bitset** bset, FILE* fp) {
     } 
 
     int buffer_size = calculate_buffer_size(bitset_size);
-    fread(out->bit_buffer, buffer_size, 1, fp);
+    for(int i = 0; i < buffer_size / SHORT_INT_SIZE; i++) {
+        unsigned char bytes[2];
+        if(fread(bytes, 2, 1, fp) != 1) {
+            bitset_destroy(&out);
+            return BITSET_OUT_OF_BOUNDS;
+        }
+        read_buckets(bytes, SHORT_INT_SIZE, &out->bit_buffer[i]);
+    }
 
     (*bset) = out;
     return BITSET_SUCCESS;
 }
 
+unsigned int bitset_serialized_size(bitset* bset) {
+    return sizeof(unsigned int) + calculate_buffer_size(bset->total_bits);
+}
+
+unsigned int bitset_serialize_buffer(bitset* bset, unsigned char* buffer) {
+
+    write_header(bset->total_bits, buffer);
+
+    int buffer_size = calculate_buffer_size(bset->total_bits);
+    write_buckets(bset->bit_buffer, buffer_size, buffer + sizeof(unsigned int));
+
+    return sizeof(unsigned int) + buffer_size;
+}
+
+int bitset_deserialize_buffer(bitset** bset, const unsigned char* buffer, unsigned int size, unsigned int max_bits,
+                              unsigned int* bytes_read) {
+
+    if(size < sizeof(unsigned int)) {
+        return BITSET_OUT_OF_BOUNDS;
+    }
+
+    unsigned int bitset_size = read_header(buffer);
+
+    if(bitset_size > max_bits || bitset_size > (size - sizeof(unsigned int)) * 8) {
+        return BITSET_OUT_OF_BOUNDS;
+    }
+
+    int buffer_size = calculate_buffer_size(bitset_size);
+    if(buffer_size > size - sizeof(unsigned int)) {
+        return BITSET_OUT_OF_BOUNDS;
+    }
+
+    bitset* out;
+    int creation_status = bitset_create(&out, bitset_size);
+    if(creation_status != BITSET_SUCCESS) {
+        return creation_status;
+    }
+
+    read_buckets(buffer + sizeof(unsigned int), buffer_size, out->bit_buffer);
+
+    (*bset) = out;
+    (*bytes_read) = sizeof(unsigned int) + buffer_size;
+    return BITSET_SUCCESS;
+}
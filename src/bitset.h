@@ -116,8 +116,41 @@ void bitset_serialize(bitset* bset, FILE* fp);
  * 
  * @param bset(out) Deserialized bitset is stored in here.
  * @param fp File to read bitset from.
+ * @param max_bits Largest size accepted, larger bitsets fail with BITSET_OUT_OF_BOUNDS.
+ * @return A flag indicating if deserialization was successful, BITSET_OUT_OF_BOUNDS
+ *         if the bitset is too large or the file ends before it.
+ */
+int bitset_deserialize(bitset** bset, FILE* fp, unsigned int max_bits);
+
+/**
+ * Returns the number of bytes bitset_serialize writes for a bitset.
+ *
+ * @param bset The bitset.
+ * @return Serialized size in bytes.
+ */
+unsigned int bitset_serialized_size(bitset* bset);
+
+/**
+ * Serializes the bitset to a memory buffer, using the same layout as
+ * bitset_serialize. The buffer must hold bitset_serialized_size bytes.
+ *
+ * @param bset Bitset to serialize.
+ * @param buffer Buffer to serialize the bitset to.
+ * @return Number of bytes written.
+ */
+unsigned int bitset_serialize_buffer(bitset* bset, unsigned char* buffer);
+
+/**
+ * Reads a bitset from a memory buffer.
+ *
+ * @param bset(out) Deserialized bitset is stored in here.
+ * @param buffer Buffer to read bitset from.
+ * @param size Size of the buffer in bytes.
+ * @param max_bits Largest size accepted, larger bitsets fail with BITSET_OUT_OF_BOUNDS.
+ * @param bytes_read(out) Number of bytes the bitset occupied.
  * @return A flag indicating if deserialization was successful.
  */
-int bitset_deserialize(bitset** bset, FILE* fp);
+int bitset_deserialize_buffer(bitset** bset, const unsigned char* buffer, unsigned int size, unsigned int max_bits,
+                              unsigned int* bytes_read);
 
 #endif
\ No newline at end of file
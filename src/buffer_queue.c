@@ -0,0 +1,86 @@
+/**
+ * Copyright (c) 2011-2014, Vasileios Daras. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+#include "buffer_queue.h"
+#include <stdlib.h>
+
+int buffer_queue_create(buffer_queue** queue, int capacity) {
+    buffer_queue* retval = malloc(sizeof(buffer_queue));
+    if(retval == NULL) {
+        (*queue) = NULL;
+        return BUFFER_QUEUE_ALLOC_ERROR;
+    }
+
+    retval->items = malloc(sizeof(void*) * capacity);
+    if(retval->items == NULL) {
+        free(retval);
+        (*queue) = NULL;
+        return BUFFER_QUEUE_ALLOC_ERROR;
+    }
+
+    retval->capacity = capacity;
+    retval->head = 0;
+    retval->count = 0;
+    retval->closed = 0;
+    pthread_mutex_init(&retval->lock, NULL);
+    pthread_cond_init(&retval->changed, NULL);
+
+    (*queue) = retval;
+    return BUFFER_QUEUE_SUCCESS;
+}
+
+void buffer_queue_destroy(buffer_queue** queue) {
+    pthread_mutex_destroy(&(*queue)->lock);
+    pthread_cond_destroy(&(*queue)->changed);
+    free((*queue)->items);
+    free((*queue));
+    (*queue) = NULL;
+}
+
+void buffer_queue_push(buffer_queue* queue, void* item) {
+    pthread_mutex_lock(&queue->lock);
+    queue->items[(queue->head + queue->count) % queue->capacity] = item;
+    queue->count++;
+    pthread_cond_signal(&queue->changed);
+    pthread_mutex_unlock(&queue->lock);
+}
+
+int buffer_queue_pop(buffer_queue* queue, void** item) {
+    pthread_mutex_lock(&queue->lock);
+    while(queue->count == 0 && !queue->closed) {
+        pthread_cond_wait(&queue->changed, &queue->lock);
+    }
+
+    int taken = queue->count != 0;
+    if(taken) {
+        (*item) = queue->items[queue->head];
+        queue->head = (queue->head + 1) % queue->capacity;
+        queue->count--;
+    }
+    pthread_mutex_unlock(&queue->lock);
+
+    return taken;
+}
+
+void buffer_queue_close(buffer_queue* queue) {
+    pthread_mutex_lock(&queue->lock);
+    queue->closed = 1;
+    pthread_cond_broadcast(&queue->changed);
+    pthread_mutex_unlock(&queue->lock);
+}
@@ -0,0 +1,86 @@
+/**
+ * Copyright (c) 2011-2014, Vasileios Daras. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+#ifndef BUFFER_QUEUE_H
+#define BUFFER_QUEUE_H
+
+#include <pthread.h>
+
+#define BUFFER_QUEUE_SUCCESS 0
+#define BUFFER_QUEUE_ALLOC_ERROR -1
+
+/**
+ * A first in first out queue of pointers shared between threads. Items
+ * are taken in the order they are added, taking from an empty queue waits
+ * for an item, and once the queue is closed taking returns the remaining
+ * items and then nothing.
+ */
+typedef struct {
+    void** items;
+    int capacity;
+    int head;
+    int count;
+    int closed;
+
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+} buffer_queue;
+
+/**
+ * Creates a buffer queue.
+ *
+ * @param queue(out) Created queue is stored here. NULL if creation fails.
+ * @param capacity Most items the queue ever holds at once.
+ * @return A flag indicating if creation was successful.
+ */
+int buffer_queue_create(buffer_queue** queue, int capacity);
+
+/**
+ * Destroys a buffer queue, but not the items left in it.
+ *
+ * @param queue Queue to destroy, set to NULL after the call.
+ */
+void buffer_queue_destroy(buffer_queue** queue);
+
+/**
+ * Adds an item to the end of the queue. The queue must have room for it.
+ *
+ * @param queue The queue.
+ * @param item Item to add.
+ */
+void buffer_queue_push(buffer_queue* queue, void* item);
+
+/**
+ * Takes the item at the front of the queue, waiting for one if the queue
+ * is empty and not closed.
+ *
+ * @param queue The queue.
+ * @param item(out) The item taken.
+ * @return A flag indicating if an item was taken, 0 once the queue is closed and empty.
+ */
+int buffer_queue_pop(buffer_queue* queue, void** item);
+
+/**
+ * Closes the queue, waking everyone waiting for an item.
+ *
+ * @param queue The queue.
+ */
+void buffer_queue_close(buffer_queue* queue);
+
+#endif //BUFFER_QUEUE_H
@@ -0,0 +1,126 @@
+/**
+ * Copyright (c) 2011-2014, Vasileios Daras. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+#include "crc32c.h"
+#include <pthread.h>
+
+#if !defined(CRC32C_GENERIC_ONLY) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CRC32C_SSE42 1
+#include <nmmintrin.h>
+#endif
+
+/* The reflected Castagnoli polynomial. */
+static const unsigned int POLYNOMIAL = 0x82F63B78;
+
+/* tables[k][b] is the checksum of byte b followed by k zero bytes. */
+static unsigned int tables[8][256];
+static pthread_once_t tables_once = PTHREAD_ONCE_INIT;
+
+static void build_tables() {
+    for(unsigned int b = 0; b < 256; b++) {
+        unsigned int crc = b;
+        for(int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (POLYNOMIAL & -(crc & 1));
+        }
+        tables[0][b] = crc;
+    }
+
+    for(unsigned int b = 0; b < 256; b++) {
+        for(int k = 1; k < 8; k++) {
+            tables[k][b] = (tables[k - 1][b] >> 8) ^ tables[0][tables[k - 1][b] & 0xFF];
+        }
+    }
+}
+
+static unsigned int crc32c_generic(unsigned int crc, const unsigned char* bytes, unsigned int size) {
+
+    pthread_once(&tables_once, build_tables);
+
+    while(size >= 8) {
+        unsigned int low = crc ^ (bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | ((unsigned int) bytes[3] << 24));
+        crc = tables[7][low & 0xFF] ^ tables[6][(low >> 8) & 0xFF] ^ tables[5][(low >> 16) & 0xFF] ^ tables[4][low >> 24]
+            ^ tables[3][bytes[4]] ^ tables[2][bytes[5]] ^ tables[1][bytes[6]] ^ tables[0][bytes[7]];
+        bytes += 8;
+        size -= 8;
+    }
+
+    while(size != 0) {
+        crc = (crc >> 8) ^ tables[0][(crc ^ (*bytes)) & 0xFF];
+        bytes++;
+        size--;
+    }
+
+    return crc;
+}
+
+#ifdef CRC32C_SSE42
+
+__attribute__((target("sse4.2")))
+static unsigned int crc32c_sse42(unsigned int crc, const unsigned char* bytes, unsigned int size) {
+
+#ifdef __x86_64__
+    unsigned long long wide = crc;
+    while(size >= 8) {
+        unsigned long long word;
+        __builtin_memcpy(&word, bytes, 8);
+        wide = _mm_crc32_u64(wide, word);
+        bytes += 8;
+        size -= 8;
+    }
+    crc = (unsigned int) wide;
+#endif
+
+    while(size >= 4) {
+        unsigned int word;
+        __builtin_memcpy(&word, bytes, 4);
+        crc = _mm_crc32_u32(crc, word);
+        bytes += 4;
+        size -= 4;
+    }
+
+    while(size != 0) {
+        crc = _mm_crc32_u8(crc, (*bytes));
+        bytes++;
+        size--;
+    }
+
+    return crc;
+}
+
+/* -1 until the processor is checked. Threads racing to check it store the same value. */
+static volatile int has_sse42 = -1;
+
+static int cpu_has_sse42() {
+    if(has_sse42 < 0) {
+        __builtin_cpu_init();
+        has_sse42 = __builtin_cpu_supports("sse4.2") ? 1 : 0;
+    }
+    return has_sse42;
+}
+
+#endif
+
+unsigned int crc32c_update(unsigned int crc, const unsigned char* bytes, unsigned int size) {
+#ifdef CRC32C_SSE42
+    if(cpu_has_sse42()) {
+        return ~crc32c_sse42(~crc, bytes, size);
+    }
+#endif
+    return ~crc32c_generic(~crc, bytes, size);
+}
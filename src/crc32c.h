@@ -0,0 +1,43 @@
+/**
+ * Copyright (c) 2011-2014, Vasileios Daras. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+#ifndef CRC32C_H
+#define CRC32C_H
+
+/**
+ * CRC-32C (Castagnoli), the checksum of blocks and streams. The checksum is
+ * computed eight bytes at a time, with the SSE4.2 crc32 instruction on x86
+ * processors that have it and with tables elsewhere. Both give the same
+ * result.
+ * Defining CRC32C_GENERIC_ONLY leaves out the SSE4.2 version.
+ */
+
+/**
+ * Extends a checksum with more bytes. The checksum of no bytes is 0, and
+ * the checksum of the concatenation of two pieces is the checksum of the
+ * second piece started from the checksum of the first.
+ *
+ * @param crc Checksum of the bytes before these.
+ * @param bytes Bytes to add.
+ * @param size Number of bytes to add.
+ * @return The extended checksum.
+ */
+unsigned int crc32c_update(unsigned int crc, const unsigned char* bytes, unsigned int size);
+
+#endif //CRC32C_H
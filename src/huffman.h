@@ -0,0 +1,421 @@
+/**
+ * Copyright (c) 2011-2014, Vasileios Daras. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+#ifndef HUFFMAN_H
+#define HUFFMAN_H
+
+/**
+ * The public interface of libhuffman: compressing and decompressing whole
+ * files, streams that arrive in pieces and buffers held in memory. Only
+ * what is declared here is exported from the shared library.
+ */
+
+#include <stddef.h>
+#include <stdio.h>
+
+#define HUFFMAN_VERSION_MAJOR 1
+#define HUFFMAN_VERSION_MINOR 0
+#define HUFFMAN_VERSION_PATCH 0
+#define HUFFMAN_VERSION ((HUFFMAN_VERSION_MAJOR * 100 + HUFFMAN_VERSION_MINOR) * 100 + HUFFMAN_VERSION_PATCH)
+
+#if defined(__GNUC__)
+#define HUFFMAN_API __attribute__((visibility("default")))
+#else
+#define HUFFMAN_API
+#endif
+
+#define HUFFMAN_SUCCESS 0
+#define HUFFMAN_ALLOC_ERROR -1
+#define HUFFMAN_ENCODING_ERROR -2
+#define HUFFMAN_TREE_EMPTY -3
+#define HUFFMAN_IO_ERROR -4
+#define HUFFMAN_CHECKSUM_ERROR -5
+#define HUFFMAN_BUFFER_ERROR -6
+#define HUFFMAN_MEMORY_ERROR -7
+
+#define HUFFMAN_IO_STDIO 0
+#define HUFFMAN_IO_URING 1
+
+/* Returned once a stream's end block is decoded, or written, and all output is returned. */
+#define HUFFMAN_STREAM_END 1
+/* Returned by huffman_cstream_flush and huffman_cstream_end when output is left that didn't fit. */
+#define HUFFMAN_STREAM_PENDING 2
+
+/**
+ * Options and stats begin with the size of the struct a program was compiled
+ * with, which huffman_options_init and huffman_stats_init set. Fields are
+ * only ever added at the end, and the library gives options beyond a
+ * program's struct their defaults and writes no stats beyond it, so a
+ * program keeps working with later versions of the library.
+ */
+typedef struct {
+    /* Size of the struct, sizeof(huffman_options) where it was compiled. */
+    size_t struct_size;
+    /* Codes each byte with a table chosen by the byte before it. */
+    int order1;
+    /* Run-length encodes blocks before coding them. */
+    int rle;
+    /* Codes pairs of bytes as 16 bit symbols when that is smaller. */
+    int wide;
+    /* Builds the code of large blocks from a sample of their bytes, skipping order1 and wide for them. */
+    int fast;
+    /* Measures how much larger fast coding makes blocks than exact counts would, which costs a count of every byte. */
+    int stats;
+    /* I/O backend to read and write block streams with, HUFFMAN_IO_STDIO or HUFFMAN_IO_URING. */
+    int io;
+    /* Ends every block with a checksum of its bytes and the stream with a checksum of those. */
+    int checksum;
+    /* Checks the checksums of streams that have them while decoding, on by default. */
+    int verify;
+    /* Threads that decode files in the format written before blocks, 1 by default. */
+    int threads;
+    /* Bytes of memory coding a file may take, bounding its buffers, blocks and threads, 0 for no limit. */
+    size_t memory_limit;
+} huffman_options;
+
+/**
+ * Counts gathered while encoding. sampled_size is the size of the bodies of
+ * blocks coded from a sample and exact_size the size the same bodies would
+ * have with exact counts, which is only measured with the stats option.
+ * planned_memory is the memory planned for the pipeline's buffers and the
+ * encoder, which is what the memory_limit option bounds. Memory taken by
+ * the I/O backend and by trees and code tables is not counted.
+ */
+typedef struct {
+    /* Size of the struct, sizeof(huffman_stats) where it was compiled. */
+    size_t struct_size;
+    unsigned long long input_size;
+    unsigned long long output_size;
+    unsigned int blocks;
+    unsigned int stored_blocks;
+    unsigned int repeated_blocks;
+    unsigned int sampled_blocks;
+    unsigned long long sampled_size;
+    unsigned long long exact_size;
+    unsigned long long planned_memory;
+} huffman_stats;
+
+/**
+ * Initializes options to their defaults. Called through
+ * huffman_options_init, which passes the size of the caller's struct.
+ *
+ * @param options Options to initialize.
+ * @param size Size of the struct options points to.
+ */
+HUFFMAN_API void huffman_options_init_size(huffman_options* options, size_t size);
+
+#define huffman_options_init(options) huffman_options_init_size((options), sizeof(huffman_options))
+
+/**
+ * Initializes stats to zero counts, which is needed before they are passed
+ * to the library. Called through huffman_stats_init, which passes the size
+ * of the caller's struct.
+ *
+ * @param stats Stats to initialize.
+ * @param size Size of the struct stats points to.
+ */
+HUFFMAN_API void huffman_stats_init_size(huffman_stats* stats, size_t size);
+
+#define huffman_stats_init(stats) huffman_stats_init_size((stats), sizeof(huffman_stats))
+
+/**
+ * Encodes a file using huffman code.
+ * 
+ * @param in file to encode
+ * @param out output file
+ * @return A flag indicating if encoding was successful.
+ */
+HUFFMAN_API int huffman_encode(FILE* in, FILE* out);
+
+/**
+ * Encodes a file using huffman code.
+ *
+ * @param in file to encode
+ * @param out output file
+ * @param options options to encode the file with
+ * @return A flag indicating if encoding was successful.
+ */
+HUFFMAN_API int huffman_encode_with_options(FILE* in, FILE* out, const huffman_options* options);
+
+/**
+ * Encodes a file using huffman code and reports how it was encoded.
+ *
+ * @param in file to encode
+ * @param out output file
+ * @param options options to encode the file with
+ * @param stats(out) counts gathered while encoding the file
+ * @return A flag indicating if encoding was successful.
+ */
+HUFFMAN_API int huffman_encode_with_stats(FILE* in, FILE* out, const huffman_options* options, huffman_stats* stats);
+
+/**
+ * Estimates the size a file compresses to without compressing it. Each
+ * block's bytes are counted, or sampled with the fast option, and only its
+ * code lengths are computed, so nothing is coded or written. The rle and
+ * wide options, and blocks reusing the tables of the block before, are not
+ * considered.
+ *
+ * @param in file to estimate
+ * @param options options the file would be compressed with
+ * @param stats(out) counts compressing the file would gather, with the estimated size as output_size
+ * @return A flag indicating if estimating was successful.
+ */
+HUFFMAN_API int huffman_estimate(FILE* in, const huffman_options* options, huffman_stats* stats);
+
+/**
+ * Decodes a file using huffman code.
+ * 
+ * @param in file to decode
+ * @param out output file
+ */
+HUFFMAN_API int huffman_decode(FILE* in, FILE* out);
+
+/**
+ * Decodes a file using huffman code.
+ *
+ * @param in file to decode
+ * @param out output file
+ * @param options options holding the I/O backend to use
+ * @return A flag indicating if decoding was successful.
+ */
+HUFFMAN_API int huffman_decode_with_options(FILE* in, FILE* out, const huffman_options* options);
+
+/**
+ * Decodes a compressed stream starting at the current position of a file,
+ * stopping right after the stream's end. Unlike huffman_decode, files in
+ * the format written before streams were split into blocks are rejected.
+ *
+ * @param in file to decode
+ * @param out output file
+ * @return A flag indicating if decoding was successful.
+ */
+HUFFMAN_API int huffman_decode_stream(FILE* in, FILE* out);
+
+/**
+ * Describes a status code returned by the encoder or decoder.
+ *
+ * @param status The status code.
+ * @return A description of the status.
+ */
+HUFFMAN_API const char* huffman_error_string(int status);
+
+/**
+ * Returns the version of the library, which may differ from the version of
+ * the header a program was compiled with.
+ *
+ * @return HUFFMAN_VERSION of the library.
+ */
+HUFFMAN_API int huffman_version();
+
+/**
+ * Decoder for a compressed stream that arrives in pieces, with memory use
+ * bounded by the size of a block whatever the size of the stream.
+ */
+typedef struct huffman_dstream_t huffman_dstream;
+
+/**
+ * Creates a stream decoder.
+ *
+ * @param stream(out) Created decoder is stored here. NULL if creation fails.
+ * @return A flag indicating if creation was successful.
+ */
+HUFFMAN_API int huffman_dstream_create(huffman_dstream** stream);
+
+/**
+ * Destroys a stream decoder.
+ *
+ * @param stream Decoder to destroy, set to NULL after the call.
+ */
+HUFFMAN_API void huffman_dstream_destroy(huffman_dstream** stream);
+
+/**
+ * Gives the decoder the next piece of a compressed stream and takes as
+ * much decoded output as fits in out. Decoding stops when either the input
+ * is used up or out is full, so the call is repeated with the rest of the
+ * input, or with no input at all, until it consumes and produces nothing.
+ * An error stops the decoder for good.
+ *
+ * @param stream The decoder.
+ * @param in Next bytes of the compressed stream.
+ * @param in_len Number of bytes in in.
+ * @param consumed(out) Number of bytes of in the decoder used.
+ * @param out Buffer for decoded bytes.
+ * @param out_cap Size of out.
+ * @param produced(out) Number of decoded bytes written to out.
+ * @return HUFFMAN_STREAM_END when the whole stream is decoded, HUFFMAN_SUCCESS
+ *         when more input or output space is needed, or an error.
+ */
+HUFFMAN_API int huffman_dstream_feed(huffman_dstream* stream, const unsigned char* in, size_t in_len, size_t* consumed,
+                                     unsigned char* out, size_t out_cap, size_t* produced);
+
+/**
+ * Compressor for data that arrives in pieces, which compresses it in
+ * blocks as they fill up or are flushed.
+ */
+typedef struct huffman_cstream_t huffman_cstream;
+
+/**
+ * Creates a stream compressor.
+ *
+ * @param stream(out) Created compressor is stored here. NULL if creation fails.
+ * @param options Options to compress the stream with.
+ * @return A flag indicating if creation was successful.
+ */
+HUFFMAN_API int huffman_cstream_create(huffman_cstream** stream, const huffman_options* options);
+
+/**
+ * Destroys a stream compressor.
+ *
+ * @param stream Compressor to destroy, set to NULL after the call.
+ */
+HUFFMAN_API void huffman_cstream_destroy(huffman_cstream** stream);
+
+/**
+ * Gives the compressor the next piece of the stream and takes as much
+ * compressed output as fits in out. Input stops being taken when a full
+ * block is compressed and its output doesn't fit, so the call is repeated
+ * with the rest of the input.
+ *
+ * @param stream The compressor.
+ * @param in Next bytes of the stream.
+ * @param in_len Number of bytes in in.
+ * @param consumed(out) Number of bytes of in the compressor took.
+ * @param out Buffer for compressed bytes.
+ * @param out_cap Size of out.
+ * @param produced(out) Number of compressed bytes written to out.
+ * @return A flag indicating if compression was successful.
+ */
+HUFFMAN_API int huffman_cstream_write(huffman_cstream* stream, const unsigned char* in, size_t in_len, size_t* consumed,
+                                      unsigned char* out, size_t out_cap, size_t* produced);
+
+/**
+ * Compresses the input taken so far as a block of its own, so that
+ * everything written before the call can be decoded from the output.
+ *
+ * @param stream The compressor.
+ * @param out Buffer for compressed bytes.
+ * @param out_cap Size of out.
+ * @param produced(out) Number of compressed bytes written to out.
+ * @return HUFFMAN_SUCCESS once all output is returned, HUFFMAN_STREAM_PENDING
+ *         if the call has to be repeated for the rest, or an error.
+ */
+HUFFMAN_API int huffman_cstream_flush(huffman_cstream* stream, unsigned char* out, size_t out_cap, size_t* produced);
+
+/**
+ * Flushes the compressor and ends the stream. No more input can be written.
+ *
+ * @param stream The compressor.
+ * @param out Buffer for compressed bytes.
+ * @param out_cap Size of out.
+ * @param produced(out) Number of compressed bytes written to out.
+ * @return HUFFMAN_STREAM_END once all output is returned, HUFFMAN_STREAM_PENDING
+ *         if the call has to be repeated for the rest, or an error.
+ */
+HUFFMAN_API int huffman_cstream_end(huffman_cstream* stream, unsigned char* out, size_t out_cap, size_t* produced);
+
+/**
+ * A compressor and decompressor for buffers, which keeps its memory from
+ * one call to the next. A context is used by one thread at a time, so
+ * threads compressing at once each create their own.
+ */
+typedef struct huffman_context_t huffman_context;
+
+/**
+ * Creates a context.
+ *
+ * @param context(out) Created context is stored here. NULL if creation fails.
+ * @param options Options to compress with, and the verify option for decompressing.
+ * @return A flag indicating if creation was successful.
+ */
+HUFFMAN_API int huffman_context_create(huffman_context** context, const huffman_options* options);
+
+/**
+ * Destroys a context.
+ *
+ * @param context Context to destroy, set to NULL after the call.
+ */
+HUFFMAN_API void huffman_context_destroy(huffman_context** context);
+
+/**
+ * Compresses a buffer into a complete stream.
+ *
+ * @param context The context.
+ * @param in Bytes to compress.
+ * @param in_len Number of bytes to compress.
+ * @param out Buffer for the compressed stream, huffman_compress_bound(in_len) bytes are always enough.
+ * @param out_cap Size of out.
+ * @param out_len(out) Size of the compressed stream.
+ * @return A flag indicating if compression was successful, HUFFMAN_BUFFER_ERROR if out is too small.
+ */
+HUFFMAN_API int huffman_context_compress(huffman_context* context, const unsigned char* in, size_t in_len,
+                                         unsigned char* out, size_t out_cap, size_t* out_len);
+
+/**
+ * Decompresses a complete stream held in a buffer. Only streams in the
+ * block format are accepted, and bytes after the end of the stream are
+ * ignored.
+ *
+ * @param context The context.
+ * @param in The compressed stream.
+ * @param in_len Size of the compressed stream.
+ * @param out Buffer for the decompressed bytes.
+ * @param out_cap Size of out.
+ * @param out_len(out) Number of decompressed bytes.
+ * @return A flag indicating if decompression was successful, HUFFMAN_BUFFER_ERROR if out is too small.
+ */
+HUFFMAN_API int huffman_context_decompress(huffman_context* context, const unsigned char* in, size_t in_len,
+                                           unsigned char* out, size_t out_cap, size_t* out_len);
+
+/**
+ * Returns the largest size a compressed stream of a number of bytes can
+ * have, with any options.
+ *
+ * @param in_len Number of bytes to compress.
+ * @return The largest size of their compressed stream.
+ */
+HUFFMAN_API size_t huffman_compress_bound(size_t in_len);
+
+/**
+ * Compresses a buffer into a complete stream with a context of its own.
+ * See huffman_context_compress.
+ */
+HUFFMAN_API int huffman_compress_buffer(const huffman_options* options, const unsigned char* in, size_t in_len,
+                                        unsigned char* out, size_t out_cap, size_t* out_len);
+
+/**
+ * Decompresses a complete stream held in a buffer with a context of its
+ * own. See huffman_context_decompress.
+ */
+HUFFMAN_API int huffman_decompress_buffer(const huffman_options* options, const unsigned char* in, size_t in_len,
+                                          unsigned char* out, size_t out_cap, size_t* out_len);
+
+/**
+ * Estimates the size a buffer compresses to without compressing it. See
+ * huffman_estimate.
+ *
+ * @param options Options the buffer would be compressed with.
+ * @param in Bytes to estimate.
+ * @param in_len Number of bytes.
+ * @param out_len(out) Estimated size of the compressed stream.
+ * @return A flag indicating if estimating was successful.
+ */
+HUFFMAN_API int huffman_estimate_buffer(const huffman_options* options, const unsigned char* in, size_t in_len,
+                                        size_t* out_len);
+
+#endif //HUFFMAN_H
@@ -0,0 +1,280 @@
+/**
+ * Copyright (c) 2011-2014, Vasileios Daras. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+#include "huffman_archive.h"
+#include "huffman_tree.h"
+#include <stdlib.h>
+#include <string.h>
+
+static const unsigned char ARCHIVE_MAGIC[4] = { 'H', 'U', 'F', 'A' };
+static const unsigned char ARCHIVE_VERSION = 1;
+
+/* Each directory entry holds a name length, the name and three sizes. */
+static const unsigned int ENTRY_FIXED_SIZE = 2 + 3 * 8;
+
+static void write_u64(unsigned char* buffer, unsigned long long value) {
+    for(int i = 0; i < 8; i++) {
+        buffer[i] = (value >> (8 * i)) & 0xFF;
+    }
+}
+
+static unsigned long long read_u64(const unsigned char* buffer) {
+    unsigned long long value = 0;
+    for(int i = 0; i < 8; i++) {
+        value |= (unsigned long long) buffer[i] << (8 * i);
+    }
+    return value;
+}
+
+static int write_entry(FILE* out, const huffman_archive_entry* entry) {
+    size_t name_length = strlen(entry->name);
+    unsigned char fixed[2 + 3 * 8];
+
+    fixed[0] = name_length & 0xFF;
+    fixed[1] = (name_length >> 8) & 0xFF;
+    write_u64(fixed + 2, entry->offset);
+    write_u64(fixed + 10, entry->compressed_size);
+    write_u64(fixed + 18, entry->original_size);
+
+    if(fwrite(fixed, 1, 2, out) != 2
+    || fwrite(entry->name, 1, name_length, out) != name_length
+    || fwrite(fixed + 2, 1, 3 * 8, out) != 3 * 8) {
+        return HUFFMAN_IO_ERROR;
+    }
+
+    return HUFFMAN_SUCCESS;
+}
+
+int huffman_archive_write(FILE* out, char** names, int count, const huffman_options* options, int* failed) {
+
+    (*failed) = -1;
+
+    unsigned char header[HUFFMAN_ARCHIVE_HEADER_SIZE];
+    memcpy(header, ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC));
+    header[4] = ARCHIVE_VERSION;
+    if(fwrite(header, 1, HUFFMAN_ARCHIVE_HEADER_SIZE, out) != HUFFMAN_ARCHIVE_HEADER_SIZE) {
+        return HUFFMAN_IO_ERROR;
+    }
+
+    huffman_archive_entry* entries = calloc(count, sizeof(huffman_archive_entry));
+    if(entries == NULL && count > 0) {
+        return HUFFMAN_ALLOC_ERROR;
+    }
+
+    int retval = HUFFMAN_SUCCESS;
+    unsigned long long offset = HUFFMAN_ARCHIVE_HEADER_SIZE;
+
+    for(int i = 0; i < count && retval == HUFFMAN_SUCCESS; i++) {
+        if(strlen(names[i]) > HUFFMAN_ARCHIVE_MAX_NAME) {
+            (*failed) = i;
+            retval = HUFFMAN_ENCODING_ERROR;
+            break;
+        }
+
+        FILE* in = fopen(names[i], "rb");
+        if(in == NULL) {
+            (*failed) = i;
+            retval = HUFFMAN_IO_ERROR;
+            break;
+        }
+
+        retval = huffman_encode_with_options(in, out, options);
+        if(retval != HUFFMAN_SUCCESS) {
+            (*failed) = i;
+        }
+
+        entries[i].name = names[i];
+        entries[i].offset = offset;
+        entries[i].original_size = ftell(in);
+        fclose(in);
+
+        long end = ftell(out);
+        if(end < 0) {
+            retval = HUFFMAN_IO_ERROR;
+        }
+        entries[i].compressed_size = end - offset;
+        offset = end;
+    }
+
+    if(retval == HUFFMAN_SUCCESS) {
+        for(int i = 0; i < count && retval == HUFFMAN_SUCCESS; i++) {
+            retval = write_entry(out, &entries[i]);
+        }
+    }
+
+    if(retval == HUFFMAN_SUCCESS) {
+        unsigned char trailer[HUFFMAN_ARCHIVE_TRAILER_SIZE];
+        write_u64(trailer, offset);
+        trailer[8] = count & 0xFF;
+        trailer[9] = (count >> 8) & 0xFF;
+        trailer[10] = (count >> 16) & 0xFF;
+        trailer[11] = (count >> 24) & 0xFF;
+        memcpy(trailer + 12, ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC));
+
+        if(fwrite(trailer, 1, HUFFMAN_ARCHIVE_TRAILER_SIZE, out) != HUFFMAN_ARCHIVE_TRAILER_SIZE) {
+            retval = HUFFMAN_IO_ERROR;
+        }
+    }
+
+    free(entries);
+    return retval;
+}
+
+static void free_entries(huffman_archive_entry* entries, unsigned int count) {
+    for(unsigned int i = 0; i < count; i++) {
+        free(entries[i].name);
+    }
+    free(entries);
+}
+
+static int read_directory(huffman_archive* archive, const unsigned char* directory, unsigned long long size,
+                          unsigned long long directory_offset) {
+
+    unsigned long long position = 0;
+
+    for(unsigned int i = 0; i < archive->entry_count; i++) {
+        if(size - position < ENTRY_FIXED_SIZE) {
+            return HUFFMAN_ENCODING_ERROR;
+        }
+
+        unsigned int name_length = directory[position] | (directory[position + 1] << 8);
+        position += 2;
+        if(size - position < name_length + 3 * 8) {
+            return HUFFMAN_ENCODING_ERROR;
+        }
+
+        huffman_archive_entry* entry = &archive->entries[i];
+        entry->name = malloc(name_length + 1);
+        if(entry->name == NULL) {
+            return HUFFMAN_ALLOC_ERROR;
+        }
+        memcpy(entry->name, directory + position, name_length);
+        entry->name[name_length] = '\0';
+        position += name_length;
+
+        entry->offset = read_u64(directory + position);
+        entry->compressed_size = read_u64(directory + position + 8);
+        entry->original_size = read_u64(directory + position + 16);
+        position += 3 * 8;
+
+        if(entry->offset < HUFFMAN_ARCHIVE_HEADER_SIZE || entry->offset > directory_offset
+        || entry->compressed_size > directory_offset - entry->offset) {
+            return HUFFMAN_ENCODING_ERROR;
+        }
+    }
+
+    return position == size ? HUFFMAN_SUCCESS : HUFFMAN_ENCODING_ERROR;
+}
+
+int huffman_archive_open(huffman_archive** archive, FILE* fp) {
+
+    (*archive) = NULL;
+
+    unsigned char header[HUFFMAN_ARCHIVE_HEADER_SIZE];
+    unsigned char trailer[HUFFMAN_ARCHIVE_TRAILER_SIZE];
+
+    if(fseek(fp, 0, SEEK_SET) != 0
+    || fread(header, 1, HUFFMAN_ARCHIVE_HEADER_SIZE, fp) != HUFFMAN_ARCHIVE_HEADER_SIZE
+    || memcmp(header, ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC)) != 0 || header[4] != ARCHIVE_VERSION) {
+        return HUFFMAN_ENCODING_ERROR;
+    }
+
+    if(fseek(fp, 0, SEEK_END) != 0) {
+        return HUFFMAN_IO_ERROR;
+    }
+
+    long archive_size = ftell(fp);
+    if(archive_size < HUFFMAN_ARCHIVE_HEADER_SIZE + HUFFMAN_ARCHIVE_TRAILER_SIZE
+    || fseek(fp, archive_size - HUFFMAN_ARCHIVE_TRAILER_SIZE, SEEK_SET) != 0
+    || fread(trailer, 1, HUFFMAN_ARCHIVE_TRAILER_SIZE, fp) != HUFFMAN_ARCHIVE_TRAILER_SIZE
+    || memcmp(trailer + 12, ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC)) != 0) {
+        return HUFFMAN_ENCODING_ERROR;
+    }
+
+    unsigned long long directory_offset = read_u64(trailer);
+    unsigned long long directory_end = archive_size - HUFFMAN_ARCHIVE_TRAILER_SIZE;
+    unsigned int entry_count = trailer[8] | (trailer[9] << 8) | (trailer[10] << 16) | ((unsigned int) trailer[11] << 24);
+
+    if(directory_offset < HUFFMAN_ARCHIVE_HEADER_SIZE || directory_offset > directory_end
+    || entry_count > (directory_end - directory_offset) / ENTRY_FIXED_SIZE) {
+        return HUFFMAN_ENCODING_ERROR;
+    }
+
+    unsigned long long directory_size = directory_end - directory_offset;
+    unsigned char* directory = malloc(directory_size + 1);
+    huffman_archive* retval = malloc(sizeof(huffman_archive));
+    huffman_archive_entry* entries = calloc(entry_count + 1, sizeof(huffman_archive_entry));
+    if(directory == NULL || retval == NULL || entries == NULL) {
+        free(directory);
+        free(retval);
+        free(entries);
+        return HUFFMAN_ALLOC_ERROR;
+    }
+
+    retval->fp = fp;
+    retval->entry_count = entry_count;
+    retval->entries = entries;
+
+    int status = HUFFMAN_SUCCESS;
+    if(fseek(fp, directory_offset, SEEK_SET) != 0 || fread(directory, 1, directory_size, fp) != directory_size) {
+        status = HUFFMAN_IO_ERROR;
+    } else {
+        status = read_directory(retval, directory, directory_size, directory_offset);
+    }
+
+    free(directory);
+    if(status != HUFFMAN_SUCCESS) {
+        free_entries(entries, entry_count);
+        free(retval);
+        return status;
+    }
+
+    (*archive) = retval;
+    return HUFFMAN_SUCCESS;
+}
+
+void huffman_archive_close(huffman_archive** archive) {
+    fclose((*archive)->fp);
+    free_entries((*archive)->entries, (*archive)->entry_count);
+    free((*archive));
+    (*archive) = NULL;
+}
+
+int huffman_archive_find(huffman_archive* archive, const char* name) {
+    for(unsigned int i = 0; i < archive->entry_count; i++) {
+        if(strcmp(archive->entries[i].name, name) == 0) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+int huffman_archive_extract(huffman_archive* archive, unsigned int index, FILE* out) {
+
+    if(index >= archive->entry_count) {
+        return HUFFMAN_ENCODING_ERROR;
+    }
+
+    if(fseek(archive->fp, archive->entries[index].offset, SEEK_SET) != 0) {
+        return HUFFMAN_IO_ERROR;
+    }
+
+    return huffman_decode_stream(archive->fp, out);
+}
@@ -0,0 +1,100 @@
+/**
+ * Copyright (c) 2011-2014, Vasileios Daras. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+#ifndef HUFFMAN_ARCHIVE_H
+#define HUFFMAN_ARCHIVE_H
+
+#include <stdio.h>
+#include "huffman_encoding.h"
+
+#define HUFFMAN_ARCHIVE_HEADER_SIZE 5
+#define HUFFMAN_ARCHIVE_TRAILER_SIZE 16
+#define HUFFMAN_ARCHIVE_MAX_NAME 65535
+
+/**
+ * An archive starts with a header and holds one compressed stream per
+ * member, one after the other, followed by a central directory with the
+ * name, offset, compressed size and original size of every member. The
+ * archive ends with a trailer holding the directory's offset and the
+ * number of members, so a member is found by reading the directory from
+ * the end of the archive and decoded after a single seek to its offset.
+ */
+typedef struct {
+    char* name;
+    unsigned long long offset;
+    unsigned long long compressed_size;
+    unsigned long long original_size;
+} huffman_archive_entry;
+
+typedef struct {
+    FILE* fp;
+    unsigned int entry_count;
+    huffman_archive_entry* entries;
+} huffman_archive;
+
+/**
+ * Creates an archive holding a set of files.
+ *
+ * @param out File to write the archive to.
+ * @param names Files to store in the archive.
+ * @param count Number of files.
+ * @param options Options to compress the files with.
+ * @param failed(out) Index of the file that couldn't be stored, -1 if none
+ *        did or writing the archive itself failed.
+ * @return A flag indicating if creating the archive was successful.
+ *         HUFFMAN_IO_ERROR if a file can't be opened or read.
+ */
+int huffman_archive_write(FILE* out, char** names, int count, const huffman_options* options, int* failed);
+
+/**
+ * Opens an archive and reads its central directory.
+ *
+ * @param archive(out) Opened archive is stored here. NULL if opening fails.
+ * @param fp File holding the archive, owned by the archive afterwards.
+ * @return A flag indicating if opening the archive was successful.
+ */
+int huffman_archive_open(huffman_archive** archive, FILE* fp);
+
+/**
+ * Closes an archive and the file holding it.
+ *
+ * @param archive Archive to close, set to NULL after the call.
+ */
+void huffman_archive_close(huffman_archive** archive);
+
+/**
+ * Finds a member of an archive by name.
+ *
+ * @param archive The archive.
+ * @param name The member's name.
+ * @return The member's index in the archive's entries, -1 if there is no such member.
+ */
+int huffman_archive_find(huffman_archive* archive, const char* name);
+
+/**
+ * Decompresses a member of an archive.
+ *
+ * @param archive The archive.
+ * @param index The member's index in the archive's entries.
+ * @param out File to decompress the member to.
+ * @return A flag indicating if decompression was successful.
+ */
+int huffman_archive_extract(huffman_archive* archive, unsigned int index, FILE* out);
+
+#endif //HUFFMAN_ARCHIVE_H
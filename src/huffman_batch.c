@@ -0,0 +1,288 @@
+/**
+ * Copyright (c) 2011-2014, Vasileios Daras. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+#include "huffman_batch.h"
+#include "huffman_tree.h"
+#include "thread_pool.h"
+#include "huffman_pipeline.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+typedef struct {
+    int compress;
+    const huffman_options* options;
+} batch_context;
+
+typedef struct {
+    const batch_context* context;
+    const char* in_name;
+    char* out_name;
+    long long in_size;
+    long long out_size;
+    int status;
+} batch_job;
+
+static int append_name(char*** names, int* count, int* capacity, const char* name) {
+    if((*count) == (*capacity)) {
+        int new_capacity = (*capacity) == 0 ? 64 : (*capacity) * 2;
+        char** temp = realloc((*names), sizeof(char*) * new_capacity);
+        if(temp == NULL) {
+            return HUFFMAN_ALLOC_ERROR;
+        }
+        (*names) = temp;
+        (*capacity) = new_capacity;
+    }
+
+    (*names)[(*count)] = strdup(name);
+    if((*names)[(*count)] == NULL) {
+        return HUFFMAN_ALLOC_ERROR;
+    }
+    (*count)++;
+
+    return HUFFMAN_SUCCESS;
+}
+
+static int append_list(char*** names, int* count, int* capacity, FILE* list) {
+    char* line = NULL;
+    size_t line_capacity = 0;
+    ssize_t length;
+    int retval = HUFFMAN_SUCCESS;
+
+    while(retval == HUFFMAN_SUCCESS && (length = getline(&line, &line_capacity, list)) != -1) {
+        while(length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r')) {
+            line[--length] = '\0';
+        }
+
+        if(length > 0) {
+            retval = append_name(names, count, capacity, line);
+        }
+    }
+
+    free(line);
+    return retval;
+}
+
+int huffman_batch_collect(char** args, int arg_count, char*** names, int* count) {
+    int capacity = 0;
+    int retval = HUFFMAN_SUCCESS;
+
+    (*names) = NULL;
+    (*count) = 0;
+
+    for(int i = 0; i < arg_count && retval == HUFFMAN_SUCCESS; i++) {
+        if(strcmp(args[i], "-") == 0) {
+            retval = append_list(names, count, &capacity, stdin);
+        } else if(args[i][0] == '@') {
+            FILE* list = fopen(args[i] + 1, "r");
+            if(list == NULL) {
+                printf("Can't open file list %s.\n", args[i] + 1);
+                retval = HUFFMAN_IO_ERROR;
+            } else {
+                retval = append_list(names, count, &capacity, list);
+                fclose(list);
+            }
+        } else {
+            retval = append_name(names, count, &capacity, args[i]);
+        }
+    }
+
+    if(retval != HUFFMAN_SUCCESS) {
+        huffman_batch_free_names((*names), (*count));
+        (*names) = NULL;
+        (*count) = 0;
+    }
+
+    return retval;
+}
+
+void huffman_batch_free_names(char** names, int count) {
+    for(int i = 0; i < count; i++) {
+        free(names[i]);
+    }
+    free(names);
+}
+
+static char* output_name(const char* name, int compress) {
+    size_t length = strlen(name);
+    size_t suffix_length = strlen(HUFFMAN_BATCH_SUFFIX);
+    char* retval = malloc(length + suffix_length + 1);
+    if(retval == NULL) {
+        return NULL;
+    }
+
+    strcpy(retval, name);
+    if(compress) {
+        strcat(retval, HUFFMAN_BATCH_SUFFIX);
+    } else if(length > suffix_length && strcmp(name + length - suffix_length, HUFFMAN_BATCH_SUFFIX) == 0) {
+        retval[length - suffix_length] = '\0';
+    } else {
+        strcat(retval, ".out");
+    }
+
+    return retval;
+}
+
+static void batch_job_run(void* arg) {
+    batch_job* job = (batch_job*) arg;
+
+    FILE* in = fopen(job->in_name, "rb");
+    if(in == NULL) {
+        job->status = HUFFMAN_IO_ERROR;
+        return;
+    }
+
+    FILE* out = fopen(job->out_name, "wb");
+    if(out == NULL) {
+        fclose(in);
+        job->status = HUFFMAN_IO_ERROR;
+        return;
+    }
+
+    if(job->context->compress) {
+        job->status = huffman_encode_with_options(in, out, job->context->options);
+    } else {
+        job->status = huffman_decode_with_options(in, out, job->context->options);
+    }
+
+    if(fflush(out) != 0 && job->status == HUFFMAN_SUCCESS) {
+        job->status = HUFFMAN_IO_ERROR;
+    }
+    job->out_size = ftell(out);
+
+    fclose(in);
+    if(fclose(out) != 0 && job->status == HUFFMAN_SUCCESS) {
+        job->status = HUFFMAN_IO_ERROR;
+    }
+
+    /* A failed job leaves no partial output behind, unless the output is a
+     * device or a pipe. */
+    struct stat info;
+    if(job->status != HUFFMAN_SUCCESS && stat(job->out_name, &info) == 0 && S_ISREG(info.st_mode)) {
+        remove(job->out_name);
+    }
+}
+
+static int compare_job_sizes(const void* job1, const void* job2) {
+    const batch_job* batch_job_1 = *(const batch_job**) job1;
+    const batch_job* batch_job_2 = *(const batch_job**) job2;
+
+    return batch_job_1->in_size > batch_job_2->in_size ? -1 :
+            batch_job_1->in_size == batch_job_2->in_size ? 0 : 1;
+}
+
+/**
+ * Jobs are submitted largest file first so that a large file picked up
+ * last doesn't keep one thread busy long after the others ran out of work.
+ * With a memory limit, no more files are processed at once than fit in it
+ * taking the least memory each, and each one gets an even share of it.
+ * That share always allows the blocks the whole limit does, so the output
+ * doesn't depend on the number of threads.
+ */
+int huffman_batch_run(char** names, int count, int compress, const huffman_options* options, int threads) {
+
+    huffman_options job_options = (*options);
+    batch_context context = { compress, &job_options };
+
+    if(options->memory_limit != 0) {
+        unsigned long long job_memory = huffman_pipeline_min_memory(options, compress);
+        if(job_memory > options->memory_limit) {
+            return HUFFMAN_MEMORY_ERROR;
+        }
+        if((unsigned long long) threads > options->memory_limit / job_memory) {
+            threads = (int) (options->memory_limit / job_memory);
+        }
+    }
+
+    batch_job* jobs = calloc(count, sizeof(batch_job));
+    batch_job** order = malloc(sizeof(batch_job*) * count);
+    if(jobs == NULL || (order == NULL && count > 0)) {
+        free(jobs);
+        free(order);
+        return HUFFMAN_ALLOC_ERROR;
+    }
+
+    int queued = 0;
+    for(int i = 0; i < count; i++) {
+        jobs[i].context = &context;
+        jobs[i].in_name = names[i];
+        jobs[i].status = HUFFMAN_SUCCESS;
+
+        struct stat file_stat;
+        if(stat(names[i], &file_stat) != 0 || !S_ISREG(file_stat.st_mode)) {
+            jobs[i].status = HUFFMAN_IO_ERROR;
+            continue;
+        }
+        jobs[i].in_size = file_stat.st_size;
+
+        jobs[i].out_name = output_name(names[i], compress);
+        if(jobs[i].out_name == NULL) {
+            jobs[i].status = HUFFMAN_ALLOC_ERROR;
+            continue;
+        }
+
+        order[queued] = &jobs[i];
+        queued++;
+    }
+
+    qsort(order, queued, sizeof(batch_job*), compare_job_sizes);
+
+    if(threads > queued) {
+        threads = queued;
+    }
+    if(options->memory_limit != 0 && threads > 0) {
+        job_options.memory_limit = options->memory_limit / threads;
+    }
+
+    thread_pool* pool = NULL;
+    if(threads > 0 && thread_pool_create(&pool, threads) != THREAD_POOL_SUCCESS) {
+        for(int i = 0; i < count; i++) {
+            free(jobs[i].out_name);
+        }
+        free(jobs);
+        free(order);
+        return HUFFMAN_ALLOC_ERROR;
+    }
+
+    for(int i = 0; i < queued; i++) {
+        if(thread_pool_submit(pool, batch_job_run, order[i]) != THREAD_POOL_SUCCESS) {
+            order[i]->status = HUFFMAN_ALLOC_ERROR;
+        }
+    }
+
+    if(pool != NULL) {
+        thread_pool_destroy(&pool);
+    }
+
+    int failed = 0;
+    for(int i = 0; i < count; i++) {
+        if(jobs[i].status == HUFFMAN_SUCCESS) {
+            printf("%s -> %s: %lld -> %lld bytes.\n", jobs[i].in_name, jobs[i].out_name, jobs[i].in_size, jobs[i].out_size);
+        } else {
+            printf("%s: %s.\n", jobs[i].in_name, huffman_error_string(jobs[i].status));
+            failed++;
+        }
+        free(jobs[i].out_name);
+    }
+
+    free(jobs);
+    free(order);
+    return failed;
+}
@@ -0,0 +1,66 @@
+/**
+ * Copyright (c) 2011-2014, Vasileios Daras. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+#ifndef HUFFMAN_BATCH_H
+#define HUFFMAN_BATCH_H
+
+#include "huffman_encoding.h"
+
+#define HUFFMAN_BATCH_SUFFIX ".huf"
+
+/**
+ * Builds the list of files to process from command line arguments. An
+ * argument of the form @listfile adds the files listed in listfile, one
+ * per line, and an argument of - adds the files listed on the standard
+ * input. Any other argument is a file name.
+ *
+ * @param args The arguments.
+ * @param arg_count Number of arguments.
+ * @param names(out) List of file names, freed with huffman_batch_free_names.
+ * @param count(out) Number of file names.
+ * @return A flag indicating if building the list was successful.
+ */
+int huffman_batch_collect(char** args, int arg_count, char*** names, int* count);
+
+/**
+ * Frees a list built by huffman_batch_collect.
+ *
+ * @param names The list.
+ * @param count Number of file names.
+ */
+void huffman_batch_free_names(char** names, int count);
+
+/**
+ * Compresses or decompresses files on a pool of threads, largest files
+ * first, and prints the outcome for each file in the order given. A file
+ * is compressed to its name followed by HUFFMAN_BATCH_SUFFIX and
+ * decompressed to its name without the suffix, or followed by .out if it
+ * doesn't have it.
+ *
+ * @param names Files to process.
+ * @param count Number of files.
+ * @param compress 1 to compress the files, 0 to decompress them.
+ * @param options Options to compress the files with.
+ * @param threads Number of threads to use.
+ * @return Number of files that failed, or a negative error code if the
+ *         batch couldn't run.
+ */
+int huffman_batch_run(char** names, int count, int compress, const huffman_options* options, int threads);
+
+#endif //HUFFMAN_BATCH_H
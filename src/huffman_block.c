@@ -0,0 +1,1576 @@
+/**
+ * Copyright (c) 2011-2014, Vasileios Daras. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+#include "huffman_block.h"
+#include "huffman_code.h"
+#include "rle.h"
+#include "bit_io.h"
+#include "crc32c.h"
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+static const unsigned char STREAM_MAGIC[4] = { 'H', 'U', 'F', 0x01 };
+
+/* Size of the run-length encoded byte count that starts the body of blocks with HUFFMAN_BLOCK_FLAG_RLE. */
+static const unsigned int RLE_SIZE_FIELD = 4;
+
+/* Blocks with HUFFMAN_BLOCK_FLAG_WIDE start with a symbol count and a symbol and code length per symbol. */
+static const unsigned int WIDE_COUNT_FIELD = 4;
+static const unsigned int WIDE_ENTRY_SIZE = 3;
+
+/* Fast coding counts FAST_SAMPLE_RUN bytes out of every FAST_SAMPLE_STRIDE of blocks of at least FAST_MIN_SIZE bytes. */
+static const unsigned int FAST_SAMPLE_RUN = 32;
+static const unsigned int FAST_SAMPLE_STRIDE = 256;
+static const unsigned int FAST_MIN_SIZE = 65536;
+/* Symbols a multi-symbol lookup has to decode on average, in 1/256ths, for blocks to be decoded with them. */
+static const unsigned int MULTI_MIN_SYMBOLS_PER_LOOKUP = 320;
+/* Fractional bits of the fixed point logarithms contexts are clustered with. */
+static const int LOG2_FRACTION_BITS = 16;
+
+static void write_u32(unsigned char* buffer, unsigned int value) {
+    buffer[0] = value & 0xFF;
+    buffer[1] = (value >> 8) & 0xFF;
+    buffer[2] = (value >> 16) & 0xFF;
+    buffer[3] = (value >> 24) & 0xFF;
+}
+
+static unsigned int read_u32(const unsigned char* buffer) {
+    return (unsigned int) buffer[0]
+         | ((unsigned int) buffer[1] << 8)
+         | ((unsigned int) buffer[2] << 16)
+         | ((unsigned int) buffer[3] << 24);
+}
+
+/*
+ * The last byte of the stream header is the number of times the stream's
+ * blocks are halved from HUFFMAN_BLOCK_SIZE, 0 for streams written before
+ * blocks could be smaller.
+ */
+void huffman_stream_header_write(unsigned char* buffer, unsigned int block_size) {
+    memcpy(buffer, STREAM_MAGIC, sizeof(STREAM_MAGIC));
+    buffer[4] = 0;
+    while((HUFFMAN_BLOCK_SIZE >> buffer[4]) > block_size && (HUFFMAN_BLOCK_SIZE >> buffer[4]) > HUFFMAN_MIN_BLOCK_SIZE) {
+        buffer[4]++;
+    }
+}
+
+int huffman_stream_header_check(const unsigned char* buffer) {
+    return memcmp(buffer, STREAM_MAGIC, sizeof(STREAM_MAGIC)) == 0
+        && buffer[4] < 32 && (HUFFMAN_BLOCK_SIZE >> buffer[4]) >= HUFFMAN_MIN_BLOCK_SIZE;
+}
+
+unsigned int huffman_stream_header_block_size(const unsigned char* buffer) {
+    return HUFFMAN_BLOCK_SIZE >> buffer[4];
+}
+
+void huffman_block_header_write(const huffman_block_header* header, unsigned char* buffer) {
+    buffer[0] = header->type;
+    buffer[1] = header->flags;
+    write_u32(buffer + 2, header->raw_size);
+    write_u32(buffer + 6, header->body_size);
+}
+
+int huffman_block_header_read(huffman_block_header* header, const unsigned char* buffer) {
+    header->type = buffer[0];
+    header->flags = buffer[1];
+    header->raw_size = read_u32(buffer + 2);
+    header->body_size = read_u32(buffer + 6);
+
+    unsigned int checksum_size = (header->flags & HUFFMAN_BLOCK_FLAG_CHECKSUM) ? HUFFMAN_BLOCK_CHECKSUM_SIZE : 0;
+    if(header->body_size < checksum_size) {
+        return HUFFMAN_ENCODING_ERROR;
+    }
+    unsigned int body_size = header->body_size - checksum_size;
+
+    switch(header->type) {
+        case HUFFMAN_BLOCK_END:
+            if((header->flags & ~HUFFMAN_BLOCK_FLAG_CHECKSUM) != 0 || header->raw_size != 0 || body_size != 0) {
+                return HUFFMAN_ENCODING_ERROR;
+            }
+            break;
+        case HUFFMAN_BLOCK_HUFFMAN:
+            if((header->flags & ~(HUFFMAN_BLOCK_FLAG_REPEAT_TABLE | HUFFMAN_BLOCK_FLAG_CONTEXT
+                                | HUFFMAN_BLOCK_FLAG_RLE | HUFFMAN_BLOCK_FLAG_WIDE | HUFFMAN_BLOCK_FLAG_CHECKSUM)) != 0
+            || ((header->flags & HUFFMAN_BLOCK_FLAG_REPEAT_TABLE) && (header->flags & HUFFMAN_BLOCK_FLAG_CONTEXT))
+            || ((header->flags & HUFFMAN_BLOCK_FLAG_WIDE)
+                && (header->flags & (HUFFMAN_BLOCK_FLAG_REPEAT_TABLE | HUFFMAN_BLOCK_FLAG_CONTEXT)))
+            || header->raw_size == 0 || header->raw_size > HUFFMAN_BLOCK_SIZE
+            || body_size > header->raw_size) {
+                return HUFFMAN_ENCODING_ERROR;
+            }
+            break;
+        case HUFFMAN_BLOCK_STORED:
+            if((header->flags & ~(HUFFMAN_BLOCK_FLAG_RLE | HUFFMAN_BLOCK_FLAG_CHECKSUM)) != 0
+            || header->raw_size == 0 || header->raw_size > HUFFMAN_BLOCK_SIZE
+            || body_size > header->raw_size) {
+                return HUFFMAN_ENCODING_ERROR;
+            }
+            break;
+        default:
+            return HUFFMAN_ENCODING_ERROR;
+    }
+
+    if((header->flags & HUFFMAN_BLOCK_FLAG_RLE) && body_size < RLE_SIZE_FIELD) {
+        return HUFFMAN_ENCODING_ERROR;
+    }
+
+    return HUFFMAN_SUCCESS;
+}
+
+static void count_frequencies(const unsigned char* bytes, unsigned int size, unsigned int frequencies[256]) {
+
+    for(int i = 0; i < 256; i++) {
+        frequencies[i] = 0;
+    }
+
+    for(unsigned int curr_byte = 0; curr_byte < size; curr_byte++) {
+
+        unsigned char byte = bytes[curr_byte];
+
+        frequencies[(unsigned int)byte]++;
+    }
+}
+
+/**
+ * Estimates byte frequencies from runs of bytes spread evenly over a block,
+ * scaled up to the block's size. Every byte gets a frequency of at least 1
+ * so that bytes missing from the sample still get a code.
+ */
+static void sample_frequencies(const unsigned char* bytes, unsigned int size, unsigned int frequencies[256]) {
+
+    unsigned int sampled[256] = { 0 };
+
+    for(unsigned int start = 0; start < size; start += FAST_SAMPLE_STRIDE) {
+        unsigned int end = size - start < FAST_SAMPLE_RUN ? size : start + FAST_SAMPLE_RUN;
+        for(unsigned int curr_byte = start; curr_byte < end; curr_byte++) {
+            sampled[bytes[curr_byte]]++;
+        }
+    }
+
+    for(int i = 0; i < 256; i++) {
+        frequencies[i] = sampled[i] * (FAST_SAMPLE_STRIDE / FAST_SAMPLE_RUN) + 1;
+    }
+}
+
+static void count_context_frequencies(const unsigned char* bytes, unsigned int size, unsigned int (*frequencies)[256]) {
+
+    memset(frequencies, 0, sizeof(unsigned int) * 256 * 256);
+
+    unsigned char prev = 0;
+    for(unsigned int curr_byte = 0; curr_byte < size; curr_byte++) {
+
+        unsigned char byte = bytes[curr_byte];
+
+        frequencies[prev][byte]++;
+        prev = byte;
+    }
+}
+
+/**
+ * Number of bits needed to code a block with the given code lengths, or
+ * ULLONG_MAX if a byte of the block has no code.
+ */
+static unsigned long long code_cost(unsigned int frequencies[256], unsigned int lengths[256]) {
+    unsigned long long bits = 0;
+
+    for(int i = 0; i < 256; i++) {
+        if(frequencies[i] != 0) {
+            if(lengths[i] == 0) {
+                return ULLONG_MAX;
+            }
+
+            bits += (unsigned long long) frequencies[i] * lengths[i];
+        }
+    }
+
+    return bits;
+}
+
+/**
+ * Number of bits needed to code a block with a table set, or ULLONG_MAX if
+ * the set can't code the block. context_frequencies is only needed for sets
+ * of more than one table.
+ */
+static unsigned long long table_set_cost(huffman_table_set* set, unsigned int frequencies[256], unsigned int (*context_frequencies)[256]) {
+
+    if(set->table_count == 1) {
+        return code_cost(frequencies, set->tables[0].lengths);
+    }
+
+    if(context_frequencies == NULL) {
+        return ULLONG_MAX;
+    }
+
+    unsigned long long bits = 0;
+    for(int context = 0; context < 256; context++) {
+        unsigned long long context_bits = code_cost(context_frequencies[context], set->tables[set->context_map[context]].lengths);
+        if(context_bits == ULLONG_MAX) {
+            return ULLONG_MAX;
+        }
+
+        bits += context_bits;
+    }
+
+    return bits;
+}
+
+/**
+ * Builds a table's tree and code lengths from byte frequencies, along with
+ * the tree's binary representation which is needed to know what storing
+ * the table costs.
+ */
+static int huffman_table_create(huffman_table* table, unsigned int frequencies[256]) {
+
+    memset(table, 0, sizeof(huffman_table));
+
+    int retval = huffman_tree_create(&table->tree, frequencies);
+    if(retval != HUFFMAN_SUCCESS) {
+        return retval;
+    }
+    huffman_tree_code_lengths(table->tree, table->lengths);
+
+    retval = huffman_tree_to_compact_bitset(table->tree, &table->tree_binary_rep);
+    if(retval != HUFFMAN_SUCCESS) {
+        huffman_tree_destroy(&table->tree);
+        return retval;
+    }
+
+    return HUFFMAN_SUCCESS;
+}
+
+static void huffman_table_destroy(huffman_table* table) {
+    if(table->tree != NULL) {
+        huffman_tree_destroy(&table->tree);
+    }
+    if(table->tree_binary_rep != NULL) {
+        bitset_destroy(&table->tree_binary_rep);
+    }
+}
+
+static void huffman_table_set_destroy(huffman_table_set* set) {
+    for(int i = 0; i < set->table_count; i++) {
+        huffman_table_destroy(&set->tables[i]);
+    }
+    set->table_count = 0;
+}
+
+/**
+ * Size of the tables of a set when stored in a block. Sets of more than
+ * one table also store their count and the table each context uses.
+ */
+static unsigned int table_set_size(huffman_table_set* set) {
+    unsigned int size = set->table_count > 1 ? 1 + 256 : 0;
+
+    for(int i = 0; i < set->table_count; i++) {
+        size += bitset_serialized_size(set->tables[i].tree_binary_rep);
+    }
+
+    return size;
+}
+
+static unsigned int table_set_serialize(huffman_table_set* set, unsigned char* buffer) {
+    unsigned int size = 0;
+
+    if(set->table_count > 1) {
+        buffer[0] = (unsigned char) set->table_count;
+        memcpy(buffer + 1, set->context_map, 256);
+        size = 1 + 256;
+    }
+
+    for(int i = 0; i < set->table_count; i++) {
+        size += bitset_serialize_buffer(set->tables[i].tree_binary_rep, buffer + size);
+    }
+
+    return size;
+}
+
+static int order0_table_set_create(huffman_table_set* set, unsigned int frequencies[256]) {
+    memset(set->context_map, 0, 256);
+    set->table_count = 0;
+
+    int retval = huffman_table_create(&set->tables[0], frequencies);
+    if(retval != HUFFMAN_SUCCESS) {
+        return retval;
+    }
+
+    set->table_count = 1;
+    return HUFFMAN_SUCCESS;
+}
+
+/**
+ * Computes log2(value) with LOG2_FRACTION_BITS fractional bits for a value
+ * of at least 1. The mantissa is squared once per fractional bit, each
+ * square of at least 2 giving a 1 bit, so only integers are involved and
+ * every host rounds alike.
+ */
+static unsigned long long fixed_log2(unsigned int value) {
+    int exponent = 0;
+    while((value >> exponent) > 1) {
+        exponent++;
+    }
+
+    /* The mantissa in [1, 2) with 31 fractional bits. */
+    unsigned long long mantissa = ((unsigned long long) value << 31) >> exponent;
+    unsigned long long result = (unsigned long long) exponent << LOG2_FRACTION_BITS;
+    for(int bit = LOG2_FRACTION_BITS - 1; bit >= 0; bit--) {
+        mantissa = (mantissa * mantissa) >> 31;
+        if(mantissa >= (1ULL << 32)) {
+            mantissa >>= 1;
+            result |= 1ULL << bit;
+        }
+    }
+
+    return result;
+}
+
+/**
+ * Groups the previous byte contexts of a block into at most HUFFMAN_MAX_TABLES
+ * clusters of contexts with similar byte distributions. The most frequent
+ * contexts seed the clusters, then each context is repeatedly moved to the
+ * cluster whose distribution codes it in the fewest bits, estimated from the
+ * cluster's byte probabilities, until no context moves.
+ */
+static int cluster_contexts(unsigned int (*context_frequencies)[256], unsigned char context_map[256]) {
+
+    unsigned int totals[256];
+    int contexts[256];
+    int context_count = 0;
+
+    for(int context = 0; context < 256; context++) {
+        totals[context] = 0;
+        for(int byte = 0; byte < 256; byte++) {
+            totals[context] += context_frequencies[context][byte];
+        }
+
+        if(totals[context] != 0) {
+            contexts[context_count] = context;
+            context_count++;
+        }
+
+        context_map[context] = 0;
+    }
+
+    if(context_count < 2) {
+        return 1;
+    }
+
+    /* Sorts active contexts by descending frequency, ties by context. */
+    for(int i = 1; i < context_count; i++) {
+        int context = contexts[i];
+        int j = i - 1;
+        while(j >= 0 && totals[contexts[j]] < totals[context]) {
+            contexts[j + 1] = contexts[j];
+            j--;
+        }
+        contexts[j + 1] = context;
+    }
+
+    int cluster_count = context_count < HUFFMAN_MAX_TABLES ? context_count : HUFFMAN_MAX_TABLES;
+    int assignment[256];
+    for(int i = 0; i < context_count; i++) {
+        assignment[contexts[i]] = i < cluster_count ? i : -1;
+    }
+
+    static const int MAX_ROUNDS = 8;
+    unsigned long long costs[HUFFMAN_MAX_TABLES][256];
+
+    for(int round = 0; round < MAX_ROUNDS; round++) {
+
+        for(int cluster = 0; cluster < cluster_count; cluster++) {
+            unsigned int counts[256] = { 0 };
+            unsigned int total = 0;
+
+            for(int i = 0; i < context_count; i++) {
+                int context = contexts[i];
+                if(assignment[context] == cluster) {
+                    for(int byte = 0; byte < 256; byte++) {
+                        counts[byte] += context_frequencies[context][byte];
+                    }
+                    total += totals[context];
+                }
+            }
+
+            /* -log2((count + 1/2) / (total + 128)), in fixed point and doubled to stay in integers. */
+            unsigned long long total_log = fixed_log2(2 * total + 256);
+            for(int byte = 0; byte < 256; byte++) {
+                costs[cluster][byte] = total_log - fixed_log2(2 * counts[byte] + 1);
+            }
+        }
+
+        int moved = 0;
+        for(int i = 0; i < context_count; i++) {
+            int context = contexts[i];
+            int best_cluster = 0;
+            unsigned long long best_cost = 0;
+
+            for(int cluster = 0; cluster < cluster_count; cluster++) {
+                unsigned long long cost = 0;
+                for(int byte = 0; byte < 256; byte++) {
+                    if(context_frequencies[context][byte] != 0) {
+                        cost += context_frequencies[context][byte] * costs[cluster][byte];
+                    }
+                }
+
+                if(cluster == 0 || cost < best_cost) {
+                    best_cost = cost;
+                    best_cluster = cluster;
+                }
+            }
+
+            if(best_cluster != assignment[context]) {
+                assignment[context] = best_cluster;
+                moved = 1;
+            }
+        }
+
+        if(!moved) {
+            break;
+        }
+    }
+
+    /* Renumbers the clusters that kept at least one context. */
+    int renumbered[HUFFMAN_MAX_TABLES];
+    for(int cluster = 0; cluster < HUFFMAN_MAX_TABLES; cluster++) {
+        renumbered[cluster] = -1;
+    }
+
+    int table_count = 0;
+    for(int i = 0; i < context_count; i++) {
+        int cluster = assignment[contexts[i]];
+        if(renumbered[cluster] == -1) {
+            renumbered[cluster] = table_count;
+            table_count++;
+        }
+        context_map[contexts[i]] = renumbered[cluster];
+    }
+
+    return table_count;
+}
+
+static int order1_table_set_create(huffman_table_set* set, unsigned int (*context_frequencies)[256]) {
+
+    set->table_count = 0;
+    int table_count = cluster_contexts(context_frequencies, set->context_map);
+
+    for(int table = 0; table < table_count; table++) {
+        unsigned int frequencies[256] = { 0 };
+
+        for(int context = 0; context < 256; context++) {
+            if(set->context_map[context] == table) {
+                for(int byte = 0; byte < 256; byte++) {
+                    frequencies[byte] += context_frequencies[context][byte];
+                }
+            }
+        }
+
+        int retval = huffman_table_create(&set->tables[table], frequencies);
+        if(retval != HUFFMAN_SUCCESS) {
+            huffman_table_set_destroy(set);
+            return retval;
+        }
+
+        set->table_count++;
+    }
+
+    return HUFFMAN_SUCCESS;
+}
+
+/**
+ * Packs the code of every leaf of a table's tree with its length, walking
+ * the tree with a stack of the nodes still to visit instead of recursing.
+ * Codes longer than BIT_IO_MAX_CODE_LENGTH bits are left out.
+ */
+static void create_codes(huffman_table* table) {
+    huffman_node* nodes[HUFFMAN_TREE_MAX_DEPTH + 2];
+    unsigned int codes[HUFFMAN_TREE_MAX_DEPTH + 2];
+    unsigned char depths[HUFFMAN_TREE_MAX_DEPTH + 2];
+    int top = 0;
+
+    memset(table->codes, 0, sizeof(table->codes));
+
+    nodes[0] = table->tree;
+    codes[0] = 0;
+    depths[0] = 0;
+    top = 1;
+
+    while(top > 0) {
+        top--;
+        huffman_node* node = nodes[top];
+        unsigned int code = codes[top];
+        int depth = depths[top];
+
+        if(node->is_leaf) {
+            table->codes[node->which_char] = BIT_IO_CODE(code, depth);
+        } else if(depth < BIT_IO_MAX_CODE_LENGTH) {
+            nodes[top] = node->right;
+            codes[top] = (code << 1) | 1;
+            depths[top] = depth + 1;
+            nodes[top + 1] = node->left;
+            codes[top + 1] = code << 1;
+            depths[top + 1] = depth + 1;
+            top += 2;
+        }
+    }
+}
+
+static void table_set_create_codes(huffman_table_set* set) {
+    for(int i = 0; i < set->table_count; i++) {
+        create_codes(&set->tables[i]);
+    }
+}
+
+static unsigned int table_set_max_length(huffman_table_set* set) {
+    unsigned int max_length = 0;
+    for(int i = 0; i < set->table_count; i++) {
+        for(int j = 0; j < 256; j++) {
+            if(set->tables[i].lengths[j] > max_length) {
+                max_length = set->tables[i].lengths[j];
+            }
+        }
+    }
+
+    return max_length;
+}
+
+/**
+ * Codes a block with the bit I/O kernels, which needs every code of the set
+ * to be at most BIT_IO_MAX_CODE_LENGTH bits long. Fails if the coded block
+ * doesn't fit in out_cap bytes.
+ */
+static int table_set_encode(huffman_table_set* set, const unsigned char* bytes, unsigned int size,
+                            unsigned char* bytes_out, unsigned int out_cap, unsigned int* produced) {
+
+    const unsigned int* context_codes[256];
+    for(int context = 0; context < 256; context++) {
+        context_codes[context] = set->tables[set->context_map[context]].codes;
+    }
+
+    return bit_io_encode(bytes, size, context_codes, bytes_out, out_cap, produced);
+}
+
+typedef struct {
+    unsigned char* bytes_out;
+    unsigned int bytes_produced;
+    unsigned long long buffer;
+    int bits;
+} bit_writer;
+
+static void bit_writer_put(bit_writer* writer, unsigned int code, int length) {
+    writer->buffer = (writer->buffer << length) | code;
+    writer->bits += length;
+
+    while(writer->bits >= 8) {
+        writer->bits -= 8;
+        writer->bytes_out[writer->bytes_produced] = (unsigned char) (writer->buffer >> writer->bits);
+        writer->bytes_produced++;
+    }
+}
+
+static void bit_writer_flush(bit_writer* writer) {
+    if(writer->bits != 0) {
+        writer->bytes_out[writer->bytes_produced] = (unsigned char) (writer->buffer << (8 - writer->bits));
+        writer->bytes_produced++;
+        writer->bits = 0;
+    }
+}
+
+/**
+ * Codes a block whose coded size is known to be out_size bytes.
+ */
+static void huffman_compress_block(const unsigned char* bytes, unsigned int size, huffman_table_set* set,
+                                   unsigned char* bytes_out, unsigned int out_size) {
+
+    if(table_set_max_length(set) <= BIT_IO_MAX_CODE_LENGTH) {
+        unsigned int produced;
+        table_set_encode(set, bytes, size, bytes_out, out_size, &produced);
+        return;
+    }
+
+    /*
+     * Codes too long for the bit I/O kernels are written one at a time.
+     * Blocks of up to HUFFMAN_BLOCK_SIZE bytes have codes of at most 28 bits.
+     */
+    unsigned int codes[HUFFMAN_MAX_TABLES][256];
+    unsigned char lengths[HUFFMAN_MAX_TABLES][256];
+    for(int i = 0; i < set->table_count; i++) {
+        unsigned int symbols[256];
+        unsigned int tree_codes[256];
+        unsigned char tree_lengths[256];
+        int count;
+        huffman_tree_codes(set->tables[i].tree, 31, symbols, tree_codes, tree_lengths, &count);
+
+        for(int j = 0; j < count; j++) {
+            codes[i][symbols[j]] = tree_codes[j];
+            lengths[i][symbols[j]] = tree_lengths[j];
+        }
+    }
+
+    bit_writer writer = { bytes_out, 0, 0, 0 };
+    unsigned char prev = 0;
+
+    for(unsigned int i = 0; i < size; i++) {
+        int table = set->context_map[prev];
+        bit_writer_put(&writer, codes[table][bytes[i]], lengths[table][bytes[i]]);
+        prev = bytes[i];
+    }
+
+    bit_writer_flush(&writer);
+}
+
+static void wide_state_destroy(huffman_wide_state** wide) {
+    free((*wide)->frequencies);
+    free((*wide)->codes);
+    free((*wide)->symbols);
+    free((*wide)->symbol_frequencies);
+    free((*wide)->lengths);
+    free((*wide));
+    (*wide) = NULL;
+}
+
+static int wide_state_create(huffman_wide_state** wide) {
+    huffman_wide_state* retval = malloc(sizeof(huffman_wide_state));
+    if(retval == NULL) {
+        return HUFFMAN_ALLOC_ERROR;
+    }
+
+    retval->frequencies = calloc(HUFFMAN_WIDE_SYMBOLS, sizeof(unsigned int));
+    retval->codes = malloc(sizeof(unsigned int) * HUFFMAN_WIDE_SYMBOLS);
+    retval->symbols = malloc(sizeof(unsigned int) * HUFFMAN_WIDE_SYMBOLS);
+    retval->symbol_frequencies = malloc(sizeof(unsigned int) * HUFFMAN_WIDE_SYMBOLS);
+    retval->lengths = malloc(HUFFMAN_WIDE_SYMBOLS);
+    retval->symbol_count = 0;
+
+    if(retval->frequencies == NULL || retval->codes == NULL || retval->symbols == NULL
+    || retval->symbol_frequencies == NULL || retval->lengths == NULL) {
+        wide_state_destroy(&retval);
+        return HUFFMAN_ALLOC_ERROR;
+    }
+
+    (*wide) = retval;
+    return HUFFMAN_SUCCESS;
+}
+
+/**
+ * Computes the code of a block read as 16 bit little endian symbols, and
+ * the size of the block's body when coded with it. Only the symbols that
+ * occur in the block are kept, in increasing order, and the table stored
+ * in the block lists each one with its code length.
+ */
+static int wide_code_create(huffman_wide_state* wide, const unsigned char* data, unsigned int size, unsigned long long* body_size) {
+
+    unsigned int symbol_count = size / 2;
+    for(unsigned int i = 0; i < symbol_count; i++) {
+        wide->frequencies[data[2 * i] | (data[2 * i + 1] << 8)]++;
+    }
+
+    wide->symbol_count = 0;
+    for(unsigned int symbol = 0; symbol < HUFFMAN_WIDE_SYMBOLS; symbol++) {
+        if(wide->frequencies[symbol] != 0) {
+            wide->symbols[wide->symbol_count] = symbol;
+            wide->symbol_frequencies[wide->symbol_count] = wide->frequencies[symbol];
+            wide->symbol_count++;
+
+            wide->frequencies[symbol] = 0;
+        }
+    }
+
+    int retval = huffman_code_lengths(wide->symbol_frequencies, wide->symbol_count, wide->lengths, HUFFMAN_CODE_MAX_LENGTH);
+    if(retval != HUFFMAN_SUCCESS) {
+        return retval;
+    }
+
+    unsigned long long bits = 0;
+    for(int i = 0; i < wide->symbol_count; i++) {
+        bits += (unsigned long long) wide->symbol_frequencies[i] * wide->lengths[i];
+    }
+
+    (*body_size) = WIDE_COUNT_FIELD + WIDE_ENTRY_SIZE * wide->symbol_count + (size % 2) + (bits + 7) / 8;
+    return HUFFMAN_SUCCESS;
+}
+
+static int huffman_compress_wide(huffman_wide_state* wide, const unsigned char* data, unsigned int size, unsigned char* body) {
+
+    unsigned int* codes = wide->symbol_frequencies;
+    int retval = huffman_canonical_codes(wide->lengths, wide->symbol_count, codes);
+    if(retval != HUFFMAN_SUCCESS) {
+        return retval;
+    }
+
+    write_u32(body, wide->symbol_count);
+    unsigned int table_size = WIDE_COUNT_FIELD;
+
+    for(int i = 0; i < wide->symbol_count; i++) {
+        body[table_size] = wide->symbols[i] & 0xFF;
+        body[table_size + 1] = wide->symbols[i] >> 8;
+        body[table_size + 2] = wide->lengths[i];
+        table_size += WIDE_ENTRY_SIZE;
+
+        wide->codes[wide->symbols[i]] = BIT_IO_CODE(codes[i], wide->lengths[i]);
+    }
+
+    if(size % 2 != 0) {
+        body[table_size] = data[size - 1];
+        table_size++;
+    }
+
+    bit_writer writer = { body + table_size, 0, 0, 0 };
+
+    unsigned int symbol_count = size / 2;
+    for(unsigned int i = 0; i < symbol_count; i++) {
+        unsigned int code = wide->codes[data[2 * i] | (data[2 * i + 1] << 8)];
+        bit_writer_put(&writer, BIT_IO_CODE_BITS(code), BIT_IO_CODE_LENGTH(code));
+    }
+
+    bit_writer_flush(&writer);
+    return HUFFMAN_SUCCESS;
+}
+
+int huffman_block_encoder_create(huffman_block_encoder** encoder, const huffman_options* options, unsigned int block_size) {
+    huffman_block_encoder* retval = malloc(sizeof(huffman_block_encoder));
+    if(retval == NULL) {
+        (*encoder) = NULL;
+        return HUFFMAN_ALLOC_ERROR;
+    }
+
+    retval->options = (*options);
+    retval->block_size = block_size;
+    memset(&retval->previous, 0, sizeof(huffman_table_set));
+    retval->context_frequencies = NULL;
+    retval->rle_buffer = NULL;
+    retval->wide = NULL;
+    memset(&retval->stats, 0, sizeof(huffman_stats));
+    retval->stream_checksum = 0;
+
+    retval->record = malloc(HUFFMAN_RECORD_SIZE(block_size));
+    if(retval->record == NULL) {
+        huffman_block_encoder_destroy(&retval);
+        (*encoder) = NULL;
+        return HUFFMAN_ALLOC_ERROR;
+    }
+
+    if(options->order1) {
+        retval->context_frequencies = malloc(sizeof(unsigned int) * 256 * 256);
+        if(retval->context_frequencies == NULL) {
+            huffman_block_encoder_destroy(&retval);
+            (*encoder) = NULL;
+            return HUFFMAN_ALLOC_ERROR;
+        }
+    }
+
+    if(options->wide) {
+        if(wide_state_create(&retval->wide) != HUFFMAN_SUCCESS) {
+            huffman_block_encoder_destroy(&retval);
+            (*encoder) = NULL;
+            return HUFFMAN_ALLOC_ERROR;
+        }
+    }
+
+    if(options->rle) {
+        retval->rle_buffer = malloc(block_size);
+        if(retval->rle_buffer == NULL) {
+            huffman_block_encoder_destroy(&retval);
+            (*encoder) = NULL;
+            return HUFFMAN_ALLOC_ERROR;
+        }
+    }
+
+    (*encoder) = retval;
+    return HUFFMAN_SUCCESS;
+}
+
+unsigned long long huffman_block_encoder_memory(const huffman_options* options, unsigned int block_size) {
+    unsigned long long memory = sizeof(huffman_block_encoder) + HUFFMAN_RECORD_SIZE(block_size);
+    if(options->order1) {
+        memory += sizeof(unsigned int) * 256 * 256;
+    }
+    if(options->wide) {
+        memory += sizeof(huffman_wide_state) + (4 * sizeof(unsigned int) + 1) * HUFFMAN_WIDE_SYMBOLS;
+    }
+    if(options->rle) {
+        memory += block_size;
+    }
+    return memory;
+}
+
+void huffman_block_encoder_reset(huffman_block_encoder* encoder) {
+    huffman_table_set_destroy(&encoder->previous);
+    memset(&encoder->stats, 0, sizeof(huffman_stats));
+    encoder->stream_checksum = 0;
+}
+
+void huffman_block_encoder_destroy(huffman_block_encoder** encoder) {
+    huffman_table_set_destroy(&(*encoder)->previous);
+    free((*encoder)->context_frequencies);
+    free((*encoder)->rle_buffer);
+    if((*encoder)->wide != NULL) {
+        wide_state_destroy(&(*encoder)->wide);
+    }
+    free((*encoder)->record);
+    free((*encoder));
+    (*encoder) = NULL;
+}
+
+unsigned char* huffman_block_encoder_swap_record(huffman_block_encoder* encoder, unsigned char* record) {
+    unsigned char* previous = encoder->record;
+    encoder->record = record;
+    return previous;
+}
+
+/**
+ * Codes a block with a code built from a sample of its bytes, so the block
+ * is read once instead of being counted first. As the coded size isn't
+ * known in advance, coding stops once it reaches the block's size and the
+ * block is stored instead. Blocks whose sampled code has codes too long
+ * for the bit I/O kernels are left to be coded from exact counts.
+ */
+static int huffman_encode_sampled(huffman_block_encoder* encoder, const unsigned char* data, unsigned int size,
+                                  huffman_block_header* header, unsigned char* body, unsigned int* body_size, int* sampled) {
+
+    (*sampled) = 0;
+
+    unsigned int frequencies[256];
+    sample_frequencies(data, size, frequencies);
+
+    huffman_table_set set;
+    int retval = order0_table_set_create(&set, frequencies);
+    if(retval != HUFFMAN_SUCCESS) {
+        return retval;
+    }
+
+    if(table_set_max_length(&set) > BIT_IO_MAX_CODE_LENGTH) {
+        huffman_table_set_destroy(&set);
+        return HUFFMAN_SUCCESS;
+    }
+
+    table_set_create_codes(&set);
+
+    unsigned int table_size = table_set_size(&set);
+    unsigned int coded_size;
+
+    if(table_size < size
+    && table_set_encode(&set, data, size, body + table_size, size - table_size - 1, &coded_size) == HUFFMAN_SUCCESS) {
+
+        header->type = HUFFMAN_BLOCK_HUFFMAN;
+        (*body_size) = table_size + coded_size;
+        table_set_serialize(&set, body);
+
+        huffman_table_set_destroy(&encoder->previous);
+        encoder->previous = set;
+        set.table_count = 0;
+
+    } else {
+
+        header->type = HUFFMAN_BLOCK_STORED;
+        (*body_size) = size;
+        memcpy(body, data, size);
+    }
+
+    huffman_table_set_destroy(&set);
+
+    encoder->stats.sampled_blocks++;
+    encoder->stats.sampled_size += (*body_size);
+
+    if(encoder->options.stats) {
+        count_frequencies(data, size, frequencies);
+
+        retval = order0_table_set_create(&set, frequencies);
+        if(retval != HUFFMAN_SUCCESS) {
+            return retval;
+        }
+
+        unsigned long long exact_size = table_set_size(&set) + (table_set_cost(&set, frequencies, NULL) + 7) / 8;
+        encoder->stats.exact_size += exact_size < size ? exact_size : size;
+        huffman_table_set_destroy(&set);
+    }
+
+    (*sampled) = 1;
+    return HUFFMAN_SUCCESS;
+}
+
+/**
+ * Each block is coded in the cheapest of these ways: with a code built for
+ * the block, whose tree has to be stored in the block, with codes built for
+ * clusters of previous byte contexts or for 16 bit symbols when enabled,
+ * with the code of the previous block, which costs nothing to store but may
+ * be longer, or stored uncompressed when no code saves space.
+ */
+static int huffman_encode_symbols(huffman_block_encoder* encoder, const unsigned char* data, unsigned int size,
+                                  huffman_block_header* header, unsigned char* body, unsigned int* body_size) {
+
+    int retval;
+
+    if(encoder->options.fast && size >= FAST_MIN_SIZE) {
+        int sampled;
+        retval = huffman_encode_sampled(encoder, data, size, header, body, body_size, &sampled);
+        if(retval != HUFFMAN_SUCCESS || sampled) {
+            return retval;
+        }
+    }
+
+    unsigned int frequencies[256];
+    count_frequencies(data, size, frequencies);
+
+    huffman_table_set order0;
+    retval = order0_table_set_create(&order0, frequencies);
+    if(retval != HUFFMAN_SUCCESS) {
+        return retval;
+    }
+
+    huffman_table_set* fresh = &order0;
+    unsigned long long fresh_size = table_set_size(&order0) + (table_set_cost(&order0, frequencies, NULL) + 7) / 8;
+
+    huffman_table_set order1;
+    order1.table_count = 0;
+
+    if(encoder->context_frequencies != NULL) {
+        count_context_frequencies(data, size, encoder->context_frequencies);
+
+        retval = order1_table_set_create(&order1, encoder->context_frequencies);
+        if(retval != HUFFMAN_SUCCESS) {
+            huffman_table_set_destroy(&order0);
+            return retval;
+        }
+
+        if(order1.table_count > 1) {
+            unsigned long long order1_size = table_set_size(&order1)
+                                           + (table_set_cost(&order1, frequencies, encoder->context_frequencies) + 7) / 8;
+            if(order1_size < fresh_size) {
+                fresh = &order1;
+                fresh_size = order1_size;
+            }
+        }
+    }
+
+    unsigned long long reuse_size = ULLONG_MAX;
+    if(encoder->previous.table_count != 0) {
+        unsigned long long reuse_bits = table_set_cost(&encoder->previous, frequencies, encoder->context_frequencies);
+        if(reuse_bits != ULLONG_MAX) {
+            reuse_size = (reuse_bits + 7) / 8;
+        }
+    }
+
+    unsigned long long wide_size = ULLONG_MAX;
+    if(encoder->wide != NULL && size >= 2) {
+        retval = wide_code_create(encoder->wide, data, size, &wide_size);
+        if(retval != HUFFMAN_SUCCESS) {
+            huffman_table_set_destroy(&order0);
+            huffman_table_set_destroy(&order1);
+            return retval;
+        }
+    }
+
+    if(wide_size < size && wide_size < fresh_size && wide_size < reuse_size) {
+
+        header->type = HUFFMAN_BLOCK_HUFFMAN;
+        header->flags |= HUFFMAN_BLOCK_FLAG_WIDE;
+        (*body_size) = (unsigned int) wide_size;
+
+        retval = huffman_compress_wide(encoder->wide, data, size, body);
+        if(retval != HUFFMAN_SUCCESS) {
+            huffman_table_set_destroy(&order0);
+            huffman_table_set_destroy(&order1);
+            return retval;
+        }
+
+    } else if(reuse_size <= fresh_size && reuse_size < size) {
+
+        header->type = HUFFMAN_BLOCK_HUFFMAN;
+        header->flags |= HUFFMAN_BLOCK_FLAG_REPEAT_TABLE;
+        (*body_size) = (unsigned int) reuse_size;
+
+        memset(body, 0, (*body_size));
+        huffman_compress_block(data, size, &encoder->previous, body, (*body_size));
+
+    } else if(fresh_size < size) {
+
+        table_set_create_codes(fresh);
+
+        header->type = HUFFMAN_BLOCK_HUFFMAN;
+        header->flags |= fresh->table_count > 1 ? HUFFMAN_BLOCK_FLAG_CONTEXT : 0;
+        (*body_size) = (unsigned int) fresh_size;
+
+        unsigned int table_size = table_set_serialize(fresh, body);
+        memset(body + table_size, 0, (*body_size) - table_size);
+        huffman_compress_block(data, size, fresh, body + table_size, (*body_size) - table_size);
+
+        huffman_table_set_destroy(&encoder->previous);
+        encoder->previous = (*fresh);
+        fresh->table_count = 0;
+
+    } else {
+
+        header->type = HUFFMAN_BLOCK_STORED;
+        (*body_size) = size;
+
+        memcpy(body, data, size);
+    }
+
+    huffman_table_set_destroy(&order0);
+    huffman_table_set_destroy(&order1);
+
+    return HUFFMAN_SUCCESS;
+}
+
+/**
+ * When run-length encoding is enabled and shrinks the block by at least a
+ * 32nd, the run-length encoded bytes are coded instead of the block's bytes
+ * and their count is stored at the start of the block's body. Smaller gains
+ * are usually lost to the run lengths coding worse than the bytes did.
+ */
+int huffman_block_encode(huffman_block_encoder* encoder, const unsigned char* data, unsigned int size,
+                         unsigned char** record, unsigned int* record_size) {
+
+    if(size == 0 || size > encoder->block_size) {
+        return HUFFMAN_ENCODING_ERROR;
+    }
+
+    huffman_block_header header;
+    header.raw_size = size;
+    header.flags = 0;
+
+    /* Taken while the bytes are in cache from being counted for the code. */
+    unsigned int checksum = 0;
+    if(encoder->options.checksum) {
+        checksum = crc32c_update(0, data, size);
+    }
+
+    unsigned char* body = encoder->record + HUFFMAN_BLOCK_HEADER_SIZE;
+    unsigned int prefix_size = 0;
+
+    if(encoder->rle_buffer != NULL && size > RLE_SIZE_FIELD) {
+        unsigned int rle_size;
+        if(rle_encode(data, size, encoder->rle_buffer, size - RLE_SIZE_FIELD - size / 32 - 1, &rle_size) == RLE_SUCCESS) {
+            header.flags |= HUFFMAN_BLOCK_FLAG_RLE;
+            write_u32(body, rle_size);
+            prefix_size = RLE_SIZE_FIELD;
+
+            data = encoder->rle_buffer;
+            size = rle_size;
+        }
+    }
+
+    unsigned int body_size;
+    int retval = huffman_encode_symbols(encoder, data, size, &header, body + prefix_size, &body_size);
+    if(retval != HUFFMAN_SUCCESS) {
+        return retval;
+    }
+
+    header.body_size = prefix_size + body_size;
+    if(encoder->options.checksum) {
+        header.flags |= HUFFMAN_BLOCK_FLAG_CHECKSUM;
+        write_u32(body + header.body_size, checksum);
+        header.body_size += HUFFMAN_BLOCK_CHECKSUM_SIZE;
+
+        unsigned char checksum_bytes[HUFFMAN_BLOCK_CHECKSUM_SIZE];
+        write_u32(checksum_bytes, checksum);
+        encoder->stream_checksum = crc32c_update(encoder->stream_checksum, checksum_bytes, HUFFMAN_BLOCK_CHECKSUM_SIZE);
+    }
+    huffman_block_header_write(&header, encoder->record);
+
+    (*record) = encoder->record;
+    (*record_size) = HUFFMAN_BLOCK_HEADER_SIZE + header.body_size;
+
+    encoder->stats.blocks++;
+    encoder->stats.input_size += header.raw_size;
+    encoder->stats.output_size += (*record_size);
+    if(header.type == HUFFMAN_BLOCK_STORED) {
+        encoder->stats.stored_blocks++;
+    } else if(header.flags & HUFFMAN_BLOCK_FLAG_REPEAT_TABLE) {
+        encoder->stats.repeated_blocks++;
+    }
+    return HUFFMAN_SUCCESS;
+}
+
+int huffman_block_estimate(const huffman_options* options, const unsigned char* data, unsigned int size,
+                           unsigned int (*context_frequencies)[256], huffman_stats* stats) {
+
+    if(size == 0 || size > HUFFMAN_BLOCK_SIZE) {
+        return HUFFMAN_ENCODING_ERROR;
+    }
+
+    int sampled = options->fast && size >= FAST_MIN_SIZE;
+
+    unsigned int frequencies[256];
+    if(sampled) {
+        sample_frequencies(data, size, frequencies);
+    } else {
+        count_frequencies(data, size, frequencies);
+    }
+
+    huffman_table_set set;
+    int retval = order0_table_set_create(&set, frequencies);
+    if(retval != HUFFMAN_SUCCESS) {
+        return retval;
+    }
+
+    unsigned long long bits = table_set_cost(&set, frequencies, NULL);
+    if(sampled) {
+        /* Sampled counts are scaled up and padded, so they only add up to about the block's size. */
+        unsigned long long total = 0;
+        for(int i = 0; i < 256; i++) {
+            total += frequencies[i];
+        }
+        bits = bits * size / total;
+        stats->sampled_blocks++;
+    }
+    unsigned long long body_size = table_set_size(&set) + (bits + 7) / 8;
+    huffman_table_set_destroy(&set);
+
+    if(options->order1 && !sampled) {
+        count_context_frequencies(data, size, context_frequencies);
+
+        retval = order1_table_set_create(&set, context_frequencies);
+        if(retval != HUFFMAN_SUCCESS) {
+            return retval;
+        }
+
+        if(set.table_count > 1) {
+            unsigned long long order1_size = table_set_size(&set) + (table_set_cost(&set, frequencies, context_frequencies) + 7) / 8;
+            if(order1_size < body_size) {
+                body_size = order1_size;
+            }
+        }
+        huffman_table_set_destroy(&set);
+    }
+
+    if(body_size >= size) {
+        body_size = size;
+        stats->stored_blocks++;
+    }
+
+    stats->input_size += size;
+    stats->output_size += HUFFMAN_BLOCK_HEADER_SIZE + body_size + (options->checksum ? HUFFMAN_BLOCK_CHECKSUM_SIZE : 0);
+    stats->blocks++;
+    return HUFFMAN_SUCCESS;
+}
+
+unsigned int huffman_block_encoder_end(huffman_block_encoder* encoder, unsigned char* record) {
+    huffman_block_header end = { HUFFMAN_BLOCK_END, 0, 0, 0 };
+    if(encoder->options.checksum) {
+        end.flags = HUFFMAN_BLOCK_FLAG_CHECKSUM;
+        end.body_size = HUFFMAN_BLOCK_CHECKSUM_SIZE;
+        write_u32(record + HUFFMAN_BLOCK_HEADER_SIZE, encoder->stream_checksum);
+    }
+    huffman_block_header_write(&end, record);
+
+    encoder->stats.output_size += HUFFMAN_BLOCK_HEADER_SIZE + end.body_size;
+    return HUFFMAN_BLOCK_HEADER_SIZE + end.body_size;
+}
+
+/**
+ * Decodes a block by walking the trees bit by bit, for trees with codes
+ * too long for decode tables.
+ */
+static int huffman_decompress_block_tree(huffman_block_decoder* decoder, const unsigned char* bytes, unsigned int size,
+                                         unsigned char* bytes_out, unsigned int symbols) {
+
+    unsigned int total_bits = size * 8;
+    unsigned int bits_read = 0;
+    unsigned char prev = 0;
+
+    for(unsigned int bytes_produced = 0; bytes_produced < symbols; bytes_produced++) {
+
+        huffman_node* curr = decoder->trees[decoder->context_map[prev]];
+        while(!curr->is_leaf) {
+            if(bits_read >= total_bits) {
+                return HUFFMAN_ENCODING_ERROR;
+            }
+
+            int bit = (bytes[bits_read / 8] >> (8 - (bits_read % 8) - 1)) & 1;
+            if(bit == 0) {
+                curr = curr->left;
+            } else {
+                curr = curr->right;
+            }
+            bits_read++;
+        }
+
+        bytes_out[bytes_produced] = curr->which_char;
+        prev = curr->which_char;
+    }
+
+    return HUFFMAN_SUCCESS;
+}
+
+static int huffman_decompress_block(huffman_block_decoder* decoder, const unsigned char* bytes, unsigned int size,
+                                    unsigned char* bytes_out, unsigned int symbols) {
+
+    if(decoder->table_bits == 0) {
+        return huffman_decompress_block_tree(decoder, bytes, size, bytes_out, symbols);
+    }
+
+    const unsigned int* context_entries[256];
+    for(int context = 0; context < 256; context++) {
+        context_entries[context] = decoder->decode_tables[decoder->context_map[context]]->entries;
+    }
+
+    return bit_io_decode(decoder->table_bits, context_entries, decoder->multi_entries, bytes, size, bytes_out, symbols);
+}
+
+/**
+ * Builds decode tables for the decoder's trees, all with the same primary
+ * width chosen from the longest code, or none when a code is too long or a
+ * tree has a single leaf, which codes symbols in no bits.
+ */
+static int huffman_block_decoder_build_tables(huffman_block_decoder* decoder) {
+
+    unsigned int symbols[256];
+    unsigned int codes[256];
+    unsigned char lengths[256];
+    int max_length = 0;
+
+    decoder->table_bits = 0;
+    decoder->multi_entries = NULL;
+
+    for(int i = 0; i < decoder->table_count; i++) {
+        if(decoder->trees[i]->is_leaf) {
+            return HUFFMAN_SUCCESS;
+        }
+
+        int count = 0;
+        int length = huffman_tree_codes(decoder->trees[i], HUFFMAN_CODE_MAX_LENGTH, symbols, codes, lengths, &count);
+        if(length > HUFFMAN_CODE_MAX_LENGTH) {
+            return HUFFMAN_SUCCESS;
+        }
+        if(length > max_length) {
+            max_length = length;
+        }
+    }
+
+    int table_bits = max_length < BIT_IO_MIN_TABLE_BITS ? BIT_IO_MIN_TABLE_BITS :
+                     max_length > BIT_IO_MAX_TABLE_BITS ? BIT_IO_MAX_TABLE_BITS : max_length;
+
+    for(int i = 0; i < decoder->table_count; i++) {
+        int count = 0;
+        huffman_tree_codes(decoder->trees[i], HUFFMAN_CODE_MAX_LENGTH, symbols, codes, lengths, &count);
+
+        int retval = huffman_decode_table_create_codes(&decoder->decode_tables[i], symbols, codes, lengths, count, table_bits);
+        if(retval != HUFFMAN_SUCCESS) {
+            for(int j = 0; j < i; j++) {
+                huffman_decode_table_destroy(&decoder->decode_tables[j]);
+            }
+            return retval;
+        }
+    }
+
+    decoder->table_bits = table_bits;
+
+    /* Multi-symbol lookups only pay for their extra checks when they mostly find more than one code. */
+    if(decoder->table_count == 1) {
+        unsigned int symbols_per_lookup;
+        if(huffman_decode_table_create_multi(decoder->decode_tables[0], &symbols_per_lookup) == HUFFMAN_SUCCESS
+           && symbols_per_lookup >= MULTI_MIN_SYMBOLS_PER_LOOKUP) {
+            decoder->multi_entries = decoder->decode_tables[0]->multi_entries;
+        }
+    }
+
+    return HUFFMAN_SUCCESS;
+}
+
+int huffman_block_decoder_create(huffman_block_decoder** decoder) {
+    (*decoder) = malloc(sizeof(huffman_block_decoder));
+    if((*decoder) == NULL) {
+        return HUFFMAN_ALLOC_ERROR;
+    }
+
+    (*decoder)->table_count = 0;
+    (*decoder)->table_bits = 0;
+    (*decoder)->multi_entries = NULL;
+    (*decoder)->verify = 1;
+    (*decoder)->stream_checksum = 0;
+    (*decoder)->block_size = HUFFMAN_BLOCK_SIZE;
+    (*decoder)->rle_buffer = NULL;
+    return HUFFMAN_SUCCESS;
+}
+
+unsigned long long huffman_block_decoder_memory(unsigned int block_size) {
+    return sizeof(huffman_block_decoder) + block_size;
+}
+
+static void huffman_block_decoder_clear(huffman_block_decoder* decoder) {
+    for(int i = 0; i < decoder->table_count; i++) {
+        huffman_tree_destroy(&decoder->trees[i]);
+        if(decoder->table_bits != 0) {
+            huffman_decode_table_destroy(&decoder->decode_tables[i]);
+        }
+    }
+    decoder->table_count = 0;
+    decoder->table_bits = 0;
+    decoder->multi_entries = NULL;
+}
+
+void huffman_block_decoder_reset(huffman_block_decoder* decoder) {
+    huffman_block_decoder_clear(decoder);
+    decoder->stream_checksum = 0;
+}
+
+void huffman_block_decoder_destroy(huffman_block_decoder** decoder) {
+    huffman_block_decoder_clear(*decoder);
+    free((*decoder)->rle_buffer);
+    free((*decoder));
+    (*decoder) = NULL;
+}
+
+static int huffman_block_decoder_read_tables(huffman_block_decoder* decoder, const huffman_block_header* header,
+                                             const unsigned char* body, unsigned int body_size, unsigned int* table_size) {
+
+    huffman_block_decoder_clear(decoder);
+
+    int table_count = 1;
+    unsigned int bytes_read = 0;
+
+    if(header->flags & HUFFMAN_BLOCK_FLAG_CONTEXT) {
+        if(body_size < 1 + 256) {
+            return HUFFMAN_ENCODING_ERROR;
+        }
+
+        table_count = body[0];
+        if(table_count < 2 || table_count > HUFFMAN_MAX_TABLES) {
+            return HUFFMAN_ENCODING_ERROR;
+        }
+
+        for(int context = 0; context < 256; context++) {
+            if(body[1 + context] >= table_count) {
+                return HUFFMAN_ENCODING_ERROR;
+            }
+            decoder->context_map[context] = body[1 + context];
+        }
+
+        bytes_read = 1 + 256;
+    } else {
+        memset(decoder->context_map, 0, 256);
+    }
+
+    for(int i = 0; i < table_count; i++) {
+        unsigned int tree_size;
+        int deserialization_status = huffman_tree_deserialize_buffer(&decoder->trees[i], body + bytes_read,
+                                                                     body_size - bytes_read, &tree_size);
+        if(deserialization_status != HUFFMAN_SUCCESS) {
+            huffman_block_decoder_clear(decoder);
+            return deserialization_status;
+        }
+
+        decoder->table_count++;
+        bytes_read += tree_size;
+    }
+
+    int retval = huffman_block_decoder_build_tables(decoder);
+    if(retval != HUFFMAN_SUCCESS) {
+        huffman_block_decoder_clear(decoder);
+        return retval;
+    }
+
+    (*table_size) = bytes_read;
+    return HUFFMAN_SUCCESS;
+}
+
+/**
+ * Decodes a block of 16 bit symbols with a two level table built from the
+ * block's canonical code lengths.
+ */
+static int huffman_decompress_wide(const unsigned char* body, unsigned int body_size, unsigned char* out, unsigned int size) {
+
+    if(body_size < WIDE_COUNT_FIELD) {
+        return HUFFMAN_ENCODING_ERROR;
+    }
+
+    unsigned int symbol_count = read_u32(body);
+    unsigned int table_size = WIDE_COUNT_FIELD + WIDE_ENTRY_SIZE * symbol_count + (size % 2);
+    if(symbol_count == 0 || symbol_count > HUFFMAN_WIDE_SYMBOLS || table_size > body_size) {
+        return HUFFMAN_ENCODING_ERROR;
+    }
+
+    unsigned int* symbols = malloc(sizeof(unsigned int) * symbol_count);
+    unsigned char* lengths = malloc(symbol_count);
+    if(symbols == NULL || lengths == NULL) {
+        free(symbols);
+        free(lengths);
+        return HUFFMAN_ALLOC_ERROR;
+    }
+
+    const unsigned char* entry = body + WIDE_COUNT_FIELD;
+    for(unsigned int i = 0; i < symbol_count; i++) {
+        symbols[i] = entry[0] | (entry[1] << 8);
+        lengths[i] = entry[2];
+        entry += WIDE_ENTRY_SIZE;
+
+        if(i > 0 && symbols[i] <= symbols[i - 1]) {
+            free(symbols);
+            free(lengths);
+            return HUFFMAN_ENCODING_ERROR;
+        }
+    }
+
+    huffman_decode_table* table;
+    int retval = huffman_decode_table_create(&table, symbols, lengths, symbol_count);
+    free(symbols);
+    free(lengths);
+    if(retval != HUFFMAN_SUCCESS) {
+        return retval;
+    }
+
+    if(size % 2 != 0) {
+        out[size - 1] = body[table_size - 1];
+    }
+
+    const unsigned char* bytes = body + table_size;
+    unsigned int bytes_size = body_size - table_size;
+    unsigned int bytes_read = 0;
+    unsigned long long bit_buffer = 0;
+    int bits = 0;
+    int primary_bits = table->primary_bits;
+
+    for(unsigned int i = 0; i < size / 2; i++) {
+
+        while(bits <= 56 && bytes_read < bytes_size) {
+            bit_buffer |= (unsigned long long) bytes[bytes_read] << (56 - bits);
+            bytes_read++;
+            bits += 8;
+        }
+
+        unsigned int entry = table->entries[bit_buffer >> (64 - primary_bits)];
+        if(entry & HUFFMAN_CODE_LINK) {
+            int link_bits = HUFFMAN_CODE_ENTRY_LENGTH(entry);
+            entry = table->entries[HUFFMAN_CODE_ENTRY_VALUE(entry) + ((bit_buffer << primary_bits) >> (64 - link_bits))];
+        }
+
+        int length = HUFFMAN_CODE_ENTRY_LENGTH(entry);
+        if(length == 0 || length > bits) {
+            huffman_decode_table_destroy(&table);
+            return HUFFMAN_ENCODING_ERROR;
+        }
+
+        unsigned int symbol = HUFFMAN_CODE_ENTRY_VALUE(entry);
+        out[2 * i] = symbol & 0xFF;
+        out[2 * i + 1] = symbol >> 8;
+
+        bit_buffer <<= length;
+        bits -= length;
+    }
+
+    huffman_decode_table_destroy(&table);
+    return HUFFMAN_SUCCESS;
+}
+
+static int huffman_decode_symbols(huffman_block_decoder* decoder, const huffman_block_header* header,
+                                  const unsigned char* body, unsigned int body_size,
+                                  unsigned char* out, unsigned int symbols) {
+
+    if(header->type == HUFFMAN_BLOCK_STORED) {
+        if(body_size != symbols) {
+            return HUFFMAN_ENCODING_ERROR;
+        }
+
+        memcpy(out, body, symbols);
+        return HUFFMAN_SUCCESS;
+    }
+
+    if(header->flags & HUFFMAN_BLOCK_FLAG_WIDE) {
+        return huffman_decompress_wide(body, body_size, out, symbols);
+    }
+
+    unsigned int table_size = 0;
+
+    if((header->flags & HUFFMAN_BLOCK_FLAG_REPEAT_TABLE) == 0) {
+        int retval = huffman_block_decoder_read_tables(decoder, header, body, body_size, &table_size);
+        if(retval != HUFFMAN_SUCCESS) {
+            return retval;
+        }
+    } else if(decoder->table_count == 0) {
+        return HUFFMAN_ENCODING_ERROR;
+    }
+
+    return huffman_decompress_block(decoder, body + table_size, body_size - table_size, out, symbols);
+}
+
+static int huffman_block_decode_body(huffman_block_decoder* decoder, const huffman_block_header* header,
+                                     const unsigned char* body, unsigned char* out) {
+
+    if((header->flags & HUFFMAN_BLOCK_FLAG_RLE) == 0) {
+        return huffman_decode_symbols(decoder, header, body, header->body_size, out, header->raw_size);
+    }
+
+    unsigned int symbols = read_u32(body);
+    if(symbols >= header->raw_size) {
+        return HUFFMAN_ENCODING_ERROR;
+    }
+
+    if(decoder->rle_buffer == NULL) {
+        decoder->rle_buffer = malloc(decoder->block_size);
+        if(decoder->rle_buffer == NULL) {
+            return HUFFMAN_ALLOC_ERROR;
+        }
+    }
+
+    int retval = huffman_decode_symbols(decoder, header, body + RLE_SIZE_FIELD, header->body_size - RLE_SIZE_FIELD,
+                                        decoder->rle_buffer, symbols);
+    if(retval != HUFFMAN_SUCCESS) {
+        return retval;
+    }
+
+    unsigned int decoded_size;
+    if(rle_decode(decoder->rle_buffer, symbols, out, header->raw_size, &decoded_size) != RLE_SUCCESS
+    || decoded_size != header->raw_size) {
+        return HUFFMAN_ENCODING_ERROR;
+    }
+
+    return HUFFMAN_SUCCESS;
+}
+
+int huffman_block_decode(huffman_block_decoder* decoder, const huffman_block_header* header,
+                         const unsigned char* body, unsigned char* out) {
+
+    if(header->raw_size > decoder->block_size) {
+        return HUFFMAN_ENCODING_ERROR;
+    }
+
+    if((header->flags & HUFFMAN_BLOCK_FLAG_CHECKSUM) == 0) {
+        return huffman_block_decode_body(decoder, header, body, out);
+    }
+
+    huffman_block_header body_header = (*header);
+    body_header.flags &= ~HUFFMAN_BLOCK_FLAG_CHECKSUM;
+    body_header.body_size -= HUFFMAN_BLOCK_CHECKSUM_SIZE;
+
+    int retval = huffman_block_decode_body(decoder, &body_header, body, out);
+    if(retval != HUFFMAN_SUCCESS) {
+        return retval;
+    }
+
+    const unsigned char* checksum = body + body_header.body_size;
+    decoder->stream_checksum = crc32c_update(decoder->stream_checksum, checksum, HUFFMAN_BLOCK_CHECKSUM_SIZE);
+
+    /* Checked right after decoding, while the decoded bytes are in cache. */
+    if(decoder->verify && crc32c_update(0, out, header->raw_size) != read_u32(checksum)) {
+        return HUFFMAN_CHECKSUM_ERROR;
+    }
+
+    return HUFFMAN_SUCCESS;
+}
+
+int huffman_block_decoder_end(huffman_block_decoder* decoder, const huffman_block_header* header,
+                              const unsigned char* body) {
+
+    if(decoder->verify && (header->flags & HUFFMAN_BLOCK_FLAG_CHECKSUM) && read_u32(body) != decoder->stream_checksum) {
+        return HUFFMAN_CHECKSUM_ERROR;
+    }
+
+    return HUFFMAN_SUCCESS;
+}
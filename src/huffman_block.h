@@ -0,0 +1,341 @@
+/**
+ * Copyright (c) 2011-2014, Vasileios Daras. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+#ifndef HUFFMAN_BLOCK_H
+#define HUFFMAN_BLOCK_H
+
+#include "huffman_tree.h"
+#include "bitset.h"
+#include "huffman_encoding.h"
+#include "huffman_code.h"
+
+#define HUFFMAN_BLOCK_SIZE (1 << 20)
+/* Smallest blocks a stream may be encoded in, to fit a memory limit. */
+#define HUFFMAN_MIN_BLOCK_SIZE (HUFFMAN_BLOCK_SIZE >> 4)
+
+#define HUFFMAN_STREAM_HEADER_SIZE 5
+#define HUFFMAN_BLOCK_HEADER_SIZE 10
+
+#define HUFFMAN_BLOCK_END 0
+#define HUFFMAN_BLOCK_HUFFMAN 1
+#define HUFFMAN_BLOCK_STORED 2
+
+#define HUFFMAN_BLOCK_FLAG_REPEAT_TABLE 0x01
+#define HUFFMAN_BLOCK_FLAG_CONTEXT 0x02
+#define HUFFMAN_BLOCK_FLAG_RLE 0x04
+#define HUFFMAN_BLOCK_FLAG_WIDE 0x08
+#define HUFFMAN_BLOCK_FLAG_CHECKSUM 0x10
+
+#define HUFFMAN_BLOCK_CHECKSUM_SIZE 4
+/* Largest header and body of a block of size bytes, a stored block with a checksum. */
+#define HUFFMAN_RECORD_SIZE(size) (HUFFMAN_BLOCK_HEADER_SIZE + (size) + HUFFMAN_BLOCK_CHECKSUM_SIZE)
+#define HUFFMAN_BLOCK_RECORD_SIZE HUFFMAN_RECORD_SIZE(HUFFMAN_BLOCK_SIZE)
+
+#define HUFFMAN_MAX_TABLES 8
+#define HUFFMAN_WIDE_SYMBOLS 65536
+
+/**
+ * A compressed stream starts with a stream header and is followed by a
+ * sequence of blocks, each one holding up to HUFFMAN_BLOCK_SIZE bytes of
+ * the input. Every block starts with a header of HUFFMAN_BLOCK_HEADER_SIZE
+ * bytes: the block's type, its flags, the number of bytes the block decodes
+ * to and the size of the block's body, all integers stored in little endian.
+ * A block of type HUFFMAN_BLOCK_END terminates the stream. Blocks with the
+ * HUFFMAN_BLOCK_FLAG_RLE flag code run-length encoded bytes which are
+ * expanded after decoding, blocks with the HUFFMAN_BLOCK_FLAG_WIDE flag code
+ * pairs of bytes as 16 bit symbols. The body of a block with the
+ * HUFFMAN_BLOCK_FLAG_CHECKSUM flag ends with the CRC-32C of the bytes the
+ * block decodes to, which is not counted against raw_size. An end block
+ * with the flag has a body of just the CRC-32C of the checksums of the
+ * blocks before it, each stored in little endian.
+ */
+typedef struct {
+    unsigned char type;
+    unsigned char flags;
+    unsigned int raw_size;
+    unsigned int body_size;
+} huffman_block_header;
+
+/**
+ * A code used to compress a block. codes holds the code of each byte packed
+ * with its length by BIT_IO_CODE, for codes of up to BIT_IO_MAX_CODE_LENGTH
+ * bits, 256 entries that fit in 1 KiB.
+ */
+typedef struct {
+    huffman_node* tree;
+    bitset* tree_binary_rep;
+    unsigned int codes[256];
+    unsigned int lengths[256];
+} huffman_table;
+
+/**
+ * The codes used to compress a block. A block is either coded with a single
+ * table, or, when it has the HUFFMAN_BLOCK_FLAG_CONTEXT flag, each byte is
+ * coded with the table that the byte before it maps to. A block's tables are
+ * kept by the encoder after the block is written so that the next block may
+ * reuse them.
+ */
+typedef struct {
+    int table_count;
+    unsigned char context_map[256];
+    huffman_table tables[HUFFMAN_MAX_TABLES];
+} huffman_table_set;
+
+/**
+ * Scratch space for coding blocks as 16 bit symbols. frequencies and codes
+ * are indexed by symbol, the rest by the position of the symbol in symbols.
+ */
+typedef struct {
+    unsigned int* frequencies;
+    unsigned int* codes;
+    unsigned int* symbols;
+    unsigned int* symbol_frequencies;
+    unsigned char* lengths;
+    int symbol_count;
+} huffman_wide_state;
+
+/**
+ * Compresses blocks of up to block_size bytes, which bounds the size of its
+ * record and buffers.
+ */
+typedef struct {
+    huffman_options options;
+    unsigned int block_size;
+    huffman_table_set previous;
+    unsigned int (*context_frequencies)[256];
+    unsigned char* rle_buffer;
+    huffman_wide_state* wide;
+    huffman_stats stats;
+    unsigned int stream_checksum;
+
+    unsigned char* record;
+} huffman_block_encoder;
+
+/**
+ * Tables of the last block that carried them. decode_tables are built from
+ * the trees when every code is at most HUFFMAN_CODE_MAX_LENGTH bits long and
+ * share a primary width of table_bits. table_bits is 0 when blocks are
+ * decoded by walking the trees instead. multi_entries are the multi-symbol
+ * entries of a block's only table when its codes are short enough for a
+ * lookup to decode more than one symbol on average, NULL otherwise.
+ * Checksums are only compared with the bytes decoded when verify is set,
+ * which it is by default. Blocks of more than block_size bytes, which is
+ * HUFFMAN_BLOCK_SIZE by default, are rejected.
+ */
+typedef struct {
+    int table_count;
+    unsigned char context_map[256];
+    huffman_node* trees[HUFFMAN_MAX_TABLES];
+    huffman_decode_table* decode_tables[HUFFMAN_MAX_TABLES];
+    int table_bits;
+    const unsigned int* multi_entries;
+
+    int verify;
+    unsigned int stream_checksum;
+    unsigned int block_size;
+
+    unsigned char* rle_buffer;
+} huffman_block_decoder;
+
+/**
+ * Writes the header that starts a compressed stream. Streams encoded in
+ * blocks smaller than HUFFMAN_BLOCK_SIZE record their size, so that they
+ * can be decoded in as little memory.
+ *
+ * @param buffer Buffer of HUFFMAN_STREAM_HEADER_SIZE bytes to write the header to.
+ * @param block_size Largest block of the stream, HUFFMAN_BLOCK_SIZE halved
+ *                   down to no less than HUFFMAN_MIN_BLOCK_SIZE.
+ */
+void huffman_stream_header_write(unsigned char* buffer, unsigned int block_size);
+
+/**
+ * Checks if a buffer starts with a compressed stream header.
+ *
+ * @param buffer Buffer of HUFFMAN_STREAM_HEADER_SIZE bytes.
+ * @return 1 if the buffer holds a valid stream header, 0 otherwise.
+ */
+int huffman_stream_header_check(const unsigned char* buffer);
+
+/**
+ * Returns the size of the largest block of a stream.
+ *
+ * @param buffer Buffer of HUFFMAN_STREAM_HEADER_SIZE bytes holding a valid stream header.
+ * @return Number of bytes.
+ */
+unsigned int huffman_stream_header_block_size(const unsigned char* buffer);
+
+/**
+ * Writes a block header.
+ *
+ * @param header The header to write.
+ * @param buffer Buffer of HUFFMAN_BLOCK_HEADER_SIZE bytes to write the header to.
+ */
+void huffman_block_header_write(const huffman_block_header* header, unsigned char* buffer);
+
+/**
+ * Reads and validates a block header.
+ *
+ * @param header(out) The header read is stored in here.
+ * @param buffer Buffer of HUFFMAN_BLOCK_HEADER_SIZE bytes to read the header from.
+ * @return A flag indicating if the header is valid.
+ */
+int huffman_block_header_read(huffman_block_header* header, const unsigned char* buffer);
+
+/**
+ * Creates a block encoder.
+ *
+ * @param encoder(out) Created encoder is stored here. NULL if creation fails.
+ * @param options Options the encoder compresses blocks with.
+ * @param block_size Largest block the encoder compresses, up to HUFFMAN_BLOCK_SIZE.
+ * @return A flag indicating if creation was successful.
+ */
+int huffman_block_encoder_create(huffman_block_encoder** encoder, const huffman_options* options, unsigned int block_size);
+
+/**
+ * Computes the memory the buffers of an encoder take, allocated when it is
+ * created. The tables built for each block are not counted.
+ *
+ * @param options Options the encoder compresses blocks with.
+ * @param block_size Largest block the encoder compresses.
+ * @return Number of bytes.
+ */
+unsigned long long huffman_block_encoder_memory(const huffman_options* options, unsigned int block_size);
+
+/**
+ * Destroys a block encoder.
+ *
+ * @param encoder Encoder to destroy, set to NULL after the call.
+ */
+void huffman_block_encoder_destroy(huffman_block_encoder** encoder);
+
+/**
+ * Returns an encoder to the state it was created in, keeping its memory,
+ * so that it can compress another stream.
+ *
+ * @param encoder The encoder.
+ */
+void huffman_block_encoder_reset(huffman_block_encoder* encoder);
+
+/**
+ * Compresses a block. The block's header and body are stored in a record
+ * owned by the encoder which is valid until the next call.
+ *
+ * @param encoder The encoder.
+ * @param data Bytes to compress.
+ * @param size Number of bytes to compress, up to the encoder's block_size.
+ * @param record(out) Compressed block is stored in here.
+ * @param record_size(out) Size of the compressed block is stored in here.
+ * @return A flag indicating if compression was successful.
+ */
+int huffman_block_encode(huffman_block_encoder* encoder, const unsigned char* data, unsigned int size,
+                         unsigned char** record, unsigned int* record_size);
+
+/**
+ * Estimates the size of a block's record without coding it. The block's
+ * bytes are counted, or sampled with the fast option as huffman_block_encode
+ * does for large blocks, and only its code is built. Reusing the tables of
+ * the block before, run-length encoding and 16 bit symbols are not
+ * considered.
+ *
+ * @param options Options the block would be compressed with.
+ * @param data Bytes of the block.
+ * @param size Number of bytes, up to HUFFMAN_BLOCK_SIZE.
+ * @param context_frequencies Scratch space of 256 counts per context, needed with the order1 option.
+ * @param stats(out) The block's input size, record size, and whether it would be stored, are added to these.
+ * @return A flag indicating if estimating was successful.
+ */
+int huffman_block_estimate(const huffman_options* options, const unsigned char* data, unsigned int size,
+                           unsigned int (*context_frequencies)[256], huffman_stats* stats);
+
+/**
+ * Writes the end block of the stream the encoder compressed.
+ *
+ * @param encoder The encoder.
+ * @param record(out) Buffer of HUFFMAN_BLOCK_HEADER_SIZE + HUFFMAN_BLOCK_CHECKSUM_SIZE bytes to write the block to.
+ * @return The size of the end block.
+ */
+unsigned int huffman_block_encoder_end(huffman_block_encoder* encoder, unsigned char* record);
+
+/**
+ * Gives the encoder a new buffer for its records and returns the buffer
+ * holding the last record, which then belongs to the caller.
+ *
+ * @param encoder The encoder.
+ * @param record Buffer of HUFFMAN_RECORD_SIZE(block_size) bytes.
+ * @return The encoder's previous record buffer.
+ */
+unsigned char* huffman_block_encoder_swap_record(huffman_block_encoder* encoder, unsigned char* record);
+
+/**
+ * Creates a block decoder.
+ *
+ * @param decoder(out) Created decoder is stored here. NULL if creation fails.
+ * @return A flag indicating if creation was successful.
+ */
+int huffman_block_decoder_create(huffman_block_decoder** decoder);
+
+/**
+ * Computes the most memory the buffers of a decoder take, counting the
+ * buffer for run-length encoded blocks, which is allocated with the first
+ * such block. Trees and decode tables are not counted.
+ *
+ * @param block_size Size of the largest block decoded.
+ * @return Number of bytes.
+ */
+unsigned long long huffman_block_decoder_memory(unsigned int block_size);
+
+/**
+ * Destroys a block decoder.
+ *
+ * @param decoder Decoder to destroy, set to NULL after the call.
+ */
+void huffman_block_decoder_destroy(huffman_block_decoder** decoder);
+
+/**
+ * Returns a decoder to the state it was created in, keeping its memory,
+ * so that it can decompress another stream.
+ *
+ * @param decoder The decoder.
+ */
+void huffman_block_decoder_reset(huffman_block_decoder* decoder);
+
+/**
+ * Decompresses a block.
+ *
+ * @param decoder The decoder.
+ * @param header The block's header.
+ * @param body The block's body, header->body_size bytes.
+ * @param out Buffer of at least header->raw_size bytes to decompress to.
+ * @return A flag indicating if decompression was successful.
+ */
+int huffman_block_decode(huffman_block_decoder* decoder, const huffman_block_header* header,
+                         const unsigned char* body, unsigned char* out);
+
+/**
+ * Checks the end block of a stream against the blocks decoded before it.
+ *
+ * @param decoder The decoder.
+ * @param header The end block's header.
+ * @param body The end block's body, header->body_size bytes.
+ * @return A flag indicating if the stream is intact, HUFFMAN_CHECKSUM_ERROR if it is not.
+ */
+int huffman_block_decoder_end(huffman_block_decoder* decoder, const huffman_block_header* header,
+                              const unsigned char* body);
+
+#endif //HUFFMAN_BLOCK_H
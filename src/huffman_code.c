@@ -0,0 +1,327 @@
+/**
+ * Copyright (c) 2011-2014, Vasileios Daras. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+#include "huffman_code.h"
+#include "huffman_tree.h"
+#include "binary_heap.h"
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    unsigned int frequency;
+    int index;
+    int parent;
+    int depth;
+} code_node;
+
+static int compare_code_nodes(void* node1, void* node2) {
+    code_node* code_node_1 = (code_node*) node1;
+    code_node* code_node_2 = (code_node*) node2;
+
+    if(code_node_1->frequency != code_node_2->frequency) {
+        return code_node_1->frequency < code_node_2->frequency ? 1 : -1;
+    }
+
+    return code_node_1->index < code_node_2->index ? 1 :
+            code_node_1->index == code_node_2->index ? 0 : -1;
+}
+
+/**
+ * Builds a huffman tree the same way huffman_tree_create does, but in an
+ * array of count leaves followed by count - 1 internal nodes so that only
+ * the depth of each leaf is kept. Returns the depth of the deepest leaf.
+ */
+static int build_code_lengths(const unsigned int* frequencies, int count, unsigned char* lengths, code_node* nodes) {
+
+    binary_heap* heap = NULL;
+    if(binary_heap_create(&heap, compare_code_nodes, NULL) != BINARYHEAP_SUCCESS) {
+        return HUFFMAN_ALLOC_ERROR;
+    }
+
+    for(int i = 0; i < count; i++) {
+        nodes[i].frequency = frequencies[i];
+        nodes[i].index = i;
+        nodes[i].parent = -1;
+
+        if(binary_heap_insert(heap, &nodes[i]) != BINARYHEAP_SUCCESS) {
+            binary_heap_destroy(&heap);
+            return HUFFMAN_ALLOC_ERROR;
+        }
+    }
+
+    for(int next = count; next < 2 * count - 1; next++) {
+        void* data;
+        binary_heap_extract(heap, &data);
+        code_node* left = (code_node*) data;
+        binary_heap_extract(heap, &data);
+        code_node* right = (code_node*) data;
+
+        nodes[next].frequency = left->frequency + right->frequency;
+        nodes[next].index = next;
+        nodes[next].parent = -1;
+        left->parent = right->parent = next;
+
+        if(binary_heap_insert(heap, &nodes[next]) != BINARYHEAP_SUCCESS) {
+            binary_heap_destroy(&heap);
+            return HUFFMAN_ALLOC_ERROR;
+        }
+    }
+
+    binary_heap_destroy(&heap);
+
+    /* Parents always come after their children, so depths are set from the root down. */
+    int max_depth = 0;
+    nodes[2 * count - 2].depth = 0;
+    for(int i = 2 * count - 3; i >= 0; i--) {
+        nodes[i].depth = nodes[nodes[i].parent].depth + 1;
+
+        if(i < count) {
+            lengths[i] = nodes[i].depth;
+            if(nodes[i].depth > max_depth) {
+                max_depth = nodes[i].depth;
+            }
+        }
+    }
+
+    return max_depth;
+}
+
+/**
+ * When the tree is deeper than max_length, the frequencies are halved,
+ * which flattens the tree, and the tree is built again until it fits.
+ */
+int huffman_code_lengths(const unsigned int* frequencies, int count, unsigned char* lengths, int max_length) {
+
+    if(count == 1) {
+        lengths[0] = 1;
+        return HUFFMAN_SUCCESS;
+    }
+
+    code_node* nodes = malloc(sizeof(code_node) * (2 * count - 1));
+    unsigned int* scaled = malloc(sizeof(unsigned int) * count);
+    if(nodes == NULL || scaled == NULL) {
+        free(nodes);
+        free(scaled);
+        return HUFFMAN_ALLOC_ERROR;
+    }
+
+    memcpy(scaled, frequencies, sizeof(unsigned int) * count);
+
+    int retval;
+    while((retval = build_code_lengths(scaled, count, lengths, nodes)) > max_length) {
+        for(int i = 0; i < count; i++) {
+            scaled[i] = scaled[i] / 2 + 1;
+        }
+    }
+
+    free(nodes);
+    free(scaled);
+    return retval < 0 ? retval : HUFFMAN_SUCCESS;
+}
+
+int huffman_canonical_codes(const unsigned char* lengths, int count, unsigned int* codes) {
+
+    unsigned int length_count[HUFFMAN_CODE_MAX_LENGTH + 1] = { 0 };
+    for(int i = 0; i < count; i++) {
+        if(lengths[i] == 0 || lengths[i] > HUFFMAN_CODE_MAX_LENGTH) {
+            return HUFFMAN_ENCODING_ERROR;
+        }
+        length_count[lengths[i]]++;
+    }
+
+    unsigned int next_code[HUFFMAN_CODE_MAX_LENGTH + 1];
+    unsigned int code = 0;
+    for(int length = 1; length <= HUFFMAN_CODE_MAX_LENGTH; length++) {
+        code = (code + length_count[length - 1]) << 1;
+        next_code[length] = code;
+
+        /* More codes of this length than there are left means the lengths are over-subscribed. */
+        if(code + length_count[length] > (1u << length)) {
+            return HUFFMAN_ENCODING_ERROR;
+        }
+    }
+
+    for(int i = 0; i < count; i++) {
+        codes[i] = next_code[lengths[i]];
+        next_code[lengths[i]]++;
+    }
+
+    return HUFFMAN_SUCCESS;
+}
+
+int huffman_decode_table_create(huffman_decode_table** table, const unsigned int* symbols, const unsigned char* lengths, int count) {
+
+    (*table) = NULL;
+
+    unsigned int* codes = malloc(sizeof(unsigned int) * count);
+    if(codes == NULL) {
+        return HUFFMAN_ALLOC_ERROR;
+    }
+
+    int retval = huffman_canonical_codes(lengths, count, codes);
+    if(retval != HUFFMAN_SUCCESS) {
+        free(codes);
+        return retval;
+    }
+
+    int max_length = 0;
+    for(int i = 0; i < count; i++) {
+        if(lengths[i] > max_length) {
+            max_length = lengths[i];
+        }
+    }
+
+    int primary_bits = max_length < HUFFMAN_CODE_PRIMARY_BITS ? max_length : HUFFMAN_CODE_PRIMARY_BITS;
+    retval = huffman_decode_table_create_codes(table, symbols, codes, lengths, count, primary_bits);
+
+    free(codes);
+    return retval;
+}
+
+int huffman_decode_table_create_codes(huffman_decode_table** table, const unsigned int* symbols, const unsigned int* codes,
+                                      const unsigned char* lengths, int count, int primary_bits) {
+
+    (*table) = NULL;
+
+    if(primary_bits < 1 || primary_bits > HUFFMAN_CODE_MAX_PRIMARY_BITS) {
+        return HUFFMAN_ENCODING_ERROR;
+    }
+
+    for(int i = 0; i < count; i++) {
+        if(lengths[i] == 0 || lengths[i] > HUFFMAN_CODE_MAX_LENGTH) {
+            return HUFFMAN_ENCODING_ERROR;
+        }
+    }
+
+    unsigned int primary_size = 1u << primary_bits;
+
+    /* Codes longer than the primary bits share a secondary table per primary prefix. */
+    unsigned char secondary_bits[1 << HUFFMAN_CODE_MAX_PRIMARY_BITS] = { 0 };
+    for(int i = 0; i < count; i++) {
+        if(lengths[i] > primary_bits) {
+            unsigned int prefix = codes[i] >> (lengths[i] - primary_bits);
+            if(lengths[i] - primary_bits > secondary_bits[prefix]) {
+                secondary_bits[prefix] = lengths[i] - primary_bits;
+            }
+        }
+    }
+
+    unsigned int size = primary_size;
+    for(unsigned int prefix = 0; prefix < primary_size; prefix++) {
+        if(secondary_bits[prefix] != 0) {
+            size += 1u << secondary_bits[prefix];
+        }
+    }
+
+    huffman_decode_table* retval_table = malloc(sizeof(huffman_decode_table));
+    unsigned int* entries = calloc(size, sizeof(unsigned int));
+    if(retval_table == NULL || entries == NULL) {
+        free(retval_table);
+        free(entries);
+        return HUFFMAN_ALLOC_ERROR;
+    }
+
+    unsigned int offset = primary_size;
+    for(unsigned int prefix = 0; prefix < primary_size; prefix++) {
+        if(secondary_bits[prefix] != 0) {
+            entries[prefix] = (offset << 8) | HUFFMAN_CODE_LINK | secondary_bits[prefix];
+            offset += 1u << secondary_bits[prefix];
+        }
+    }
+
+    for(int i = 0; i < count; i++) {
+        unsigned int entry = (symbols[i] << 8) | lengths[i];
+
+        if(lengths[i] <= primary_bits) {
+            unsigned int start = codes[i] << (primary_bits - lengths[i]);
+            unsigned int span = 1u << (primary_bits - lengths[i]);
+            for(unsigned int j = 0; j < span; j++) {
+                entries[start + j] = entry;
+            }
+        } else {
+            int rest_bits = lengths[i] - primary_bits;
+            unsigned int link = entries[codes[i] >> rest_bits];
+            int link_bits = HUFFMAN_CODE_ENTRY_LENGTH(link);
+
+            unsigned int rest = codes[i] & ((1u << rest_bits) - 1);
+            unsigned int start = HUFFMAN_CODE_ENTRY_VALUE(link) + (rest << (link_bits - rest_bits));
+            unsigned int span = 1u << (link_bits - rest_bits);
+            for(unsigned int j = 0; j < span; j++) {
+                entries[start + j] = entry;
+            }
+        }
+    }
+
+    retval_table->primary_bits = primary_bits;
+    retval_table->size = size;
+    retval_table->entries = entries;
+    retval_table->multi_entries = NULL;
+    (*table) = retval_table;
+    return HUFFMAN_SUCCESS;
+}
+
+/**
+ * Every primary index is as likely as any other when each code of length n
+ * occurs with the probability of 2^-n that the code implies, so the average
+ * over the entries is the number of symbols a lookup is expected to decode.
+ */
+int huffman_decode_table_create_multi(huffman_decode_table* table, unsigned int* symbols_per_lookup) {
+
+    int primary_bits = table->primary_bits;
+    unsigned int primary_size = 1u << primary_bits;
+
+    unsigned int* multi_entries = malloc(sizeof(unsigned int) * primary_size);
+    if(multi_entries == NULL) {
+        return HUFFMAN_ALLOC_ERROR;
+    }
+
+    unsigned long long total_symbols = 0;
+    for(unsigned int index = 0; index < primary_size; index++) {
+        unsigned int multi = 0;
+        int consumed = 0;
+
+        for(int count = 0; count < HUFFMAN_CODE_MULTI_SYMBOLS; count++) {
+            /* The bits after the codes decoded so far, with 0 bits past the end of the index. */
+            unsigned int entry = table->entries[(index << consumed) & (primary_size - 1)];
+            int length = HUFFMAN_CODE_ENTRY_LENGTH(entry);
+            if((entry & HUFFMAN_CODE_LINK) || length == 0 || length > primary_bits - consumed) {
+                break;
+            }
+
+            multi |= HUFFMAN_CODE_ENTRY_VALUE(entry) << (8 + 8 * count);
+            consumed += length;
+            multi = (multi & ~0x7Fu) | ((count + 1) << 5) | consumed;
+        }
+
+        multi_entries[index] = multi;
+        total_symbols += HUFFMAN_CODE_MULTI_COUNT(multi);
+    }
+
+    free(table->multi_entries);
+    table->multi_entries = multi_entries;
+    (*symbols_per_lookup) = (unsigned int) ((total_symbols << 8) >> primary_bits);
+    return HUFFMAN_SUCCESS;
+}
+
+void huffman_decode_table_destroy(huffman_decode_table** table) {
+    free((*table)->multi_entries);
+    free((*table)->entries);
+    free((*table));
+    (*table) = NULL;
+}
@@ -0,0 +1,129 @@
+/**
+ * Copyright (c) 2011-2014, Vasileios Daras. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+#ifndef HUFFMAN_CODE_H
+#define HUFFMAN_CODE_H
+
+#define HUFFMAN_CODE_MAX_LENGTH 20
+#define HUFFMAN_CODE_PRIMARY_BITS 11
+#define HUFFMAN_CODE_MAX_PRIMARY_BITS 12
+
+/**
+ * A decode table entry holds a code's length in its low 5 bits and its
+ * symbol from bit 8 up. Entries for codes longer than the table's primary
+ * bits are links instead, marked by HUFFMAN_CODE_LINK, that hold the number
+ * of further bits to index a secondary table with and the secondary table's
+ * offset. Entries with a length of 0 don't start any code.
+ */
+#define HUFFMAN_CODE_LINK 0x20
+#define HUFFMAN_CODE_ENTRY_LENGTH(entry) ((entry) & 0x1F)
+#define HUFFMAN_CODE_ENTRY_VALUE(entry) ((entry) >> 8)
+
+/**
+ * A multi-symbol entry decodes every whole code, up to
+ * HUFFMAN_CODE_MULTI_SYMBOLS of them, found in the primary bits it is
+ * indexed by. It holds the codes' total length in its low 5 bits, their
+ * number in the next 2 bits and their byte symbols from bit 8 up, the first
+ * in the lowest byte. Entries whose first code is longer than the primary
+ * bits hold no codes.
+ */
+#define HUFFMAN_CODE_MULTI_SYMBOLS 3
+#define HUFFMAN_CODE_MULTI_COUNT(entry) (((entry) >> 5) & 0x3)
+
+/**
+ * A two level decode table. multi_entries is a primary table of
+ * multi-symbol entries, NULL unless created with
+ * huffman_decode_table_create_multi.
+ */
+typedef struct {
+    int primary_bits;
+    unsigned int size;
+    unsigned int* entries;
+    unsigned int* multi_entries;
+} huffman_decode_table;
+
+/**
+ * Computes huffman code lengths for a set of symbols, limited to max_length
+ * bits. A single symbol gets a code of one bit.
+ *
+ * @param frequencies Frequency of each symbol, all greater than 0.
+ * @param count Number of symbols.
+ * @param lengths(out) Code length of each symbol.
+ * @param max_length Longest code length allowed, enough to code count symbols.
+ * @return A flag indicating if computing the lengths was successful.
+ */
+int huffman_code_lengths(const unsigned int* frequencies, int count, unsigned char* lengths, int max_length);
+
+/**
+ * Assigns canonical codes to symbols from their code lengths. Shorter codes
+ * come first, codes of equal length are assigned in the order the symbols
+ * are given.
+ *
+ * @param lengths Code length of each symbol.
+ * @param count Number of symbols.
+ * @param codes(out) Code of each symbol.
+ * @return HUFFMAN_ENCODING_ERROR if the lengths can't form a prefix code.
+ */
+int huffman_canonical_codes(const unsigned char* lengths, int count, unsigned int* codes);
+
+/**
+ * Creates a two level table for decoding canonical codes.
+ *
+ * @param table(out) Created table is stored here. NULL if creation fails.
+ * @param symbols Symbol of each code, in the order codes were assigned to them.
+ * @param lengths Code length of each symbol, at most HUFFMAN_CODE_MAX_LENGTH.
+ * @param count Number of symbols.
+ * @return A flag indicating if creation was successful.
+ */
+int huffman_decode_table_create(huffman_decode_table** table, const unsigned int* symbols, const unsigned char* lengths, int count);
+
+/**
+ * Creates a two level table for decoding any prefix code, canonical or not,
+ * with a primary table of a fixed number of bits.
+ *
+ * @param table(out) Created table is stored here. NULL if creation fails.
+ * @param symbols Symbol of each code.
+ * @param codes Code of each symbol, most significant bit first.
+ * @param lengths Code length of each symbol, at most HUFFMAN_CODE_MAX_LENGTH.
+ * @param count Number of symbols.
+ * @param primary_bits Bits indexing the primary table, at most HUFFMAN_CODE_MAX_PRIMARY_BITS.
+ * @return A flag indicating if creation was successful.
+ */
+int huffman_decode_table_create_codes(huffman_decode_table** table, const unsigned int* symbols, const unsigned int* codes,
+                                      const unsigned char* lengths, int count, int primary_bits);
+
+/**
+ * Creates a table of multi-symbol entries for the primary table of a decode
+ * table of byte symbols, so that runs of short codes are decoded with a
+ * single lookup.
+ *
+ * @param table The decode table, which the multi-symbol table is kept in.
+ * @param symbols_per_lookup(out) Average number of symbols an entry decodes, in 1/256ths, weighting each entry as the code implies.
+ * @return A flag indicating if creation was successful.
+ */
+int huffman_decode_table_create_multi(huffman_decode_table* table, unsigned int* symbols_per_lookup);
+
+/**
+ * Destroys a decode table.
+ *
+ * @param table Table to destroy, set to NULL after the call.
+ */
+void huffman_decode_table_destroy(huffman_decode_table** table);
+
+#endif //HUFFMAN_CODE_H
@@ -0,0 +1,224 @@
+/**
+ * Copyright (c) 2011-2014, Vasileios Daras. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+#include "huffman.h"
+#include "huffman_block.h"
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Buffers are coded a block at a time with an encoder and decoder that
+ * are reset between calls. Blocks are decoded straight into the caller's
+ * output and only compressed blocks are copied out of the encoder.
+ */
+struct huffman_context_t {
+    huffman_options options;
+    huffman_block_encoder* encoder;
+    huffman_block_decoder* decoder;
+};
+
+int huffman_context_create(huffman_context** context, const huffman_options* options) {
+    huffman_context* retval = malloc(sizeof(huffman_context));
+    if(retval == NULL) {
+        (*context) = NULL;
+        return HUFFMAN_ALLOC_ERROR;
+    }
+
+    huffman_options_copy(&retval->options, options);
+    options = &retval->options;
+    retval->decoder = NULL;
+
+    int status = huffman_block_encoder_create(&retval->encoder, options, HUFFMAN_BLOCK_SIZE);
+    if(status == HUFFMAN_SUCCESS) {
+        status = huffman_block_decoder_create(&retval->decoder);
+    }
+    if(status != HUFFMAN_SUCCESS) {
+        if(retval->encoder != NULL) {
+            huffman_block_encoder_destroy(&retval->encoder);
+        }
+        free(retval);
+        (*context) = NULL;
+        return status;
+    }
+
+    retval->decoder->verify = options->verify;
+
+    (*context) = retval;
+    return HUFFMAN_SUCCESS;
+}
+
+void huffman_context_destroy(huffman_context** context) {
+    huffman_block_encoder_destroy(&(*context)->encoder);
+    huffman_block_decoder_destroy(&(*context)->decoder);
+    free((*context));
+    (*context) = NULL;
+}
+
+int huffman_context_compress(huffman_context* context, const unsigned char* in, size_t in_len,
+                             unsigned char* out, size_t out_cap, size_t* out_len) {
+
+    huffman_block_encoder_reset(context->encoder);
+
+    if(out_cap < HUFFMAN_STREAM_HEADER_SIZE) {
+        return HUFFMAN_BUFFER_ERROR;
+    }
+    huffman_stream_header_write(out, HUFFMAN_BLOCK_SIZE);
+    size_t position = HUFFMAN_STREAM_HEADER_SIZE;
+
+    size_t offset = 0;
+    while(offset < in_len) {
+        unsigned int size = in_len - offset < HUFFMAN_BLOCK_SIZE ? (unsigned int) (in_len - offset) : HUFFMAN_BLOCK_SIZE;
+
+        unsigned char* record;
+        unsigned int record_size;
+        int retval = huffman_block_encode(context->encoder, in + offset, size, &record, &record_size);
+        if(retval != HUFFMAN_SUCCESS) {
+            return retval;
+        }
+        if(record_size > out_cap - position) {
+            return HUFFMAN_BUFFER_ERROR;
+        }
+
+        memcpy(out + position, record, record_size);
+        position += record_size;
+        offset += size;
+    }
+
+    unsigned char end[HUFFMAN_BLOCK_HEADER_SIZE + HUFFMAN_BLOCK_CHECKSUM_SIZE];
+    unsigned int end_size = huffman_block_encoder_end(context->encoder, end);
+    if(end_size > out_cap - position) {
+        return HUFFMAN_BUFFER_ERROR;
+    }
+    memcpy(out + position, end, end_size);
+
+    (*out_len) = position + end_size;
+    return HUFFMAN_SUCCESS;
+}
+
+int huffman_context_decompress(huffman_context* context, const unsigned char* in, size_t in_len,
+                               unsigned char* out, size_t out_cap, size_t* out_len) {
+
+    huffman_block_decoder_reset(context->decoder);
+
+    if(in_len < HUFFMAN_STREAM_HEADER_SIZE || !huffman_stream_header_check(in)) {
+        return HUFFMAN_ENCODING_ERROR;
+    }
+    size_t position = HUFFMAN_STREAM_HEADER_SIZE;
+    size_t produced = 0;
+
+    while(1) {
+        if(in_len - position < HUFFMAN_BLOCK_HEADER_SIZE) {
+            return HUFFMAN_ENCODING_ERROR;
+        }
+
+        huffman_block_header header;
+        int retval = huffman_block_header_read(&header, in + position);
+        if(retval != HUFFMAN_SUCCESS) {
+            return retval;
+        }
+        position += HUFFMAN_BLOCK_HEADER_SIZE;
+
+        if(header.body_size > in_len - position) {
+            return HUFFMAN_ENCODING_ERROR;
+        }
+        const unsigned char* body = in + position;
+        position += header.body_size;
+
+        if(header.type == HUFFMAN_BLOCK_END) {
+            retval = huffman_block_decoder_end(context->decoder, &header, body);
+            if(retval == HUFFMAN_SUCCESS) {
+                (*out_len) = produced;
+            }
+            return retval;
+        }
+
+        if(header.raw_size > out_cap - produced) {
+            return HUFFMAN_BUFFER_ERROR;
+        }
+
+        retval = huffman_block_decode(context->decoder, &header, body, out + produced);
+        if(retval != HUFFMAN_SUCCESS) {
+            return retval;
+        }
+        produced += header.raw_size;
+    }
+}
+
+size_t huffman_compress_bound(size_t in_len) {
+    size_t blocks = (in_len + HUFFMAN_BLOCK_SIZE - 1) / HUFFMAN_BLOCK_SIZE;
+    return HUFFMAN_STREAM_HEADER_SIZE + in_len + (blocks + 1) * (HUFFMAN_BLOCK_HEADER_SIZE + HUFFMAN_BLOCK_CHECKSUM_SIZE);
+}
+
+int huffman_compress_buffer(const huffman_options* options, const unsigned char* in, size_t in_len,
+                            unsigned char* out, size_t out_cap, size_t* out_len) {
+
+    huffman_context* context;
+    int retval = huffman_context_create(&context, options);
+    if(retval != HUFFMAN_SUCCESS) {
+        return retval;
+    }
+
+    retval = huffman_context_compress(context, in, in_len, out, out_cap, out_len);
+    huffman_context_destroy(&context);
+    return retval;
+}
+
+int huffman_decompress_buffer(const huffman_options* options, const unsigned char* in, size_t in_len,
+                              unsigned char* out, size_t out_cap, size_t* out_len) {
+
+    huffman_context* context;
+    int retval = huffman_context_create(&context, options);
+    if(retval != HUFFMAN_SUCCESS) {
+        return retval;
+    }
+
+    retval = huffman_context_decompress(context, in, in_len, out, out_cap, out_len);
+    huffman_context_destroy(&context);
+    return retval;
+}
+
+int huffman_estimate_buffer(const huffman_options* options, const unsigned char* in, size_t in_len, size_t* out_len) {
+
+    huffman_options copy;
+    huffman_options_copy(&copy, options);
+    options = &copy;
+
+    unsigned int (*context_frequencies)[256] = NULL;
+    if(options->order1) {
+        context_frequencies = malloc(sizeof(unsigned int) * 256 * 256);
+        if(context_frequencies == NULL) {
+            return HUFFMAN_ALLOC_ERROR;
+        }
+    }
+
+    huffman_stats stats;
+    memset(&stats, 0, sizeof(huffman_stats));
+
+    int retval = HUFFMAN_SUCCESS;
+    for(size_t offset = 0; retval == HUFFMAN_SUCCESS && offset < in_len; offset += HUFFMAN_BLOCK_SIZE) {
+        unsigned int size = in_len - offset < HUFFMAN_BLOCK_SIZE ? (unsigned int) (in_len - offset) : HUFFMAN_BLOCK_SIZE;
+        retval = huffman_block_estimate(options, in + offset, size, context_frequencies, &stats);
+    }
+
+    (*out_len) = HUFFMAN_STREAM_HEADER_SIZE + stats.output_size + HUFFMAN_BLOCK_HEADER_SIZE
+               + (options->checksum ? HUFFMAN_BLOCK_CHECKSUM_SIZE : 0);
+
+    free(context_frequencies);
+    return retval;
+}
@@ -20,235 +20,180 @@
 #include "huffman_encoding.h"
 #include "binary_heap.h"
 #include "huffman_tree.h"
+#include "huffman_block.h"
+#include "huffman_pipeline.h"
+#include "huffman_legacy.h"
 #include "bitset.h"
 #include <stdlib.h>
+#include <string.h>
+
+void huffman_options_init_size(huffman_options* options, size_t size) {
+    huffman_options defaults;
+    defaults.struct_size = size;
+    defaults.order1 = 0;
+    defaults.rle = 0;
+    defaults.wide = 0;
+    defaults.fast = 0;
+    defaults.stats = 0;
+    defaults.io = HUFFMAN_IO_STDIO;
+    defaults.checksum = 0;
+    defaults.verify = 1;
+    defaults.threads = 1;
+    defaults.memory_limit = 0;
+
+    memcpy(options, &defaults, size < sizeof(huffman_options) ? size : sizeof(huffman_options));
+}
 
-static const int BUFFER_SIZE = 2048;
-
-static void count_frequencies(FILE* fp, unsigned int frequencies[256]) {
-    
-    unsigned char bytes[BUFFER_SIZE]; 
+void huffman_stats_init_size(huffman_stats* stats, size_t size) {
+    huffman_stats zero;
+    memset(&zero, 0, sizeof(huffman_stats));
+    zero.struct_size = size;
 
-    for(int i = 0; i < 256; i++) {
-        frequencies[i] = 0;
-    }
-    
-    unsigned int bytes_read = 0;
-    while((bytes_read = fread(bytes, sizeof(unsigned char), BUFFER_SIZE, fp)) != 0) {
-        
-        for(int curr_byte = 0; curr_byte < bytes_read; curr_byte++) {
+    memcpy(stats, &zero, size < sizeof(huffman_stats) ? size : sizeof(huffman_stats));
+}
 
-            unsigned char byte = bytes[curr_byte];
+void huffman_options_copy(huffman_options* copy, const huffman_options* options) {
+    huffman_options_init(copy);
+    memcpy(copy, options, options->struct_size < sizeof(huffman_options) ? options->struct_size : sizeof(huffman_options));
+    copy->struct_size = sizeof(huffman_options);
+}
 
-            frequencies[(unsigned int)byte]++;         
-        }
-    }
+void huffman_stats_copy(huffman_stats* stats, const huffman_stats* copy) {
+    size_t size = stats->struct_size;
+    memcpy(stats, copy, size < sizeof(huffman_stats) ? size : sizeof(huffman_stats));
+    stats->struct_size = size;
 }
 
-static int create_lookup_recurse(huffman_node* curr_node, bitset* lookup[256], bitset* curr_path, int is_left, int depth) {
-    if(is_left) {
-        bitset_clear_bit(curr_path, depth);
-    } else {
-        bitset_set_bit(curr_path, depth);
-    }
+int huffman_encode(FILE* in, FILE* out) {
 
-    if(curr_node->is_leaf) {
-        bitset_copy_bits(curr_path, &lookup[curr_node->which_char], depth + 1);
-    } else {
-        create_lookup_recurse(curr_node->left, lookup, curr_path, 1, depth + 1);
-        create_lookup_recurse(curr_node->right, lookup, curr_path, 0, depth + 1);
-    }
+    huffman_options options;
+    huffman_options_init(&options);
 
-    return HUFFMAN_SUCCESS;
+    return huffman_encode_with_options(in, out, &options);
 }
 
-static void destroy_lookup(bitset* lookup[256]) {
-    for(int i = 0; i < 256; i++) {
-        if(lookup[i] != NULL) {
-            bitset_destroy(&lookup[i]);
-        }
-    }  
+int huffman_encode_with_options(FILE* in, FILE* out, const huffman_options* options) {
+    huffman_stats stats;
+    huffman_stats_init(&stats);
+    return huffman_encode_with_stats(in, out, options, &stats);
 }
 
-static int create_lookup(huffman_node* huffman_root, bitset* lookup[256]) {
-    bitset *curr_path;
-    int bitset_creation_status = bitset_create(&curr_path, 30);
-    if(bitset_creation_status == BITSET_ALLOC_ERROR) {
-        return HUFFMAN_ALLOC_ERROR;
-    }
-
-    int lookup_creation_status = create_lookup_recurse(huffman_root->left, lookup, curr_path, 1, 0);
-    if(lookup_creation_status != HUFFMAN_SUCCESS) {
-        bitset_destroy(&curr_path); 
-        destroy_lookup(lookup);
-        return lookup_creation_status;
-    }
-
-    lookup_creation_status = create_lookup_recurse(huffman_root->right, lookup, curr_path, 0, 0);
-    if(lookup_creation_status != HUFFMAN_SUCCESS) {
-        bitset_destroy(&curr_path); 
-        destroy_lookup(lookup);
-        return lookup_creation_status;
-    }
+int huffman_encode_with_stats(FILE* in, FILE* out, const huffman_options* options, huffman_stats* stats) {
 
-    bitset_destroy(&curr_path); 
+    huffman_options copy;
+    huffman_options_copy(&copy, options);
 
-    return HUFFMAN_SUCCESS;
+    huffman_stats result;
+    int retval = huffman_pipeline_encode(in, out, &copy, &result);
+    huffman_stats_copy(stats, &result);
+    return retval;
 }
 
-static int huffman_compress_file(FILE* in, FILE* out, huffman_node* root) {
+static int estimate(FILE* in, const huffman_options* options, huffman_stats* stats) {
 
-    int tree_serialization_status = huffman_tree_serialize(root, out);
-    if(tree_serialization_status != HUFFMAN_SUCCESS) {
-        return tree_serialization_status;
-    }
+    memset(stats, 0, sizeof(huffman_stats));
 
-    bitset* lookup[256] = { NULL };
-    int create_lookup_status = create_lookup(root, lookup);
-    if(create_lookup_status != HUFFMAN_SUCCESS) {
-        return create_lookup_status;
+    unsigned char* block = malloc(HUFFMAN_BLOCK_SIZE);
+    unsigned int (*context_frequencies)[256] = options->order1 ? malloc(sizeof(unsigned int) * 256 * 256) : NULL;
+    if(block == NULL || (options->order1 && context_frequencies == NULL)) {
+        free(block);
+        free(context_frequencies);
+        return HUFFMAN_ALLOC_ERROR;
     }
 
-    fseek(in, 0, SEEK_SET);
-    unsigned char bytes[BUFFER_SIZE];
-    unsigned char bytes_out[BUFFER_SIZE];
-    unsigned char byte_out = 0;
-    int bytes_read = 0;
-    int bytes_produced = 0;
-    int bits_written = 0;
-
-    while((bytes_read = fread(bytes, sizeof(unsigned char), BUFFER_SIZE, in)) != 0) {
-
-        for(int i = 0; i < bytes_read; i++) {
+    int retval = HUFFMAN_SUCCESS;
+    size_t size;
+    while(retval == HUFFMAN_SUCCESS && (size = fread(block, 1, HUFFMAN_BLOCK_SIZE, in)) != 0) {
+        retval = huffman_block_estimate(options, block, (unsigned int) size, context_frequencies, stats);
+    }
+    if(retval == HUFFMAN_SUCCESS && ferror(in)) {
+        retval = HUFFMAN_IO_ERROR;
+    }
 
-            unsigned char byte = bytes[i];
+    stats->output_size += HUFFMAN_STREAM_HEADER_SIZE + HUFFMAN_BLOCK_HEADER_SIZE
+                        + (options->checksum ? HUFFMAN_BLOCK_CHECKSUM_SIZE : 0);
 
-            if(lookup[byte] == NULL) {
-                return HUFFMAN_UNMAPPED_BYTE;
-            }
+    free(block);
+    free(context_frequencies);
+    return retval;
+}
 
-            unsigned char mask;
+int huffman_estimate(FILE* in, const huffman_options* options, huffman_stats* stats) {
 
-            for(int i = 0; i < lookup[byte]->total_bits; i++) {
-                unsigned int bit;
-                bitset_get_bit(lookup[byte], i, &bit);
+    huffman_options copy;
+    huffman_options_copy(&copy, options);
 
-                mask = bit << (8 - bits_written - 1);
-                bits_written++;
+    huffman_stats result;
+    int retval = estimate(in, &copy, &result);
+    huffman_stats_copy(stats, &result);
+    return retval;
+}
 
-                byte_out |= mask;
+/**
+ * Files written before the block format was introduced hold a single huffman
+ * tree followed by the whole file's code, they are told apart from the block
+ * format by the stream header and decoded by huffman_legacy_decode.
+ */
+int huffman_decode(FILE* in, FILE* out) {
 
-                if(bits_written >= 8) {
-                    bytes_out[bytes_produced] = byte_out;
-                    bytes_produced++;
+    huffman_options options;
+    huffman_options_init(&options);
 
-                    if(bytes_produced >= BUFFER_SIZE) {
-                        fwrite(bytes_out, sizeof(unsigned char), BUFFER_SIZE, out);
-                        bytes_produced = 0; 
-                    }
+    return huffman_decode_with_options(in, out, &options);
+}
 
-                    bits_written = 0;
-                    byte_out = 0;
-                }
-            }
-        }
-    }
+int huffman_decode_with_options(FILE* in, FILE* out, const huffman_options* options) {
 
-    if(bits_written != 0) {
-        bytes_out[bytes_produced] = byte_out;
-        bytes_produced++;
-    }
+    huffman_options copy;
+    huffman_options_copy(&copy, options);
+    options = &copy;
 
-    if(bytes_produced > 0) {
-        fwrite(bytes_out, sizeof(unsigned char), bytes_produced, out);
+    unsigned char stream_header[HUFFMAN_STREAM_HEADER_SIZE];
+    size_t header_size = fread(stream_header, 1, HUFFMAN_STREAM_HEADER_SIZE, in);
+    if(header_size != HUFFMAN_STREAM_HEADER_SIZE || !huffman_stream_header_check(stream_header)) {
+        return huffman_legacy_decode(in, out, options, NULL);
     }
 
-    destroy_lookup(lookup);
-
-    return HUFFMAN_SUCCESS;
+    return huffman_pipeline_decode(in, out, options, huffman_stream_header_block_size(stream_header));
 }
 
+int huffman_decode_stream(FILE* in, FILE* out) {
 
-static int huffman_decompress_file(FILE* in, FILE* out) {
-
-    fseek(in, 0, SEEK_SET);
-
-    huffman_node* huffman_root;
-    int deserialization_status = huffman_tree_deserialize(&huffman_root, in);
-    if(deserialization_status != HUFFMAN_SUCCESS) {
-        return deserialization_status;        
-    } 
-
-    unsigned char bytes[BUFFER_SIZE];
-    unsigned char bytes_out[BUFFER_SIZE];
-    int bits_read = 0;
-    int bytes_read = 0;
-    int bytes_produced = 0;
-
-    huffman_node* curr = huffman_root;
-    while((bytes_read = fread(bytes, sizeof(unsigned char), BUFFER_SIZE, in)) != 0) {
-        
-        for(int i = 0; i < bytes_read; i++) {
-            
-            unsigned char byte = bytes[i];
-
-            bits_read = 0;
-            while(bits_read < 8) {
-
-                if(curr->is_leaf) {
-                    bytes_out[bytes_produced] = curr->which_char;
-                    bytes_produced++;
-
-                    if(bytes_produced >= BUFFER_SIZE) {
-                        fwrite(bytes_out, sizeof(unsigned char), BUFFER_SIZE, out);
-                        bytes_produced = 0;
-                    }
-
-                    curr = huffman_root;
-                } else {
-                    int mask = 1 << (8 - bits_read - 1);
-                    int bit = (byte & mask) != 0; 
-                    if(bit == 0) {
-                        curr = curr->left;
-                    } else {
-                        curr = curr->right;
-                    }
-                    bits_read++;
-                }
-            } 
-        }
+    unsigned char stream_header[HUFFMAN_STREAM_HEADER_SIZE];
+    if(fread(stream_header, 1, HUFFMAN_STREAM_HEADER_SIZE, in) != HUFFMAN_STREAM_HEADER_SIZE
+    || !huffman_stream_header_check(stream_header)) {
+        return HUFFMAN_ENCODING_ERROR;
     }
 
-    if(bytes_produced > 0) {
-        fwrite(bytes_out, sizeof(unsigned char), bytes_produced, out);
-    }
+    huffman_options options;
+    huffman_options_init(&options);
 
-    huffman_tree_destroy(&huffman_root);
-    return HUFFMAN_SUCCESS;
+    return huffman_pipeline_decode(in, out, &options, huffman_stream_header_block_size(stream_header));
 }
 
-int huffman_encode(FILE* in, FILE* out) {
-    
-    unsigned int frequencies[256];
-    count_frequencies(in, frequencies);
-    fseek(in, 0, SEEK_SET);
-
-    huffman_node* root;
-    int retval = huffman_tree_create(&root, frequencies);
-    if(retval != HUFFMAN_SUCCESS) {
-        return retval;
-    }
-
-    int compression_status = huffman_compress_file(in, out, root);
-
-    huffman_tree_destroy(&root);
-    
-    return compression_status;
+int huffman_version() {
+    return HUFFMAN_VERSION;
 }
 
-int huffman_decode(FILE* in, FILE* out) {
-    
-    int decompression_status = huffman_decompress_file(in, out);
-
-    return decompression_status;
-}
\ No newline at end of file
+const char* huffman_error_string(int status) {
+    switch(status) {
+        case HUFFMAN_SUCCESS:
+            return "success";
+        case HUFFMAN_ALLOC_ERROR:
+            return "out of memory";
+        case HUFFMAN_ENCODING_ERROR:
+            return "corrupt or unsupported input";
+        case HUFFMAN_TREE_EMPTY:
+            return "nothing to encode";
+        case HUFFMAN_IO_ERROR:
+            return "read or write error";
+        case HUFFMAN_CHECKSUM_ERROR:
+            return "checksum mismatch";
+        case HUFFMAN_BUFFER_ERROR:
+            return "output buffer too small";
+        case HUFFMAN_MEMORY_ERROR:
+            return "memory limit too low";
+        default:
+            return "unknown error";
+    }
+}
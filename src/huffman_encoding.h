@@ -20,25 +20,26 @@
 #ifndef HUFFMAN_ENCODING_H
 #define HUFFMAN_ENCODING_H
 
-#include <stdio.h>
+#include "huffman.h"
 
 #define HUFFMAN_UNMAPPED_BYTE -2
 
 /**
- * Encodes a file using huffman code.
- * 
- * @param in file to encode
- * @param out output file
- * @return A flag indicating if encoding was successful.
+ * Copies the options a program passed into a whole huffman_options, giving
+ * the fields its struct_size doesn't reach their defaults.
+ *
+ * @param copy(out) The options with every field set.
+ * @param options The options as the program passed them.
  */
-int huffman_encode(FILE* in, FILE* out);
+void huffman_options_copy(huffman_options* copy, const huffman_options* options);
 
 /**
- * Decodes a file using huffman code.
- * 
- * @param in file to decode
- * @param out output file
+ * Copies stats into the struct a program passed, as far as its struct_size
+ * reaches.
+ *
+ * @param stats(out) The stats as the program passed them.
+ * @param copy The stats with every field set.
  */
-int huffman_decode(FILE* in, FILE* out);
+void huffman_stats_copy(huffman_stats* stats, const huffman_stats* copy);
 
 #endif //HUFFMAN_ENCODING_H
@@ -0,0 +1,644 @@
+/**
+ * Copyright (c) 2011-2014, Vasileios Daras. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+#define _GNU_SOURCE
+
+#include "huffman_io.h"
+#include "huffman_tree.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+/* Size of the buffer bytes are copied through when the kernel can't copy them. */
+static const unsigned int COPY_BUFFER_SIZE = 1 << 16;
+
+#ifdef HAVE_IO_URING
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+/* O_DIRECT needs buffers, offsets and sizes aligned to the device's blocks. */
+#define DIRECT_ALIGNMENT 4096
+
+/**
+ * A chunk of the file. Read chunks hold length bytes from offset of which
+ * position are used, write chunks are filled up to length and then
+ * written to offset.
+ */
+typedef struct {
+    unsigned char* bytes;
+    unsigned long long offset;
+    unsigned int length;
+    unsigned int position;
+    int in_flight;
+    int result;
+} uring_chunk;
+
+struct huffman_uring_t {
+    int ring_fd;
+    int fd;
+    int old_flags;
+    int fixed;
+
+    unsigned char* sq_ring;
+    size_t sq_ring_size;
+    unsigned char* cq_ring;
+    size_t cq_ring_size;
+    struct io_uring_sqe* sqes;
+    size_t sqes_size;
+
+    unsigned int* sq_tail;
+    unsigned int* sq_mask;
+    unsigned int* sq_array;
+    unsigned int* cq_head;
+    unsigned int* cq_tail;
+    unsigned int* cq_mask;
+    struct io_uring_cqe* cqes;
+
+    uring_chunk chunks[HUFFMAN_IO_QUEUE_DEPTH];
+    int current;
+    unsigned long long next_offset;
+    unsigned long long position;
+    int error;
+};
+
+static void uring_destroy(huffman_uring** uring) {
+    huffman_uring* temp = (*uring);
+
+    if(temp->old_flags != -1) {
+        fcntl(temp->fd, F_SETFL, temp->old_flags);
+    }
+    if(temp->sqes != NULL) {
+        munmap(temp->sqes, temp->sqes_size);
+    }
+    if(temp->cq_ring != NULL) {
+        munmap(temp->cq_ring, temp->cq_ring_size);
+    }
+    if(temp->sq_ring != NULL) {
+        munmap(temp->sq_ring, temp->sq_ring_size);
+    }
+    if(temp->ring_fd >= 0) {
+        close(temp->ring_fd);
+    }
+    for(int i = 0; i < HUFFMAN_IO_QUEUE_DEPTH; i++) {
+        free(temp->chunks[i].bytes);
+    }
+
+    free(temp);
+    (*uring) = NULL;
+}
+
+/**
+ * Sets up a ring and its chunks, registering the chunks with the kernel
+ * when it allows it.
+ */
+static int uring_create(huffman_uring** uring, int fd) {
+
+    huffman_uring* retval = calloc(1, sizeof(huffman_uring));
+    if(retval == NULL) {
+        return HUFFMAN_ALLOC_ERROR;
+    }
+
+    retval->fd = fd;
+    retval->old_flags = -1;
+
+    struct iovec iovecs[HUFFMAN_IO_QUEUE_DEPTH];
+    for(int i = 0; i < HUFFMAN_IO_QUEUE_DEPTH; i++) {
+        void* bytes;
+        if(posix_memalign(&bytes, DIRECT_ALIGNMENT, HUFFMAN_IO_CHUNK_SIZE) != 0) {
+            retval->ring_fd = -1;
+            uring_destroy(&retval);
+            return HUFFMAN_ALLOC_ERROR;
+        }
+
+        retval->chunks[i].bytes = bytes;
+        iovecs[i].iov_base = bytes;
+        iovecs[i].iov_len = HUFFMAN_IO_CHUNK_SIZE;
+    }
+
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    retval->ring_fd = syscall(__NR_io_uring_setup, HUFFMAN_IO_QUEUE_DEPTH, &params);
+    if(retval->ring_fd < 0) {
+        uring_destroy(&retval);
+        return HUFFMAN_IO_ERROR;
+    }
+
+    retval->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    retval->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    retval->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+
+    void* sq_ring = mmap(NULL, retval->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                         retval->ring_fd, IORING_OFF_SQ_RING);
+    void* cq_ring = mmap(NULL, retval->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                         retval->ring_fd, IORING_OFF_CQ_RING);
+    void* sqes = mmap(NULL, retval->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      retval->ring_fd, IORING_OFF_SQES);
+    retval->sq_ring = sq_ring == MAP_FAILED ? NULL : sq_ring;
+    retval->cq_ring = cq_ring == MAP_FAILED ? NULL : cq_ring;
+    retval->sqes = sqes == MAP_FAILED ? NULL : sqes;
+    if(retval->sq_ring == NULL || retval->cq_ring == NULL || retval->sqes == NULL) {
+        uring_destroy(&retval);
+        return HUFFMAN_IO_ERROR;
+    }
+
+    retval->sq_tail = (unsigned int*) (retval->sq_ring + params.sq_off.tail);
+    retval->sq_mask = (unsigned int*) (retval->sq_ring + params.sq_off.ring_mask);
+    retval->sq_array = (unsigned int*) (retval->sq_ring + params.sq_off.array);
+    retval->cq_head = (unsigned int*) (retval->cq_ring + params.cq_off.head);
+    retval->cq_tail = (unsigned int*) (retval->cq_ring + params.cq_off.tail);
+    retval->cq_mask = (unsigned int*) (retval->cq_ring + params.cq_off.ring_mask);
+    retval->cqes = (struct io_uring_cqe*) (retval->cq_ring + params.cq_off.cqes);
+
+    /* Registration can fail on a low locked memory limit, plain requests work all the same. */
+    retval->fixed = syscall(__NR_io_uring_register, retval->ring_fd, IORING_REGISTER_BUFFERS,
+                            iovecs, HUFFMAN_IO_QUEUE_DEPTH) == 0;
+
+    (*uring) = retval;
+    return HUFFMAN_SUCCESS;
+}
+
+static int uring_submit(huffman_uring* uring, int chunk_index, int writing) {
+    uring_chunk* chunk = &uring->chunks[chunk_index];
+
+    unsigned int tail = *uring->sq_tail;
+    unsigned int index = tail & *uring->sq_mask;
+    struct io_uring_sqe* sqe = &uring->sqes[index];
+
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    if(uring->fixed) {
+        sqe->opcode = writing ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+        sqe->buf_index = chunk_index;
+    } else {
+        sqe->opcode = writing ? IORING_OP_WRITE : IORING_OP_READ;
+    }
+    sqe->fd = uring->fd;
+    sqe->off = chunk->offset;
+    sqe->addr = (unsigned long) chunk->bytes;
+    sqe->len = writing ? chunk->length : HUFFMAN_IO_CHUNK_SIZE;
+    sqe->user_data = chunk_index;
+
+    uring->sq_array[index] = index;
+    __atomic_store_n(uring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+    if(syscall(__NR_io_uring_enter, uring->ring_fd, 1, 0, 0, NULL, 0) != 1) {
+        return HUFFMAN_IO_ERROR;
+    }
+
+    chunk->in_flight = 1;
+    return HUFFMAN_SUCCESS;
+}
+
+/**
+ * Waits until a chunk's request has completed, recording the completions
+ * of other chunks that arrive first.
+ */
+static int uring_wait(huffman_uring* uring, int chunk_index) {
+
+    while(uring->chunks[chunk_index].in_flight) {
+        unsigned int head = *uring->cq_head;
+        if(head == __atomic_load_n(uring->cq_tail, __ATOMIC_ACQUIRE)) {
+            if(syscall(__NR_io_uring_enter, uring->ring_fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0) {
+                return HUFFMAN_IO_ERROR;
+            }
+            continue;
+        }
+
+        struct io_uring_cqe* cqe = &uring->cqes[head & *uring->cq_mask];
+        uring_chunk* chunk = &uring->chunks[cqe->user_data];
+        chunk->result = cqe->res;
+        chunk->in_flight = 0;
+        __atomic_store_n(uring->cq_head, head + 1, __ATOMIC_RELEASE);
+    }
+
+    return uring->chunks[chunk_index].result < 0 ? HUFFMAN_IO_ERROR : HUFFMAN_SUCCESS;
+}
+
+/**
+ * Chunks are read at aligned offsets from the block holding start on, so
+ * they can be read with O_DIRECT, which large files are.
+ */
+static int uring_start_reading(huffman_uring* uring, unsigned long long start, unsigned long long file_size) {
+
+    if(file_size >= HUFFMAN_IO_DIRECT_MIN_SIZE) {
+        int flags = fcntl(uring->fd, F_GETFL);
+        if(flags != -1 && fcntl(uring->fd, F_SETFL, flags | O_DIRECT) == 0) {
+            uring->old_flags = flags;
+        }
+    }
+
+    uring->position = start;
+    uring->next_offset = start - start % DIRECT_ALIGNMENT;
+
+    for(int i = 0; i < HUFFMAN_IO_QUEUE_DEPTH; i++) {
+        uring->chunks[i].offset = uring->next_offset;
+        uring->chunks[i].position = i == 0 ? start % DIRECT_ALIGNMENT : 0;
+        uring->next_offset += HUFFMAN_IO_CHUNK_SIZE;
+
+        if(uring_submit(uring, i, 0) != HUFFMAN_SUCCESS) {
+            return HUFFMAN_IO_ERROR;
+        }
+    }
+
+    return HUFFMAN_SUCCESS;
+}
+
+static int uring_read(huffman_uring* uring, unsigned char* buffer, unsigned int size, unsigned int* read) {
+
+    (*read) = 0;
+
+    while((*read) < size) {
+        uring_chunk* chunk = &uring->chunks[uring->current];
+        if(uring_wait(uring, uring->current) != HUFFMAN_SUCCESS) {
+            return HUFFMAN_IO_ERROR;
+        }
+
+        unsigned int length = chunk->result;
+        if(chunk->position >= length) {
+            /* A chunk that came back short holds the end of the file. */
+            if(length < HUFFMAN_IO_CHUNK_SIZE) {
+                break;
+            }
+
+            chunk->offset = uring->next_offset;
+            chunk->position = 0;
+            uring->next_offset += HUFFMAN_IO_CHUNK_SIZE;
+            if(uring_submit(uring, uring->current, 0) != HUFFMAN_SUCCESS) {
+                return HUFFMAN_IO_ERROR;
+            }
+
+            uring->current = (uring->current + 1) % HUFFMAN_IO_QUEUE_DEPTH;
+            continue;
+        }
+
+        unsigned int count = length - chunk->position;
+        if(count > size - (*read)) {
+            count = size - (*read);
+        }
+
+        memcpy(buffer + (*read), chunk->bytes + chunk->position, count);
+        chunk->position += count;
+        (*read) += count;
+        uring->position += count;
+    }
+
+    return HUFFMAN_SUCCESS;
+}
+
+/**
+ * Waits for the write of a chunk, which fails if the chunk was written short.
+ */
+static int uring_wait_write(huffman_uring* uring, int chunk_index) {
+    if(uring_wait(uring, chunk_index) != HUFFMAN_SUCCESS
+    || (unsigned int) uring->chunks[chunk_index].result != uring->chunks[chunk_index].length) {
+        return HUFFMAN_IO_ERROR;
+    }
+
+    uring->chunks[chunk_index].length = 0;
+    return HUFFMAN_SUCCESS;
+}
+
+static int uring_write(huffman_uring* uring, const unsigned char* buffer, unsigned int size) {
+
+    while(size != 0) {
+        uring_chunk* chunk = &uring->chunks[uring->current];
+        if(chunk->in_flight && uring_wait_write(uring, uring->current) != HUFFMAN_SUCCESS) {
+            return HUFFMAN_IO_ERROR;
+        }
+
+        unsigned int count = HUFFMAN_IO_CHUNK_SIZE - chunk->length;
+        if(count > size) {
+            count = size;
+        }
+
+        memcpy(chunk->bytes + chunk->length, buffer, count);
+        chunk->length += count;
+        buffer += count;
+        size -= count;
+
+        if(chunk->length == HUFFMAN_IO_CHUNK_SIZE) {
+            chunk->offset = uring->next_offset;
+            uring->next_offset += HUFFMAN_IO_CHUNK_SIZE;
+            if(uring_submit(uring, uring->current, 1) != HUFFMAN_SUCCESS) {
+                return HUFFMAN_IO_ERROR;
+            }
+
+            uring->current = (uring->current + 1) % HUFFMAN_IO_QUEUE_DEPTH;
+        }
+    }
+
+    return HUFFMAN_SUCCESS;
+}
+
+static int uring_finish_writing(huffman_uring* uring) {
+
+    uring_chunk* chunk = &uring->chunks[uring->current];
+    if(!chunk->in_flight && chunk->length != 0) {
+        chunk->offset = uring->next_offset;
+        uring->next_offset += chunk->length;
+        if(uring_submit(uring, uring->current, 1) != HUFFMAN_SUCCESS) {
+            return HUFFMAN_IO_ERROR;
+        }
+    }
+
+    int retval = HUFFMAN_SUCCESS;
+    for(int i = 0; i < HUFFMAN_IO_QUEUE_DEPTH; i++) {
+        if(uring->chunks[i].in_flight && uring_wait_write(uring, i) != HUFFMAN_SUCCESS) {
+            retval = HUFFMAN_IO_ERROR;
+        }
+    }
+
+    uring->position = uring->next_offset;
+    return retval;
+}
+
+/**
+ * Reads still in flight have to complete before their chunks are freed.
+ */
+static void uring_finish_reading(huffman_uring* uring) {
+    for(int i = 0; i < HUFFMAN_IO_QUEUE_DEPTH; i++) {
+        uring_wait(uring, i);
+    }
+}
+
+/**
+ * Switches a file to the io_uring backend if it is a regular file and a
+ * ring can be set up, leaving it on stdio otherwise.
+ */
+static int huffman_io_start_uring(huffman_io* io) {
+
+    int fd = fileno(io->fp);
+    struct stat file_stat;
+    if(fd < 0 || fstat(fd, &file_stat) != 0 || !S_ISREG(file_stat.st_mode)) {
+        return HUFFMAN_SUCCESS;
+    }
+
+    if(io->writing && fflush(io->fp) != 0) {
+        return HUFFMAN_IO_ERROR;
+    }
+
+    long start = ftell(io->fp);
+    if(start < 0 || uring_create(&io->uring, fd) != HUFFMAN_SUCCESS) {
+        return HUFFMAN_SUCCESS;
+    }
+
+    if(io->writing) {
+        io->uring->next_offset = start;
+        io->uring->position = start;
+        return HUFFMAN_SUCCESS;
+    }
+
+    if(uring_start_reading(io->uring, start, file_stat.st_size) != HUFFMAN_SUCCESS) {
+        uring_finish_reading(io->uring);
+        uring_destroy(&io->uring);
+    }
+
+    return HUFFMAN_SUCCESS;
+}
+
+#endif
+
+int huffman_io_uring_available() {
+#ifdef HAVE_IO_URING
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+int huffman_io_create(huffman_io** io, FILE* fp, int writing, int backend) {
+    huffman_io* retval = malloc(sizeof(huffman_io));
+    if(retval == NULL) {
+        (*io) = NULL;
+        return HUFFMAN_ALLOC_ERROR;
+    }
+
+    retval->fp = fp;
+    retval->writing = writing;
+    retval->uring = NULL;
+    retval->regular = 0;
+    retval->pipe = 0;
+    retval->pipe_size = 0;
+
+    retval->fd = fileno(fp);
+    struct stat file_stat;
+    if(retval->fd >= 0 && fstat(retval->fd, &file_stat) == 0) {
+        retval->regular = S_ISREG(file_stat.st_mode);
+        retval->pipe = S_ISFIFO(file_stat.st_mode);
+    }
+
+    if(writing && retval->pipe) {
+        /* A larger pipe lets whole blocks be spliced, and failing to grow it only means fewer are. */
+        fcntl(retval->fd, F_SETPIPE_SZ, HUFFMAN_IO_CHUNK_SIZE);
+        int pipe_size = fcntl(retval->fd, F_GETPIPE_SZ);
+        if(pipe_size > 0) {
+            retval->pipe_size = pipe_size;
+        } else {
+            retval->pipe = 0;
+        }
+    }
+
+#ifdef HAVE_IO_URING
+    if(backend == HUFFMAN_IO_URING) {
+        int status = huffman_io_start_uring(retval);
+        if(status != HUFFMAN_SUCCESS) {
+            free(retval);
+            (*io) = NULL;
+            return status;
+        }
+    }
+#endif
+
+    (*io) = retval;
+    return HUFFMAN_SUCCESS;
+}
+
+int huffman_io_read(huffman_io* io, unsigned char* buffer, unsigned int size, unsigned int* read) {
+#ifdef HAVE_IO_URING
+    if(io->uring != NULL) {
+        return uring_read(io->uring, buffer, size, read);
+    }
+#endif
+
+    (*read) = fread(buffer, 1, size, io->fp);
+    return (*read) < size && ferror(io->fp) ? HUFFMAN_IO_ERROR : HUFFMAN_SUCCESS;
+}
+
+int huffman_io_write(huffman_io* io, const unsigned char* buffer, unsigned int size) {
+#ifdef HAVE_IO_URING
+    if(io->uring != NULL) {
+        return uring_write(io->uring, buffer, size);
+    }
+#endif
+
+    return fwrite(buffer, 1, size, io->fp) == size ? HUFFMAN_SUCCESS : HUFFMAN_IO_ERROR;
+}
+
+int huffman_io_write_pages(huffman_io* io, const unsigned char* buffer, unsigned int size, unsigned int* hold) {
+
+    (*hold) = 0;
+    if(io->uring != NULL || !io->pipe || size < io->pipe_size) {
+        return huffman_io_write(io, buffer, size);
+    }
+
+    if(fflush(io->fp) != 0) {
+        return HUFFMAN_IO_ERROR;
+    }
+
+    struct iovec pages = { (void*) buffer, size };
+    while(pages.iov_len != 0) {
+        ssize_t spliced = vmsplice(io->fd, &pages, 1, 0);
+        if(spliced < 0 && errno == EINTR) {
+            continue;
+        }
+        if(spliced < 0 && (errno == ENOSYS || errno == EINVAL) && pages.iov_base == buffer) {
+            return huffman_io_write(io, buffer, size);
+        }
+        if(spliced <= 0) {
+            return HUFFMAN_IO_ERROR;
+        }
+
+        pages.iov_base = (unsigned char*) pages.iov_base + spliced;
+        pages.iov_len -= spliced;
+    }
+
+    (*hold) = io->pipe_size;
+    return HUFFMAN_SUCCESS;
+}
+
+int huffman_io_can_skip(huffman_io* io) {
+    return !io->writing && io->regular && io->uring == NULL;
+}
+
+int huffman_io_skip(huffman_io* io, unsigned int size, unsigned long long* offset, unsigned int* skipped) {
+
+    struct stat file_stat;
+    long position = ftell(io->fp);
+    if(position < 0 || fstat(io->fd, &file_stat) != 0) {
+        return HUFFMAN_IO_ERROR;
+    }
+
+    unsigned long long left = (unsigned long long) file_stat.st_size > (unsigned long long) position
+                            ? file_stat.st_size - position : 0;
+    (*skipped) = left < size ? (unsigned int) left : size;
+    (*offset) = position;
+
+    return fseek(io->fp, (*skipped), SEEK_CUR) == 0 ? HUFFMAN_SUCCESS : HUFFMAN_IO_ERROR;
+}
+
+/**
+ * Copies bytes through a buffer, for when the kernel can't copy them.
+ */
+static int huffman_io_copy_buffered(huffman_io* io, int fd, unsigned long long offset, unsigned int size) {
+
+    unsigned char* buffer = malloc(COPY_BUFFER_SIZE);
+    if(buffer == NULL) {
+        return HUFFMAN_ALLOC_ERROR;
+    }
+
+    int retval = HUFFMAN_SUCCESS;
+    while(size != 0 && retval == HUFFMAN_SUCCESS) {
+        ssize_t count = pread(fd, buffer, size < COPY_BUFFER_SIZE ? size : COPY_BUFFER_SIZE, offset);
+        if(count < 0 && errno == EINTR) {
+            continue;
+        }
+        if(count <= 0) {
+            retval = HUFFMAN_IO_ERROR;
+            break;
+        }
+
+        retval = huffman_io_write(io, buffer, count);
+        offset += count;
+        size -= count;
+    }
+
+    free(buffer);
+    return retval;
+}
+
+int huffman_io_copy(huffman_io* io, int fd, unsigned long long offset, unsigned int size) {
+
+    if(io->uring != NULL || io->fd < 0) {
+        return huffman_io_copy_buffered(io, fd, offset, size);
+    }
+
+    if(fflush(io->fp) != 0) {
+        return HUFFMAN_IO_ERROR;
+    }
+
+    loff_t position = offset;
+    int use_copy_range = io->regular;
+    while(size != 0) {
+        ssize_t copied = use_copy_range
+                       ? copy_file_range(fd, &position, io->fd, NULL, size, 0)
+                       : sendfile(io->fd, fd, &position, size);
+        if(copied < 0 && errno == EINTR) {
+            continue;
+        }
+        if(copied < 0 && (errno == EXDEV || errno == EINVAL || errno == ENOSYS || errno == EOPNOTSUPP)) {
+            if(use_copy_range) {
+                use_copy_range = 0;
+                continue;
+            }
+            return huffman_io_copy_buffered(io, fd, position, size);
+        }
+        if(copied <= 0) {
+            return HUFFMAN_IO_ERROR;
+        }
+
+        size -= copied;
+    }
+
+    /* The FILE keeps its own idea of where the descriptor is, which the copy moved. */
+    if(io->regular) {
+        fseek(io->fp, 0, SEEK_CUR);
+    }
+
+    return HUFFMAN_SUCCESS;
+}
+
+int huffman_io_finish(huffman_io** io) {
+    int retval = HUFFMAN_SUCCESS;
+
+#ifdef HAVE_IO_URING
+    huffman_uring* uring = (*io)->uring;
+    if(uring != NULL) {
+        if((*io)->writing) {
+            retval = uring_finish_writing(uring);
+        } else {
+            uring_finish_reading(uring);
+        }
+
+        if(fseek((*io)->fp, uring->position, SEEK_SET) != 0 && retval == HUFFMAN_SUCCESS) {
+            retval = HUFFMAN_IO_ERROR;
+        }
+        uring_destroy(&uring);
+    }
+#endif
+
+    free((*io));
+    (*io) = NULL;
+    return retval;
+}
@@ -0,0 +1,158 @@
+/**
+ * Copyright (c) 2011-2014, Vasileios Daras. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+#ifndef HUFFMAN_IO_H
+#define HUFFMAN_IO_H
+
+#include <stdio.h>
+#include "huffman.h"
+
+/* Size and number of the buffers the io_uring backend keeps in flight. */
+#define HUFFMAN_IO_CHUNK_SIZE (1 << 20)
+#define HUFFMAN_IO_QUEUE_DEPTH 4
+/* Files of at least this size are read with O_DIRECT by the io_uring backend. */
+#define HUFFMAN_IO_DIRECT_MIN_SIZE (64ULL << 20)
+
+typedef struct huffman_uring_t huffman_uring;
+
+/**
+ * Reads a file from its current position to its end, or writes a file
+ * from its current position on, through one of two backends. The stdio
+ * backend uses the FILE itself. The io_uring backend, which is only built
+ * when the system headers have io_uring, works on the file's descriptor:
+ * it reads ahead and writes behind in HUFFMAN_IO_CHUNK_SIZE chunks from
+ * buffers registered with the kernel, with HUFFMAN_IO_QUEUE_DEPTH requests
+ * in flight. It only handles regular files, and others fall back to stdio.
+ */
+typedef struct {
+    FILE* fp;
+    int writing;
+    huffman_uring* uring;
+
+    /* The file's descriptor and what kind of file it is, -1 and 0 when unknown. */
+    int fd;
+    int regular;
+    int pipe;
+    /* Capacity of the pipe written to, after asking for HUFFMAN_IO_CHUNK_SIZE. */
+    unsigned int pipe_size;
+} huffman_io;
+
+/**
+ * Tells if the io_uring backend was built in.
+ *
+ * @return 1 if HUFFMAN_IO_URING is available, 0 otherwise.
+ */
+int huffman_io_uring_available();
+
+/**
+ * Starts reading or writing a file.
+ *
+ * @param io(out) Created reader or writer is stored here. NULL if creation fails.
+ * @param fp File to read or write, which must not be used until huffman_io_finish.
+ * @param writing 1 to write the file, 0 to read it.
+ * @param backend HUFFMAN_IO_STDIO or HUFFMAN_IO_URING, which falls back to stdio when unavailable.
+ * @return A flag indicating if creation was successful.
+ */
+int huffman_io_create(huffman_io** io, FILE* fp, int writing, int backend);
+
+/**
+ * Reads the next bytes of the file.
+ *
+ * @param io The reader.
+ * @param buffer(out) Bytes read.
+ * @param size Number of bytes to read.
+ * @param read(out) Number of bytes read, less than size only at the end of the file.
+ * @return A flag indicating if reading was successful.
+ */
+int huffman_io_read(huffman_io* io, unsigned char* buffer, unsigned int size, unsigned int* read);
+
+/**
+ * Writes bytes to the file.
+ *
+ * @param io The writer.
+ * @param buffer Bytes to write.
+ * @param size Number of bytes to write.
+ * @return A flag indicating if writing was successful. Errors of the io_uring
+ *         backend may only be reported by a later call or huffman_io_finish.
+ */
+int huffman_io_write(huffman_io* io, const unsigned char* buffer, unsigned int size);
+
+/**
+ * Writes whole pages to a pipe by reference with vmsplice, so that they
+ * are not copied into the kernel. The pipe's reader sees the pages
+ * themselves, which must therefore stay unchanged until hold more bytes
+ * were written after them, when they have left the pipe. Other files, the
+ * io_uring backend and writes smaller than the pipe are written as usual
+ * and report a hold of 0. Pages spliced from the pipe to elsewhere by its
+ * reader, rather than read, are not covered by the hold.
+ *
+ * @param io The writer.
+ * @param buffer Bytes to write, best aligned to pages.
+ * @param size Number of bytes to write.
+ * @param hold(out) Number of bytes to write before the buffer may change.
+ * @return A flag indicating if writing was successful.
+ */
+int huffman_io_write_pages(huffman_io* io, const unsigned char* buffer, unsigned int size, unsigned int* hold);
+
+/**
+ * Tells if huffman_io_skip can be used, which is for regular files read
+ * through stdio. The io_uring backend has already read ahead by then.
+ *
+ * @param io The reader.
+ * @return 1 if bytes can be skipped, 0 otherwise.
+ */
+int huffman_io_can_skip(huffman_io* io);
+
+/**
+ * Moves past the next bytes of the file without reading them, so that they
+ * can be copied later with huffman_io_copy.
+ *
+ * @param io The reader.
+ * @param size Number of bytes to skip.
+ * @param offset(out) Offset in the file of the first byte skipped.
+ * @param skipped(out) Number of bytes skipped, less than size only at the end of the file.
+ * @return A flag indicating if skipping was successful.
+ */
+int huffman_io_skip(huffman_io* io, unsigned int size, unsigned long long* offset, unsigned int* skipped);
+
+/**
+ * Writes bytes taken from another file at a given offset. The kernel copies
+ * them with copy_file_range into regular files and sendfile into anything
+ * else, without them passing through user space, and they are read and
+ * written through a buffer when neither works or with the io_uring backend.
+ * The other file's position is left unchanged.
+ *
+ * @param io The writer.
+ * @param fd Descriptor of the file to copy from.
+ * @param offset Offset of the bytes in the file to copy from.
+ * @param size Number of bytes to copy, which the file must hold.
+ * @return A flag indicating if copying was successful.
+ */
+int huffman_io_copy(huffman_io* io, int fd, unsigned long long offset, unsigned int size);
+
+/**
+ * Completes all writes, leaves the file positioned right after the last
+ * byte read or written and destroys the reader or writer.
+ *
+ * @param io Reader or writer to finish, set to NULL after the call.
+ * @return A flag indicating if all writes were successful.
+ */
+int huffman_io_finish(huffman_io** io);
+
+#endif //HUFFMAN_IO_H
@@ -0,0 +1,995 @@
+/**
+ * Copyright (c) 2011-2014, Vasileios Daras. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+#include "huffman_legacy.h"
+#include "huffman_tree.h"
+#include "huffman_code.h"
+#include "bit_io.h"
+#include "thread_pool.h"
+#include "crc32c.h"
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const int BUFFER_SIZE = 2048;
+static const unsigned long long CHUNK_SIZE = 1 << 20;
+/* Number of symbols at the start of a chunk whose positions are kept to join it to the chunk before. */
+static const unsigned int SYNC_WINDOW = 1024;
+static const unsigned char INDEX_MAGIC[4] = { 'H', 'U', 'F', 'I' };
+static const unsigned char INDEX_VERSION = 1;
+/* Largest serialized tree an index is checked against. */
+static const unsigned long long MAX_TREE_SIZE = 1 << 16;
+
+/**
+ * The bitstream of a file mapped to memory, with a decode table for its
+ * tree, or no table when the tree is walked instead. Positions in it are
+ * counted in bits.
+ */
+typedef struct {
+    unsigned char* map;
+    size_t map_size;
+    unsigned long long offset;
+    huffman_node* root;
+    const unsigned char* bytes;
+    unsigned long long size;
+    unsigned long long bits;
+    huffman_decode_table* table;
+    int min_length;
+} legacy_stream;
+
+/**
+ * A chunk decoded from its start bit as if a code started there, through
+ * every code that starts before its end bit. positions holds where
+ * the first SYNC_WINDOW symbols start, next where the last symbol ends.
+ * truncated is set when the bitstream ends in the middle of a code.
+ */
+typedef struct {
+    const legacy_stream* stream;
+    unsigned long long start;
+    unsigned long long end;
+
+    unsigned char* out;
+    unsigned long long out_cap;
+    unsigned long long count;
+    unsigned long long* positions;
+    unsigned int position_count;
+    unsigned long long next;
+    int truncated;
+} legacy_chunk;
+
+/**
+ * A run of symbols between two checkpoints of an index, which end where
+ * end says unless the run is the last one.
+ */
+typedef struct {
+    const legacy_stream* stream;
+    unsigned long long start;
+    unsigned long long end;
+    int last;
+
+    unsigned char* out;
+    unsigned long long count;
+    int status;
+} legacy_segment;
+
+static int decode_sequential(huffman_node* huffman_root, FILE* in, FILE* out) {
+
+    unsigned char bytes[BUFFER_SIZE];
+    unsigned char bytes_out[BUFFER_SIZE];
+    int bits_read = 0;
+    int bytes_read = 0;
+    int bytes_produced = 0;
+
+    huffman_node* curr = huffman_root;
+    while((bytes_read = fread(bytes, sizeof(unsigned char), BUFFER_SIZE, in)) != 0) {
+        
+        for(int i = 0; i < bytes_read; i++) {
+            
+            unsigned char byte = bytes[i];
+
+            bits_read = 0;
+            while(bits_read < 8) {
+
+                if(curr->is_leaf) {
+                    bytes_out[bytes_produced] = curr->which_char;
+                    bytes_produced++;
+
+                    if(bytes_produced >= BUFFER_SIZE) {
+                        if(fwrite(bytes_out, sizeof(unsigned char), BUFFER_SIZE, out) != BUFFER_SIZE) {
+                            return HUFFMAN_IO_ERROR;
+                        }
+                        bytes_produced = 0;
+                    }
+
+                    curr = huffman_root;
+                } else {
+                    int mask = 1 << (8 - bits_read - 1);
+                    int bit = (byte & mask) != 0; 
+                    if(bit == 0) {
+                        curr = curr->left;
+                    } else {
+                        curr = curr->right;
+                    }
+                    bits_read++;
+                }
+            } 
+        }
+    }
+
+    if(ferror(in)) {
+        return HUFFMAN_IO_ERROR;
+    }
+    if(bytes_produced > 0 && fwrite(bytes_out, sizeof(unsigned char), bytes_produced, out) != (size_t) bytes_produced) {
+        return HUFFMAN_IO_ERROR;
+    }
+
+    return HUFFMAN_SUCCESS;
+}
+
+/**
+ * Maps a file to memory, its bitstream starting at the file's position,
+ * and builds a decode table for its tree. Trees with codes too long for a
+ * table are only accepted when walk is set, and are then walked.
+ *
+ * @return A flag indicating if the stream was opened.
+ */
+static int legacy_stream_open(legacy_stream* stream, huffman_node* root, FILE* in, int walk) {
+
+    unsigned int symbols[256];
+    unsigned int codes[256];
+    unsigned char lengths[256];
+    int count;
+    int max_length = huffman_tree_codes(root, HUFFMAN_CODE_MAX_LENGTH, symbols, codes, lengths, &count);
+    if(max_length > HUFFMAN_CODE_MAX_LENGTH && !walk) {
+        return HUFFMAN_ENCODING_ERROR;
+    }
+
+    struct stat info;
+    long offset = ftell(in);
+    if(offset < 0 || fstat(fileno(in), &info) != 0 || !S_ISREG(info.st_mode)
+       || (unsigned long long) info.st_size < (unsigned long long) offset) {
+        return HUFFMAN_IO_ERROR;
+    }
+
+    stream->root = root;
+    stream->table = NULL;
+    stream->min_length = 1;
+    if(max_length <= HUFFMAN_CODE_MAX_LENGTH) {
+        stream->min_length = HUFFMAN_CODE_MAX_LENGTH;
+        for(int i = 0; i < count; i++) {
+            stream->min_length = lengths[i] < stream->min_length ? lengths[i] : stream->min_length;
+        }
+        int table_bits = max_length < BIT_IO_MIN_TABLE_BITS ? BIT_IO_MIN_TABLE_BITS :
+                         max_length > BIT_IO_MAX_TABLE_BITS ? BIT_IO_MAX_TABLE_BITS : max_length;
+
+        int retval = huffman_decode_table_create_codes(&stream->table, symbols, codes, lengths, count, table_bits);
+        if(retval != HUFFMAN_SUCCESS) {
+            return retval;
+        }
+    }
+
+    stream->map_size = info.st_size;
+    stream->map = mmap(NULL, stream->map_size, PROT_READ, MAP_PRIVATE, fileno(in), 0);
+    if(stream->map == MAP_FAILED) {
+        if(stream->table != NULL) {
+            huffman_decode_table_destroy(&stream->table);
+        }
+        return HUFFMAN_IO_ERROR;
+    }
+    madvise(stream->map, stream->map_size, MADV_SEQUENTIAL);
+
+    stream->offset = offset;
+    stream->bytes = stream->map + offset;
+    stream->size = info.st_size - offset;
+    stream->bits = stream->size * 8;
+    return HUFFMAN_SUCCESS;
+}
+
+static void legacy_stream_close(legacy_stream* stream) {
+    munmap(stream->map, stream->map_size);
+    if(stream->table != NULL) {
+        huffman_decode_table_destroy(&stream->table);
+    }
+}
+
+/**
+ * Returns the bits of the stream from a position on, most significant bit
+ * first, with 0 bits past the end. At least 57 of them are valid.
+ */
+static inline uint64_t peek_bits(const legacy_stream* stream, unsigned long long bit) {
+    unsigned long long byte = bit >> 3;
+    uint64_t value = 0;
+
+    if(byte + 8 <= stream->size) {
+        for(int i = 0; i < 8; i++) {
+            value = (value << 8) | stream->bytes[byte + i];
+        }
+    } else {
+        for(int i = 0; i < 8; i++) {
+            value = (value << 8) | (byte + i < stream->size ? stream->bytes[byte + i] : 0);
+        }
+    }
+
+    return value << (bit & 7);
+}
+
+static int walk_symbol(const legacy_stream* stream, unsigned long long bit, unsigned char* symbol) {
+    huffman_node* node = stream->root;
+    int length = 0;
+
+    while(!node->is_leaf) {
+        if(bit >= stream->bits) {
+            return 0;
+        }
+        node = (stream->bytes[bit >> 3] >> (7 - (bit & 7))) & 1 ? node->right : node->left;
+        bit++;
+        length++;
+    }
+
+    (*symbol) = node->which_char;
+    return length;
+}
+
+/**
+ * Decodes the symbol whose code starts at a position.
+ *
+ * @return The length of the code, 0 when the stream ends before the code does.
+ */
+static inline int next_symbol(const legacy_stream* stream, unsigned long long bit, unsigned char* symbol) {
+    const huffman_decode_table* table = stream->table;
+    if(table == NULL) {
+        return walk_symbol(stream, bit, symbol);
+    }
+
+    uint64_t bits = peek_bits(stream, bit);
+    unsigned int entry = table->entries[bits >> (64 - table->primary_bits)];
+    if(entry & HUFFMAN_CODE_LINK) {
+        int link_bits = HUFFMAN_CODE_ENTRY_LENGTH(entry);
+        entry = table->entries[HUFFMAN_CODE_ENTRY_VALUE(entry) + ((bits << table->primary_bits) >> (64 - link_bits))];
+    }
+
+    int length = HUFFMAN_CODE_ENTRY_LENGTH(entry);
+    if(length > stream->bits - bit) {
+        return 0;
+    }
+    (*symbol) = HUFFMAN_CODE_ENTRY_VALUE(entry);
+    return length;
+}
+
+static void decode_chunk(void* data) {
+    legacy_chunk* chunk = data;
+    const legacy_stream* stream = chunk->stream;
+
+    unsigned long long bit = chunk->start;
+    unsigned long long count = 0;
+    chunk->truncated = 0;
+
+    while(bit < chunk->end) {
+        int length = next_symbol(stream, bit, &chunk->out[count]);
+        if(length == 0) {
+            chunk->truncated = 1;
+            break;
+        }
+
+        if(count < SYNC_WINDOW) {
+            chunk->positions[count] = bit;
+        }
+        count++;
+        bit += length;
+    }
+
+    chunk->count = count;
+    chunk->position_count = count < SYNC_WINDOW ? count : SYNC_WINDOW;
+    chunk->next = bit;
+}
+
+/**
+ * Joins a chunk to the ones before it. The chunk is decoded from position,
+ * where the chunk before it really ended, into overlap until a code starts
+ * where one of the chunk's own first symbols starts, after which the
+ * chunk's symbols are the same as a decoding from the start would give.
+ * Without such a position, the whole chunk is decoded into overlap.
+ *
+ * @param chunk The decoded chunk.
+ * @param position(out) Where the chunk before ended, and then where this one does.
+ * @param ended(out) Set when the bitstream ends in the middle of a code.
+ * @param overlap(out) Symbols decoded before the chunk's own are used.
+ * @param overlap_count(out) Number of symbols in overlap.
+ * @return Index of the chunk's first symbol that is used.
+ */
+static unsigned long long join_chunk(const legacy_chunk* chunk, unsigned long long* position, int* ended,
+                                     unsigned char* overlap, unsigned long long* overlap_count) {
+
+    const legacy_stream* stream = chunk->stream;
+    unsigned long long bit = (*position);
+    unsigned long long count = 0;
+    unsigned int index = 0;
+
+    while(!(*ended) && bit < chunk->end) {
+        while(index < chunk->position_count && chunk->positions[index] < bit) {
+            index++;
+        }
+        if(index < chunk->position_count && chunk->positions[index] == bit) {
+            (*overlap_count) = count;
+            (*position) = chunk->next;
+            (*ended) = chunk->truncated;
+            return index;
+        }
+
+        int length = next_symbol(stream, bit, &overlap[count]);
+        if(length == 0) {
+            (*ended) = 1;
+            break;
+        }
+        count++;
+        bit += length;
+    }
+
+    (*overlap_count) = count;
+    (*position) = bit;
+    return chunk->count;
+}
+
+static int chunk_reserve(legacy_chunk* chunk, unsigned long long symbols) {
+    if(chunk->out_cap >= symbols) {
+        return HUFFMAN_SUCCESS;
+    }
+
+    unsigned char* temp = realloc(chunk->out, symbols);
+    if(temp == NULL) {
+        return HUFFMAN_ALLOC_ERROR;
+    }
+    chunk->out = temp;
+    chunk->out_cap = symbols;
+    return HUFFMAN_SUCCESS;
+}
+
+/**
+ * Bounds threads so that the memory each one takes, and that of extra
+ * threads' worth shared by them, fits in the memory limit, keeping at
+ * least one thread.
+ */
+static int bound_threads(int threads, unsigned long long thread_memory, unsigned long long extra, size_t memory_limit) {
+    if(memory_limit == 0) {
+        return threads;
+    }
+
+    unsigned long long fitting = memory_limit / thread_memory;
+    if(fitting <= extra + 1) {
+        return 1;
+    }
+    return fitting - extra < (unsigned long long) threads ? (int) (fitting - extra) : threads;
+}
+
+/**
+ * Decodes chunks of CHUNK_SIZE bytes, the last one taking the rest of the
+ * stream, a chunk per thread at a time. The chunks of a round are then
+ * joined and written in order while the threads wait.
+ */
+static int decode_parallel(const legacy_stream* stream, FILE* out, int threads) {
+
+    thread_pool* pool;
+    if(thread_pool_create(&pool, threads) != THREAD_POOL_SUCCESS) {
+        return HUFFMAN_ALLOC_ERROR;
+    }
+
+    int retval = HUFFMAN_SUCCESS;
+    legacy_chunk* chunks = calloc(threads, sizeof(legacy_chunk));
+    legacy_chunk overlap;
+    memset(&overlap, 0, sizeof(overlap));
+    if(chunks == NULL) {
+        retval = HUFFMAN_ALLOC_ERROR;
+    }
+    for(int i = 0; retval == HUFFMAN_SUCCESS && i < threads; i++) {
+        chunks[i].stream = stream;
+        chunks[i].positions = malloc(sizeof(unsigned long long) * SYNC_WINDOW);
+        if(chunks[i].positions == NULL) {
+            retval = HUFFMAN_ALLOC_ERROR;
+        }
+    }
+
+    unsigned long long chunk_count = stream->size / CHUNK_SIZE;
+    unsigned long long position = 0;
+    int ended = 0;
+
+    for(unsigned long long first = 0; retval == HUFFMAN_SUCCESS && first < chunk_count; first += threads) {
+        int round = chunk_count - first < (unsigned long long) threads ? (int) (chunk_count - first) : threads;
+
+        int submitted = 0;
+        for(int i = 0; i < round; i++) {
+            legacy_chunk* chunk = &chunks[i];
+            chunk->start = (first + i) * CHUNK_SIZE * 8;
+            chunk->end = first + i + 1 == chunk_count ? stream->bits : chunk->start + CHUNK_SIZE * 8;
+
+            unsigned long long symbols = (chunk->end - chunk->start) / stream->min_length + 1;
+            retval = chunk_reserve(chunk, symbols);
+            if(retval == HUFFMAN_SUCCESS) {
+                retval = chunk_reserve(&overlap, symbols);
+            }
+            if(retval == HUFFMAN_SUCCESS && thread_pool_submit(pool, decode_chunk, chunk) != THREAD_POOL_SUCCESS) {
+                retval = HUFFMAN_ALLOC_ERROR;
+            }
+            if(retval != HUFFMAN_SUCCESS) {
+                break;
+            }
+            submitted++;
+        }
+        thread_pool_wait(pool);
+
+        for(int i = 0; retval == HUFFMAN_SUCCESS && i < submitted; i++) {
+            legacy_chunk* chunk = &chunks[i];
+
+            unsigned long long overlap_count;
+            unsigned long long index = join_chunk(chunk, &position, &ended, overlap.out, &overlap_count);
+            unsigned long long tail_count = chunk->count - index;
+
+            /* The code that ends the stream is never output. */
+            if(first + i + 1 == chunk_count && !ended && position == stream->bits) {
+                if(tail_count > 0) {
+                    tail_count--;
+                } else if(overlap_count > 0) {
+                    overlap_count--;
+                }
+            }
+
+            if(fwrite(overlap.out, 1, overlap_count, out) != overlap_count
+               || fwrite(chunk->out + index, 1, tail_count, out) != tail_count) {
+                retval = HUFFMAN_IO_ERROR;
+            }
+        }
+    }
+
+    thread_pool_destroy(&pool);
+    if(chunks != NULL) {
+        for(int i = 0; i < threads; i++) {
+            free(chunks[i].out);
+            free(chunks[i].positions);
+        }
+        free(chunks);
+    }
+    free(overlap.out);
+
+    return retval;
+}
+
+/**
+ * Decodes the symbols of a segment, checking that they end at the next
+ * checkpoint, which fails when the index doesn't match the file.
+ */
+static void decode_segment(void* data) {
+    legacy_segment* segment = data;
+    const legacy_stream* stream = segment->stream;
+
+    unsigned long long bit = segment->start;
+    for(unsigned long long i = 0; i < segment->count; i++) {
+        int length = next_symbol(stream, bit, &segment->out[i]);
+        if(length == 0) {
+            segment->status = HUFFMAN_ENCODING_ERROR;
+            return;
+        }
+        bit += length;
+    }
+
+    segment->status = segment->last || bit == segment->end ? HUFFMAN_SUCCESS : HUFFMAN_ENCODING_ERROR;
+}
+
+/**
+ * Decodes the segments between an index's checkpoints, grouped so that
+ * each holds about CHUNK_SIZE bytes of output, a segment per thread at a
+ * time, and writes them in order. No segment holds more than the whole
+ * output, and a segment that doesn't fit in the memory limit fails.
+ */
+static int decode_checkpoints(const legacy_stream* stream, const huffman_legacy_index* index, FILE* out, int threads,
+                              size_t memory_limit) {
+
+    if(index->count == 0) {
+        return HUFFMAN_SUCCESS;
+    }
+
+    unsigned long long group = index->interval < CHUNK_SIZE ? CHUNK_SIZE / index->interval : 1;
+    unsigned long long segment_size = group * index->interval;
+    if(segment_size > index->output_size) {
+        segment_size = index->output_size;
+    }
+    if(memory_limit != 0 && segment_size > memory_limit) {
+        return HUFFMAN_MEMORY_ERROR;
+    }
+    threads = bound_threads(threads, segment_size, 0, memory_limit);
+    unsigned long long segment_count = (index->count + group - 1) / group;
+    if(segment_count < (unsigned long long) threads) {
+        threads = (int) segment_count;
+    }
+
+    thread_pool* pool;
+    if(thread_pool_create(&pool, threads) != THREAD_POOL_SUCCESS) {
+        return HUFFMAN_ALLOC_ERROR;
+    }
+
+    int retval = HUFFMAN_SUCCESS;
+    legacy_segment* segments = calloc(threads, sizeof(legacy_segment));
+    if(segments == NULL) {
+        retval = HUFFMAN_ALLOC_ERROR;
+    }
+    for(int i = 0; retval == HUFFMAN_SUCCESS && i < threads; i++) {
+        segments[i].stream = stream;
+        segments[i].out = malloc(segment_size);
+        if(segments[i].out == NULL) {
+            retval = HUFFMAN_ALLOC_ERROR;
+        }
+    }
+
+    for(unsigned long long first = 0; retval == HUFFMAN_SUCCESS && first < segment_count; first += threads) {
+        int round = segment_count - first < (unsigned long long) threads ? (int) (segment_count - first) : threads;
+
+        int submitted = 0;
+        for(int i = 0; i < round; i++) {
+            legacy_segment* segment = &segments[i];
+            unsigned long long checkpoint = (first + i) * group;
+            unsigned long long next = checkpoint + group;
+
+            segment->start = index->checkpoints[checkpoint].bit;
+            segment->last = next >= index->count;
+            segment->end = segment->last ? 0 : index->checkpoints[next].bit;
+            segment->count = (segment->last ? index->output_size : index->checkpoints[next].offset)
+                             - index->checkpoints[checkpoint].offset;
+
+            if(thread_pool_submit(pool, decode_segment, segment) != THREAD_POOL_SUCCESS) {
+                retval = HUFFMAN_ALLOC_ERROR;
+                break;
+            }
+            submitted++;
+        }
+        thread_pool_wait(pool);
+
+        for(int i = 0; retval == HUFFMAN_SUCCESS && i < submitted; i++) {
+            retval = segments[i].status;
+            if(retval == HUFFMAN_SUCCESS && fwrite(segments[i].out, 1, segments[i].count, out) != segments[i].count) {
+                retval = HUFFMAN_IO_ERROR;
+            }
+        }
+    }
+
+    thread_pool_destroy(&pool);
+    if(segments != NULL) {
+        for(int i = 0; i < threads; i++) {
+            free(segments[i].out);
+        }
+        free(segments);
+    }
+
+    return retval;
+}
+
+/**
+ * Reads the tree at the start of a file, leaving the file at the start of
+ * its bitstream. A tree that is a single leaf is rejected, as it would
+ * decode every bit to no end.
+ */
+static int read_tree(FILE* in, huffman_node** root) {
+
+    if(fseek(in, 0, SEEK_SET) != 0) {
+        return HUFFMAN_IO_ERROR;
+    }
+
+    int retval = huffman_tree_deserialize(root, in);
+    if(retval != HUFFMAN_SUCCESS) {
+        return retval;
+    }
+    if((*root)->is_leaf) {
+        huffman_tree_destroy(root);
+        return HUFFMAN_ENCODING_ERROR;
+    }
+
+    return HUFFMAN_SUCCESS;
+}
+
+/**
+ * Opens the stream of a file an index was built from.
+ */
+static int open_indexed(FILE* in, const huffman_legacy_index* index, huffman_node** root, legacy_stream* stream) {
+
+    int retval = huffman_legacy_index_check(index, in);
+    if(retval != HUFFMAN_SUCCESS) {
+        return retval;
+    }
+
+    retval = read_tree(in, root);
+    if(retval != HUFFMAN_SUCCESS) {
+        return retval;
+    }
+
+    retval = legacy_stream_open(stream, (*root), in, 1);
+    if(retval == HUFFMAN_SUCCESS && stream->offset != index->stream_offset) {
+        legacy_stream_close(stream);
+        retval = HUFFMAN_ENCODING_ERROR;
+    }
+    if(retval != HUFFMAN_SUCCESS) {
+        huffman_tree_destroy(root);
+    }
+    return retval;
+}
+
+/**
+ * The tree is validated before anything is written, so that input which
+ * isn't a compressed file fails without output. A chunk holds a symbol for
+ * every code that fits in its bytes, up to twice CHUNK_SIZE.
+ */
+int huffman_legacy_decode(FILE* in, FILE* out, const huffman_options* options, const huffman_legacy_index* index) {
+
+    huffman_node* huffman_root;
+    legacy_stream stream;
+    int threads = options->threads;
+    int retval;
+
+    if(index != NULL) {
+        retval = open_indexed(in, index, &huffman_root, &stream);
+        if(retval == HUFFMAN_SUCCESS) {
+            retval = decode_checkpoints(&stream, index, out, threads, options->memory_limit);
+            legacy_stream_close(&stream);
+            huffman_tree_destroy(&huffman_root);
+        }
+        return retval;
+    }
+
+    retval = read_tree(in, &huffman_root);
+    if(retval != HUFFMAN_SUCCESS) {
+        return retval;
+    }
+
+    if(threads > 1 && legacy_stream_open(&stream, huffman_root, in, 0) == HUFFMAN_SUCCESS) {
+        /* One more chunk holds the symbols decoded again to join chunks. */
+        unsigned long long chunk_memory = 2 * CHUNK_SIZE * 8 / stream.min_length + sizeof(unsigned long long) * SYNC_WINDOW;
+        threads = bound_threads(threads, chunk_memory, 1, options->memory_limit);
+        if(threads > 1 && stream.size >= 2 * CHUNK_SIZE) {
+            retval = decode_parallel(&stream, out, threads);
+            legacy_stream_close(&stream);
+            huffman_tree_destroy(&huffman_root);
+            return retval;
+        }
+        legacy_stream_close(&stream);
+    }
+
+    retval = decode_sequential(huffman_root, in, out);
+    huffman_tree_destroy(&huffman_root);
+    return retval;
+}
+
+int huffman_legacy_decode_range(FILE* in, const huffman_legacy_index* index, unsigned long long offset,
+                                unsigned long long size, FILE* out) {
+
+    if(offset >= index->output_size) {
+        return HUFFMAN_SUCCESS;
+    }
+    if(size > index->output_size - offset) {
+        size = index->output_size - offset;
+    }
+
+    huffman_node* huffman_root;
+    legacy_stream stream;
+    int retval = open_indexed(in, index, &huffman_root, &stream);
+    if(retval != HUFFMAN_SUCCESS) {
+        return retval;
+    }
+
+    const huffman_legacy_checkpoint* checkpoint = &index->checkpoints[offset / index->interval];
+    unsigned long long bit = checkpoint->bit;
+    unsigned long long skip = offset - checkpoint->offset;
+
+    unsigned char bytes_out[BUFFER_SIZE];
+    unsigned int bytes_produced = 0;
+    for(unsigned long long i = 0; i < skip + size; i++) {
+        int length = next_symbol(&stream, bit, &bytes_out[bytes_produced]);
+        if(length == 0) {
+            retval = HUFFMAN_ENCODING_ERROR;
+            break;
+        }
+        bit += length;
+
+        if(i >= skip) {
+            bytes_produced++;
+            if(bytes_produced == BUFFER_SIZE) {
+                if(fwrite(bytes_out, 1, BUFFER_SIZE, out) != BUFFER_SIZE) {
+                    retval = HUFFMAN_IO_ERROR;
+                    break;
+                }
+                bytes_produced = 0;
+            }
+        }
+    }
+
+    if(retval == HUFFMAN_SUCCESS && fwrite(bytes_out, 1, bytes_produced, out) != bytes_produced) {
+        retval = HUFFMAN_IO_ERROR;
+    }
+
+    legacy_stream_close(&stream);
+    huffman_tree_destroy(&huffman_root);
+    return retval;
+}
+
+static void write_u32(unsigned char* buffer, unsigned int value) {
+    for(int i = 0; i < 4; i++) {
+        buffer[i] = (value >> (8 * i)) & 0xFF;
+    }
+}
+
+static unsigned int read_u32(const unsigned char* buffer) {
+    unsigned int value = 0;
+    for(int i = 3; i >= 0; i--) {
+        value = (value << 8) | buffer[i];
+    }
+    return value;
+}
+
+static void write_u64(unsigned char* buffer, unsigned long long value) {
+    for(int i = 0; i < 8; i++) {
+        buffer[i] = (value >> (8 * i)) & 0xFF;
+    }
+}
+
+static unsigned long long read_u64(const unsigned char* buffer) {
+    unsigned long long value = 0;
+    for(int i = 7; i >= 0; i--) {
+        value = (value << 8) | buffer[i];
+    }
+    return value;
+}
+
+static int index_create(huffman_legacy_index** index, unsigned long long count) {
+    (*index) = malloc(sizeof(huffman_legacy_index));
+    if((*index) == NULL) {
+        return HUFFMAN_ALLOC_ERROR;
+    }
+
+    (*index)->count = count;
+    (*index)->checkpoints = NULL;
+    if(count <= SIZE_MAX / sizeof(huffman_legacy_checkpoint)) {
+        (*index)->checkpoints = malloc(sizeof(huffman_legacy_checkpoint) * (count == 0 ? 1 : count));
+    }
+    if((*index)->checkpoints == NULL) {
+        free((*index));
+        (*index) = NULL;
+        return HUFFMAN_ALLOC_ERROR;
+    }
+
+    return HUFFMAN_SUCCESS;
+}
+
+void huffman_legacy_index_destroy(huffman_legacy_index** index) {
+    free((*index)->checkpoints);
+    free((*index));
+    (*index) = NULL;
+}
+
+/**
+ * Checkpoints are taken at the start of every interval-th symbol. The last
+ * symbol counted is dropped when its code ends the stream, as it is never
+ * output, along with a checkpoint taken at its start.
+ */
+int huffman_legacy_index_build(huffman_legacy_index** index, FILE* in, unsigned int interval) {
+
+    (*index) = NULL;
+    if(interval == 0 || interval > HUFFMAN_LEGACY_INDEX_MAX_INTERVAL) {
+        return HUFFMAN_ENCODING_ERROR;
+    }
+
+    huffman_node* huffman_root;
+    int retval = read_tree(in, &huffman_root);
+    if(retval != HUFFMAN_SUCCESS) {
+        return retval;
+    }
+
+    legacy_stream stream;
+    retval = legacy_stream_open(&stream, huffman_root, in, 1);
+    if(retval != HUFFMAN_SUCCESS) {
+        huffman_tree_destroy(&huffman_root);
+        return retval;
+    }
+
+    unsigned long long capacity = 64;
+    huffman_legacy_index* retval_index;
+    retval = index_create(&retval_index, capacity);
+
+    if(retval == HUFFMAN_SUCCESS) {
+        unsigned long long bit = 0;
+        unsigned long long count = 0;
+        unsigned long long checkpoint_count = 0;
+        int length = 0;
+
+        while(bit < stream.bits) {
+            if(count % interval == 0) {
+                if(checkpoint_count == capacity) {
+                    huffman_legacy_checkpoint* temp = realloc(retval_index->checkpoints,
+                                                              sizeof(huffman_legacy_checkpoint) * capacity * 2);
+                    if(temp == NULL) {
+                        retval = HUFFMAN_ALLOC_ERROR;
+                        break;
+                    }
+                    retval_index->checkpoints = temp;
+                    capacity *= 2;
+                }
+                retval_index->checkpoints[checkpoint_count].offset = count;
+                retval_index->checkpoints[checkpoint_count].bit = bit;
+                checkpoint_count++;
+            }
+
+            unsigned char symbol;
+            length = next_symbol(&stream, bit, &symbol);
+            if(length == 0) {
+                break;
+            }
+            count++;
+            bit += length;
+        }
+
+        if(retval == HUFFMAN_SUCCESS && length != 0) {
+            count--;
+            if(checkpoint_count > 0 && retval_index->checkpoints[checkpoint_count - 1].offset == count) {
+                checkpoint_count--;
+            }
+        }
+
+        retval_index->input_size = stream.map_size;
+        retval_index->stream_offset = stream.offset;
+        retval_index->tree_checksum = crc32c_update(0, stream.map, stream.offset);
+        retval_index->interval = interval;
+        retval_index->output_size = count;
+        retval_index->count = checkpoint_count;
+        if(retval == HUFFMAN_SUCCESS) {
+            (*index) = retval_index;
+        } else {
+            huffman_legacy_index_destroy(&retval_index);
+        }
+    }
+
+    legacy_stream_close(&stream);
+    huffman_tree_destroy(&huffman_root);
+    return retval;
+}
+
+int huffman_legacy_index_write(const huffman_legacy_index* index, FILE* out) {
+
+    unsigned char header[HUFFMAN_LEGACY_INDEX_HEADER_SIZE];
+    memcpy(header, INDEX_MAGIC, 4);
+    header[4] = INDEX_VERSION;
+    write_u64(header + 5, index->input_size);
+    write_u64(header + 13, index->stream_offset);
+    write_u32(header + 21, index->tree_checksum);
+    write_u32(header + 25, index->interval);
+    write_u64(header + 29, index->output_size);
+    write_u64(header + 37, index->count);
+    if(fwrite(header, 1, HUFFMAN_LEGACY_INDEX_HEADER_SIZE, out) != HUFFMAN_LEGACY_INDEX_HEADER_SIZE) {
+        return HUFFMAN_IO_ERROR;
+    }
+
+    for(unsigned long long i = 0; i < index->count; i++) {
+        unsigned char entry[HUFFMAN_LEGACY_INDEX_ENTRY_SIZE];
+        write_u64(entry, index->checkpoints[i].offset);
+        write_u64(entry + 8, index->checkpoints[i].bit);
+        if(fwrite(entry, 1, HUFFMAN_LEGACY_INDEX_ENTRY_SIZE, out) != HUFFMAN_LEGACY_INDEX_ENTRY_SIZE) {
+            return HUFFMAN_IO_ERROR;
+        }
+    }
+
+    return HUFFMAN_SUCCESS;
+}
+
+/**
+ * Besides being in order, checkpoint i must be at offset i * interval and
+ * there must be one for every interval of the output. Every symbol takes
+ * at least a bit of the input, and the checkpoints must fit in what is left
+ * of the index file, so that a corrupt count can't make them overflow.
+ */
+int huffman_legacy_index_read(huffman_legacy_index** index, FILE* fp) {
+
+    (*index) = NULL;
+
+    unsigned char header[HUFFMAN_LEGACY_INDEX_HEADER_SIZE];
+    if(fread(header, 1, HUFFMAN_LEGACY_INDEX_HEADER_SIZE, fp) != HUFFMAN_LEGACY_INDEX_HEADER_SIZE) {
+        return ferror(fp) ? HUFFMAN_IO_ERROR : HUFFMAN_ENCODING_ERROR;
+    }
+    if(memcmp(header, INDEX_MAGIC, 4) != 0 || header[4] != INDEX_VERSION) {
+        return HUFFMAN_ENCODING_ERROR;
+    }
+
+    unsigned long long input_size = read_u64(header + 5);
+    unsigned int interval = read_u32(header + 25);
+    unsigned long long output_size = read_u64(header + 29);
+    unsigned long long count = read_u64(header + 37);
+    if(interval == 0 || interval > HUFFMAN_LEGACY_INDEX_MAX_INTERVAL
+       || input_size > ULLONG_MAX / 8 || output_size > input_size * 8
+       || count != output_size / interval + (output_size % interval != 0)) {
+        return HUFFMAN_ENCODING_ERROR;
+    }
+
+    struct stat info;
+    long position = ftell(fp);
+    if(fstat(fileno(fp), &info) == 0 && S_ISREG(info.st_mode) && position >= 0
+       && count > (unsigned long long) (info.st_size - position) / HUFFMAN_LEGACY_INDEX_ENTRY_SIZE) {
+        return HUFFMAN_ENCODING_ERROR;
+    }
+
+    huffman_legacy_index* retval_index;
+    int retval = index_create(&retval_index, count);
+    if(retval != HUFFMAN_SUCCESS) {
+        return retval;
+    }
+    retval_index->input_size = input_size;
+    retval_index->stream_offset = read_u64(header + 13);
+    retval_index->tree_checksum = read_u32(header + 21);
+    retval_index->interval = interval;
+    retval_index->output_size = output_size;
+
+    for(unsigned long long i = 0; i < count; i++) {
+        unsigned char entry[HUFFMAN_LEGACY_INDEX_ENTRY_SIZE];
+        if(fread(entry, 1, HUFFMAN_LEGACY_INDEX_ENTRY_SIZE, fp) != HUFFMAN_LEGACY_INDEX_ENTRY_SIZE) {
+            retval = ferror(fp) ? HUFFMAN_IO_ERROR : HUFFMAN_ENCODING_ERROR;
+            break;
+        }
+
+        huffman_legacy_checkpoint* checkpoint = &retval_index->checkpoints[i];
+        checkpoint->offset = read_u64(entry);
+        checkpoint->bit = read_u64(entry + 8);
+        if(checkpoint->offset != i * interval || (i > 0 && checkpoint->bit <= checkpoint[-1].bit)) {
+            retval = HUFFMAN_ENCODING_ERROR;
+            break;
+        }
+    }
+
+    if(retval != HUFFMAN_SUCCESS) {
+        huffman_legacy_index_destroy(&retval_index);
+        return retval;
+    }
+
+    (*index) = retval_index;
+    return HUFFMAN_SUCCESS;
+}
+
+int huffman_legacy_index_check(const huffman_legacy_index* index, FILE* in) {
+
+    struct stat info;
+    if(fstat(fileno(in), &info) != 0) {
+        return HUFFMAN_IO_ERROR;
+    }
+    if((unsigned long long) info.st_size != index->input_size || index->stream_offset > MAX_TREE_SIZE
+       || index->stream_offset > index->input_size) {
+        return HUFFMAN_ENCODING_ERROR;
+    }
+    if(index->count > 0 && index->checkpoints[index->count - 1].bit >= (index->input_size - index->stream_offset) * 8) {
+        return HUFFMAN_ENCODING_ERROR;
+    }
+
+    unsigned char* tree = malloc(index->stream_offset == 0 ? 1 : index->stream_offset);
+    if(tree == NULL) {
+        return HUFFMAN_ALLOC_ERROR;
+    }
+
+    int retval = HUFFMAN_SUCCESS;
+    if(pread(fileno(in), tree, index->stream_offset, 0) != (ssize_t) index->stream_offset) {
+        retval = HUFFMAN_IO_ERROR;
+    } else if(crc32c_update(0, tree, index->stream_offset) != index->tree_checksum) {
+        retval = HUFFMAN_ENCODING_ERROR;
+    }
+
+    free(tree);
+    return retval;
+}
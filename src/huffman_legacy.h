@@ -0,0 +1,152 @@
+/**
+ * Copyright (c) 2011-2014, Vasileios Daras. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+#ifndef HUFFMAN_LEGACY_H
+#define HUFFMAN_LEGACY_H
+
+#include <stdio.h>
+#include "huffman_encoding.h"
+
+#define HUFFMAN_LEGACY_INDEX_SUFFIX ".idx"
+#define HUFFMAN_LEGACY_INDEX_HEADER_SIZE 45
+#define HUFFMAN_LEGACY_INDEX_ENTRY_SIZE 16
+/* Default bytes of output between checkpoints, and the largest allowed. */
+#define HUFFMAN_LEGACY_INDEX_INTERVAL (1 << 20)
+#define HUFFMAN_LEGACY_INDEX_MAX_INTERVAL (1 << 30)
+
+/**
+ * Files written before the block format hold a serialized huffman tree
+ * followed by the code of the whole file as one bitstream, most significant
+ * bit first. A decoded byte is only output once the bit after its code is
+ * read, so a code that ends at the very end of the file is dropped, while
+ * the padding bits of the last byte decode to whatever codes they complete.
+ * Both are kept as they are, since the files already exist.
+ */
+
+/**
+ * A checkpoint of a file in the legacy format: the code of output byte
+ * offset starts at bit of the bitstream.
+ */
+typedef struct {
+    unsigned long long offset;
+    unsigned long long bit;
+} huffman_legacy_checkpoint;
+
+/**
+ * An index of a file in the legacy format, kept in a file of its own next to
+ * it, so that the file can be decoded from any checkpoint without being
+ * compressed again. The index file starts with a header holding the magic
+ * bytes HUFI, a version byte, the size of the indexed file, the offset of
+ * its bitstream, the CRC-32C of the bytes before it (the serialized tree),
+ * the interval between checkpoints, the size of the output and the number
+ * of checkpoints, and is followed by the checkpoints, all integers in
+ * little endian. Checkpoints are taken every interval bytes of output,
+ * starting at 0.
+ */
+typedef struct {
+    unsigned long long input_size;
+    unsigned long long stream_offset;
+    unsigned int tree_checksum;
+    unsigned int interval;
+    unsigned long long output_size;
+    unsigned long long count;
+    huffman_legacy_checkpoint* checkpoints;
+} huffman_legacy_index;
+
+/**
+ * Decodes a file in the legacy format once to build an index of it.
+ *
+ * @param index(out) Created index is stored here. NULL if building fails.
+ * @param in Regular file to index.
+ * @param interval Bytes of output between checkpoints, up to HUFFMAN_LEGACY_INDEX_MAX_INTERVAL.
+ * @return A flag indicating if building the index was successful.
+ */
+int huffman_legacy_index_build(huffman_legacy_index** index, FILE* in, unsigned int interval);
+
+/**
+ * Writes an index to a file.
+ *
+ * @param index The index.
+ * @param out File to write the index to.
+ * @return A flag indicating if writing was successful.
+ */
+int huffman_legacy_index_write(const huffman_legacy_index* index, FILE* out);
+
+/**
+ * Reads an index written by huffman_legacy_index_write, rejecting indexes
+ * whose checkpoints are out of order with HUFFMAN_ENCODING_ERROR.
+ *
+ * @param index(out) Read index is stored here. NULL if reading fails.
+ * @param fp File to read the index from.
+ * @return A flag indicating if reading was successful.
+ */
+int huffman_legacy_index_read(huffman_legacy_index** index, FILE* fp);
+
+/**
+ * Destroys an index.
+ *
+ * @param index Index to destroy, set to NULL after the call.
+ */
+void huffman_legacy_index_destroy(huffman_legacy_index** index);
+
+/**
+ * Checks that an index was built from a file, by its size and tree.
+ *
+ * @param index The index.
+ * @param in The file.
+ * @return A flag indicating if the index belongs to the file, HUFFMAN_ENCODING_ERROR if it doesn't.
+ */
+int huffman_legacy_index_check(const huffman_legacy_index* index, FILE* in);
+
+/**
+ * Decodes part of a file in the legacy format, starting at the checkpoint
+ * at or before offset, without decoding anything before it.
+ *
+ * @param in Regular file to decode.
+ * @param index Index of the file.
+ * @param offset Offset in the output of the first byte to decode.
+ * @param size Number of bytes to decode, fewer if the output ends before.
+ * @param out output file
+ * @return A flag indicating if decoding was successful.
+ */
+int huffman_legacy_decode_range(FILE* in, const huffman_legacy_index* index, unsigned long long offset,
+                                unsigned long long size, FILE* out);
+
+/**
+ * Decodes a file in the legacy format. With more than one thread, a regular
+ * file whose codes are at most HUFFMAN_CODE_MAX_LENGTH bits is split into
+ * chunks that are decoded at once, each from the start of its first byte
+ * as if a code started there. Codes resynchronize after a few symbols, so
+ * each chunk is joined to the one before it at the first position where
+ * both decodings start a code, after decoding the symbols before it again
+ * from where the previous chunk really ended. The output is the same as
+ * decoding the file from start to end, which is done otherwise. Given an
+ * index of the file, the file is split at its checkpoints instead, which
+ * needs no joining and works for codes of any length. With a memory limit,
+ * no more threads are used than the output decoded at once fits in.
+ *
+ * @param in file to decode
+ * @param out output file
+ * @param options options holding the number of threads to decode with and the memory limit
+ * @param index index of the file, or NULL
+ * @return A flag indicating if decoding was successful.
+ */
+int huffman_legacy_decode(FILE* in, FILE* out, const huffman_options* options, const huffman_legacy_index* index);
+
+#endif //HUFFMAN_LEGACY_H
@@ -0,0 +1,549 @@
+/**
+ * Copyright (c) 2011-2014, Vasileios Daras. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+#include "huffman_pipeline.h"
+#include "huffman_block.h"
+#include "buffer_queue.h"
+#include "huffman_io.h"
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+/**
+ * A piece of the input or output. A buffer that is skipped holds only a
+ * block's header on the input side, or nothing on the output side, and
+ * stands for size bytes left in the input file at offset, which are copied
+ * to the output by the kernel.
+ */
+typedef struct {
+    unsigned char* bytes;
+    unsigned int capacity;
+    unsigned int size;
+    int skipped;
+    unsigned long long offset;
+} pipeline_buffer;
+
+/**
+ * Fills a buffer with the next piece of the input. Returns 1 if the buffer
+ * was filled, PIPELINE_LAST if it was filled with the last piece, 0 at the
+ * end of the input or an error.
+ */
+#define PIPELINE_LAST 2
+
+typedef int (*pipeline_read_function)(huffman_io* in, pipeline_buffer* buffer);
+
+typedef struct {
+    huffman_io* in;
+    huffman_io* out;
+    pipeline_read_function read;
+
+    int buffer_count;
+    pipeline_buffer in_buffers[HUFFMAN_PIPELINE_BUFFERS];
+    pipeline_buffer out_buffers[HUFFMAN_PIPELINE_BUFFERS];
+    /* Output buffers are mapped pages, which may be spliced into a pipe. */
+    int out_pages;
+    buffer_queue* free_in;
+    buffer_queue* full_in;
+    buffer_queue* free_out;
+    buffer_queue* full_out;
+
+    pthread_t reader;
+    pthread_t writer;
+    int threads_started;
+
+    int read_status;
+    int write_status;
+} pipeline;
+
+static void* pipeline_reader(void* data) {
+    pipeline* p = (pipeline*) data;
+
+    void* item;
+    while(buffer_queue_pop(p->free_in, &item)) {
+        int retval = p->read(p->in, (pipeline_buffer*) item);
+        if(retval == 1 || retval == PIPELINE_LAST) {
+            buffer_queue_push(p->full_in, item);
+        }
+        if(retval != 1) {
+            p->read_status = retval == PIPELINE_LAST ? HUFFMAN_SUCCESS : retval;
+            break;
+        }
+    }
+
+    buffer_queue_close(p->full_in);
+    return NULL;
+}
+
+static int pipeline_write(pipeline* p, pipeline_buffer* buffer, unsigned int* hold) {
+    (*hold) = 0;
+    if(buffer->skipped) {
+        return huffman_io_copy(p->out, p->in->fd, buffer->offset, buffer->size);
+    }
+    if(p->out_pages) {
+        return huffman_io_write_pages(p->out, buffer->bytes, buffer->size, hold);
+    }
+    return huffman_io_write(p->out, buffer->bytes, buffer->size);
+}
+
+/**
+ * After a failed write the remaining buffers are still taken but dropped,
+ * and the free buffers are closed so that the coding stage stops. Buffers
+ * spliced into a pipe are held back until enough was written after them
+ * for the pipe's reader to have taken them. Only buffers at least as large
+ * as the pipe are spliced, so at most one is held at a time.
+ */
+static void* pipeline_writer(void* data) {
+    pipeline* p = (pipeline*) data;
+
+    pipeline_buffer* held[HUFFMAN_PIPELINE_BUFFERS];
+    unsigned long long held_until[HUFFMAN_PIPELINE_BUFFERS];
+    int held_count = 0;
+    unsigned long long written = 0;
+
+    void* item;
+    while(buffer_queue_pop(p->full_out, &item)) {
+        pipeline_buffer* buffer = (pipeline_buffer*) item;
+
+        unsigned int hold = 0;
+        if(p->write_status == HUFFMAN_SUCCESS && pipeline_write(p, buffer, &hold) != HUFFMAN_SUCCESS) {
+            p->write_status = HUFFMAN_IO_ERROR;
+            buffer_queue_close(p->free_out);
+        }
+        written += buffer->size;
+
+        if(p->write_status != HUFFMAN_SUCCESS) {
+            continue;
+        }
+
+        int kept = 0;
+        for(int i = 0; i < held_count; i++) {
+            if(held_until[i] <= written) {
+                buffer_queue_push(p->free_out, held[i]);
+            } else {
+                held[kept] = held[i];
+                held_until[kept] = held_until[i];
+                kept++;
+            }
+        }
+        held_count = kept;
+
+        if(hold != 0) {
+            held[held_count] = buffer;
+            held_until[held_count] = written + hold;
+            held_count++;
+        } else {
+            buffer_queue_push(p->free_out, item);
+        }
+    }
+
+    return NULL;
+}
+
+static void pipeline_destroy(pipeline* p) {
+    if(p->in != NULL) {
+        huffman_io_finish(&p->in);
+    }
+    if(p->out != NULL && huffman_io_finish(&p->out) != HUFFMAN_SUCCESS && p->write_status == HUFFMAN_SUCCESS) {
+        p->write_status = HUFFMAN_IO_ERROR;
+    }
+
+    for(int i = 0; i < p->buffer_count; i++) {
+        free(p->in_buffers[i].bytes);
+        if(!p->out_pages) {
+            free(p->out_buffers[i].bytes);
+        } else if(p->out_buffers[i].bytes != NULL) {
+            /* Pages still in a pipe are kept by the kernel until they are read. */
+            munmap(p->out_buffers[i].bytes, p->out_buffers[i].capacity);
+        }
+    }
+
+    if(p->free_in != NULL) {
+        buffer_queue_destroy(&p->free_in);
+    }
+    if(p->full_in != NULL) {
+        buffer_queue_destroy(&p->full_in);
+    }
+    if(p->free_out != NULL) {
+        buffer_queue_destroy(&p->free_out);
+    }
+    if(p->full_out != NULL) {
+        buffer_queue_destroy(&p->full_out);
+    }
+}
+
+/**
+ * Output buffers of out_pages pipelines are mapped pages rather than heap
+ * memory, so that the writer can splice them.
+ */
+static int pipeline_create(pipeline* p, FILE* in, FILE* out, int io_backend, pipeline_read_function read,
+                           int buffer_count, unsigned int in_size, unsigned int out_size, int out_pages) {
+
+    memset(p, 0, sizeof(pipeline));
+    p->buffer_count = buffer_count;
+    p->read = read;
+    p->out_pages = out_pages;
+    p->read_status = HUFFMAN_SUCCESS;
+    p->write_status = HUFFMAN_SUCCESS;
+
+    int retval = huffman_io_create(&p->in, in, 0, io_backend);
+    if(retval == HUFFMAN_SUCCESS) {
+        retval = huffman_io_create(&p->out, out, 1, io_backend);
+    }
+    if(retval != HUFFMAN_SUCCESS) {
+        pipeline_destroy(p);
+        return retval;
+    }
+
+    if(buffer_queue_create(&p->free_in, buffer_count) != BUFFER_QUEUE_SUCCESS
+    || buffer_queue_create(&p->full_in, buffer_count) != BUFFER_QUEUE_SUCCESS
+    || buffer_queue_create(&p->free_out, buffer_count) != BUFFER_QUEUE_SUCCESS
+    || buffer_queue_create(&p->full_out, buffer_count) != BUFFER_QUEUE_SUCCESS) {
+        pipeline_destroy(p);
+        return HUFFMAN_ALLOC_ERROR;
+    }
+
+    for(int i = 0; i < buffer_count; i++) {
+        p->in_buffers[i].bytes = malloc(in_size);
+        p->in_buffers[i].capacity = in_size;
+        p->out_buffers[i].capacity = out_size;
+        if(out_pages) {
+            void* pages = mmap(NULL, out_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            p->out_buffers[i].bytes = pages != MAP_FAILED ? pages : NULL;
+        } else {
+            p->out_buffers[i].bytes = malloc(out_size);
+        }
+        if(p->in_buffers[i].bytes == NULL || p->out_buffers[i].bytes == NULL) {
+            pipeline_destroy(p);
+            return HUFFMAN_ALLOC_ERROR;
+        }
+
+        buffer_queue_push(p->free_in, &p->in_buffers[i]);
+        buffer_queue_push(p->free_out, &p->out_buffers[i]);
+    }
+
+    if(pthread_create(&p->reader, NULL, pipeline_reader, p) != 0) {
+        pipeline_destroy(p);
+        return HUFFMAN_ALLOC_ERROR;
+    }
+
+    if(pthread_create(&p->writer, NULL, pipeline_writer, p) != 0) {
+        buffer_queue_close(p->free_in);
+        pthread_join(p->reader, NULL);
+        pipeline_destroy(p);
+        return HUFFMAN_ALLOC_ERROR;
+    }
+
+    return HUFFMAN_SUCCESS;
+}
+
+/**
+ * Stops the pipeline once the coding stage is done, after everything it
+ * produced is written, and destroys it. Returns the coding stage's status
+ * or, if coding succeeded, the first reading or writing error.
+ */
+static int pipeline_finish(pipeline* p, int retval) {
+
+    buffer_queue_close(p->full_out);
+    pthread_join(p->writer, NULL);
+
+    buffer_queue_close(p->free_in);
+    pthread_join(p->reader, NULL);
+
+    if(retval == HUFFMAN_SUCCESS) {
+        retval = p->read_status;
+    }
+
+    pipeline_destroy(p);
+    if(retval == HUFFMAN_SUCCESS) {
+        retval = p->write_status;
+    }
+
+    return retval;
+}
+
+/**
+ * Takes a free output buffer, or fails once writing has failed.
+ */
+static int pipeline_take_output(pipeline* p, pipeline_buffer** buffer) {
+    void* item;
+    if(!buffer_queue_pop(p->free_out, &item)) {
+        return HUFFMAN_IO_ERROR;
+    }
+
+    (*buffer) = (pipeline_buffer*) item;
+    return HUFFMAN_SUCCESS;
+}
+
+static int read_block(huffman_io* in, pipeline_buffer* buffer) {
+    if(huffman_io_read(in, buffer->bytes, buffer->capacity, &buffer->size) != HUFFMAN_SUCCESS) {
+        return HUFFMAN_IO_ERROR;
+    }
+
+    return buffer->size != 0;
+}
+
+/**
+ * Reads a block's header and body. The stream's end block is the last
+ * piece of the input, and a stream cut short is an error. The bodies of
+ * stored blocks without checksums are skipped when they can be copied from
+ * the input file later.
+ */
+static int read_record(huffman_io* in, pipeline_buffer* buffer) {
+    unsigned int read;
+    if(huffman_io_read(in, buffer->bytes, HUFFMAN_BLOCK_HEADER_SIZE, &read) != HUFFMAN_SUCCESS) {
+        return HUFFMAN_IO_ERROR;
+    }
+    if(read != HUFFMAN_BLOCK_HEADER_SIZE) {
+        return HUFFMAN_ENCODING_ERROR;
+    }
+
+    huffman_block_header header;
+    int retval = huffman_block_header_read(&header, buffer->bytes);
+    if(retval != HUFFMAN_SUCCESS) {
+        return retval;
+    }
+    if(header.body_size > buffer->capacity - HUFFMAN_BLOCK_HEADER_SIZE) {
+        return HUFFMAN_ENCODING_ERROR;
+    }
+
+    buffer->size = HUFFMAN_BLOCK_HEADER_SIZE + header.body_size;
+    buffer->skipped = header.type == HUFFMAN_BLOCK_STORED
+                   && (header.flags & (HUFFMAN_BLOCK_FLAG_RLE | HUFFMAN_BLOCK_FLAG_CHECKSUM)) == 0
+                   && header.body_size == header.raw_size && huffman_io_can_skip(in);
+
+    if(buffer->skipped) {
+        if(huffman_io_skip(in, header.body_size, &buffer->offset, &read) != HUFFMAN_SUCCESS) {
+            return HUFFMAN_IO_ERROR;
+        }
+        buffer->size = HUFFMAN_BLOCK_HEADER_SIZE;
+        return read == header.body_size ? 1 : HUFFMAN_ENCODING_ERROR;
+    }
+
+    if(huffman_io_read(in, buffer->bytes + HUFFMAN_BLOCK_HEADER_SIZE, header.body_size, &read) != HUFFMAN_SUCCESS) {
+        return HUFFMAN_IO_ERROR;
+    }
+    if(read != header.body_size) {
+        return HUFFMAN_ENCODING_ERROR;
+    }
+
+    return header.type == HUFFMAN_BLOCK_END ? PIPELINE_LAST : 1;
+}
+
+/**
+ * Decoding takes at least two buffers, as the writer may hold on to one
+ * that was spliced into a pipe until the next one is written.
+ */
+static int pipeline_min_buffers(int compress) {
+    return compress ? 1 : 2;
+}
+
+/**
+ * An encoding pipeline holds an input buffer and a record per buffer, and
+ * the encoder another record which is swapped with the records handed to
+ * the writer. A decoding pipeline holds a record and an output buffer per
+ * buffer.
+ */
+static unsigned long long pipeline_memory(const huffman_options* options, int compress, unsigned int block_size, int buffers) {
+    if(compress) {
+        return buffers * ((unsigned long long) block_size + HUFFMAN_RECORD_SIZE(block_size))
+             + huffman_block_encoder_memory(options, block_size);
+    }
+
+    return buffers * ((unsigned long long) HUFFMAN_RECORD_SIZE(block_size) + block_size) + huffman_block_decoder_memory(block_size);
+}
+
+int huffman_pipeline_plan_memory(const huffman_options* options, int compress, unsigned int block_size,
+                                 huffman_pipeline_plan* plan) {
+
+    plan->block_size = block_size;
+    plan->buffers = HUFFMAN_PIPELINE_BUFFERS;
+    plan->memory = pipeline_memory(options, compress, plan->block_size, plan->buffers);
+
+    if(options->memory_limit == 0) {
+        return HUFFMAN_SUCCESS;
+    }
+
+    while(plan->memory > options->memory_limit
+          || (compress && pipeline_memory(options, 0, plan->block_size, pipeline_min_buffers(0)) > options->memory_limit)) {
+        if(plan->memory > options->memory_limit && plan->buffers > pipeline_min_buffers(compress)) {
+            plan->buffers--;
+        } else if(compress && plan->block_size > HUFFMAN_MIN_BLOCK_SIZE) {
+            plan->block_size /= 2;
+        } else {
+            return HUFFMAN_MEMORY_ERROR;
+        }
+        plan->memory = pipeline_memory(options, compress, plan->block_size, plan->buffers);
+    }
+
+    return HUFFMAN_SUCCESS;
+}
+
+/**
+ * Encoding also needs the stream's blocks to fit when it is decoded.
+ */
+static unsigned long long pipeline_min_memory(const huffman_options* options, int compress, unsigned int block_size) {
+    unsigned long long memory = pipeline_memory(options, compress, block_size, pipeline_min_buffers(compress));
+    unsigned long long decode_memory = pipeline_memory(options, 0, block_size, pipeline_min_buffers(0));
+    return compress && decode_memory > memory ? decode_memory : memory;
+}
+
+unsigned long long huffman_pipeline_min_memory(const huffman_options* options, int compress) {
+
+    unsigned int block_size = HUFFMAN_BLOCK_SIZE;
+    while(block_size > HUFFMAN_MIN_BLOCK_SIZE && options->memory_limit != 0
+          && pipeline_min_memory(options, compress, block_size) > options->memory_limit) {
+        block_size /= 2;
+    }
+
+    return pipeline_min_memory(options, compress, block_size);
+}
+
+int huffman_pipeline_encode(FILE* in, FILE* out, const huffman_options* options, huffman_stats* stats) {
+
+    memset(stats, 0, sizeof(huffman_stats));
+
+    huffman_pipeline_plan plan;
+    int retval = huffman_pipeline_plan_memory(options, 1, HUFFMAN_BLOCK_SIZE, &plan);
+    if(retval != HUFFMAN_SUCCESS) {
+        return retval;
+    }
+
+    unsigned char stream_header[HUFFMAN_STREAM_HEADER_SIZE];
+    huffman_stream_header_write(stream_header, plan.block_size);
+    if(fwrite(stream_header, 1, HUFFMAN_STREAM_HEADER_SIZE, out) != HUFFMAN_STREAM_HEADER_SIZE) {
+        return HUFFMAN_IO_ERROR;
+    }
+
+    huffman_block_encoder* encoder;
+    retval = huffman_block_encoder_create(&encoder, options, plan.block_size);
+    if(retval != HUFFMAN_SUCCESS) {
+        return retval;
+    }
+
+    pipeline p;
+    retval = pipeline_create(&p, in, out, options->io, read_block, plan.buffers, plan.block_size,
+                             HUFFMAN_RECORD_SIZE(plan.block_size), 0);
+    if(retval != HUFFMAN_SUCCESS) {
+        huffman_block_encoder_destroy(&encoder);
+        return retval;
+    }
+
+    pipeline_buffer* out_buffer;
+    void* item;
+    while(buffer_queue_pop(p.full_in, &item)) {
+        pipeline_buffer* in_buffer = (pipeline_buffer*) item;
+
+        unsigned char* record;
+        unsigned int record_size;
+        retval = huffman_block_encode(encoder, in_buffer->bytes, in_buffer->size, &record, &record_size);
+        if(retval == HUFFMAN_SUCCESS) {
+            retval = pipeline_take_output(&p, &out_buffer);
+        }
+        if(retval != HUFFMAN_SUCCESS) {
+            break;
+        }
+
+        /* The record is handed to the writer as it is and the encoder gets the free buffer instead. */
+        out_buffer->bytes = huffman_block_encoder_swap_record(encoder, out_buffer->bytes);
+        out_buffer->size = record_size;
+        buffer_queue_push(p.full_out, out_buffer);
+        buffer_queue_push(p.free_in, in_buffer);
+    }
+
+    if(retval == HUFFMAN_SUCCESS) {
+        retval = p.read_status;
+    }
+
+    if(retval == HUFFMAN_SUCCESS) {
+        retval = pipeline_take_output(&p, &out_buffer);
+        if(retval == HUFFMAN_SUCCESS) {
+            out_buffer->size = huffman_block_encoder_end(encoder, out_buffer->bytes);
+            buffer_queue_push(p.full_out, out_buffer);
+        }
+    }
+
+    retval = pipeline_finish(&p, retval);
+
+    (*stats) = encoder->stats;
+    stats->output_size += HUFFMAN_STREAM_HEADER_SIZE;
+    stats->planned_memory = plan.memory;
+    huffman_block_encoder_destroy(&encoder);
+    return retval;
+}
+
+int huffman_pipeline_decode(FILE* in, FILE* out, const huffman_options* options, unsigned int block_size) {
+
+    huffman_pipeline_plan plan;
+    int retval = huffman_pipeline_plan_memory(options, 0, block_size, &plan);
+    if(retval != HUFFMAN_SUCCESS) {
+        return retval;
+    }
+
+    huffman_block_decoder* decoder;
+    retval = huffman_block_decoder_create(&decoder);
+    if(retval != HUFFMAN_SUCCESS) {
+        return retval;
+    }
+    decoder->verify = options->verify;
+    decoder->block_size = plan.block_size;
+
+    pipeline p;
+    retval = pipeline_create(&p, in, out, options->io, read_record, plan.buffers, HUFFMAN_RECORD_SIZE(plan.block_size),
+                             plan.block_size, 1);
+    if(retval != HUFFMAN_SUCCESS) {
+        huffman_block_decoder_destroy(&decoder);
+        return retval;
+    }
+
+    void* item;
+    while(buffer_queue_pop(p.full_in, &item)) {
+        pipeline_buffer* in_buffer = (pipeline_buffer*) item;
+
+        huffman_block_header header;
+        huffman_block_header_read(&header, in_buffer->bytes);
+
+        if(header.type == HUFFMAN_BLOCK_END) {
+            retval = huffman_block_decoder_end(decoder, &header, in_buffer->bytes + HUFFMAN_BLOCK_HEADER_SIZE);
+            buffer_queue_push(p.free_in, in_buffer);
+            break;
+        }
+
+        pipeline_buffer* out_buffer;
+        retval = pipeline_take_output(&p, &out_buffer);
+        if(retval == HUFFMAN_SUCCESS) {
+            out_buffer->skipped = in_buffer->skipped;
+            out_buffer->offset = in_buffer->offset;
+            if(!in_buffer->skipped) {
+                retval = huffman_block_decode(decoder, &header, in_buffer->bytes + HUFFMAN_BLOCK_HEADER_SIZE, out_buffer->bytes);
+            }
+        }
+        if(retval != HUFFMAN_SUCCESS) {
+            break;
+        }
+
+        out_buffer->size = header.raw_size;
+        buffer_queue_push(p.full_out, out_buffer);
+        buffer_queue_push(p.free_in, in_buffer);
+    }
+
+    retval = pipeline_finish(&p, retval);
+
+    huffman_block_decoder_destroy(&decoder);
+    return retval;
+}
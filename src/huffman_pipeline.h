@@ -0,0 +1,103 @@
+/**
+ * Copyright (c) 2011-2014, Vasileios Daras. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+#ifndef HUFFMAN_PIPELINE_H
+#define HUFFMAN_PIPELINE_H
+
+#include <stdio.h>
+#include "huffman_encoding.h"
+
+/* Most buffers rotating between each pair of pipeline stages. */
+#define HUFFMAN_PIPELINE_BUFFERS 3
+
+/**
+ * Encoding and decoding run as a pipeline of three stages: a reader thread
+ * fills input buffers, the calling thread codes them into output buffers
+ * and a writer thread writes those out, so reading and writing overlap with
+ * coding. Each stage hands its buffers to the next one and gets them back
+ * once they have been used, so no memory is allocated after the start.
+ * The reader and writer go through huffman_io with the options' backend.
+ */
+
+/**
+ * How a file is coded through the pipeline: the size of the blocks it is
+ * encoded in, the number of buffers rotating between each pair of stages
+ * and the memory those buffers and the encoder's or decoder's take.
+ */
+typedef struct {
+    unsigned int block_size;
+    int buffers;
+    unsigned long long memory;
+} huffman_pipeline_plan;
+
+/**
+ * Plans how a file is coded within the options' memory limit. Fewer
+ * buffers are tried first, since that leaves the output unchanged, and
+ * then smaller blocks for encoding, down to HUFFMAN_MIN_BLOCK_SIZE. Blocks
+ * are also made small enough to decode within the limit. Decoding takes
+ * buffers for the blocks of the stream.
+ *
+ * @param options options to code the file with
+ * @param compress 1 to plan encoding, 0 to plan decoding
+ * @param block_size size of the largest blocks, those of the stream when decoding
+ * @param plan(out) the plan is stored in here
+ * @return HUFFMAN_MEMORY_ERROR if no plan fits in the memory limit.
+ */
+int huffman_pipeline_plan_memory(const huffman_options* options, int compress, unsigned int block_size,
+                                 huffman_pipeline_plan* plan);
+
+/**
+ * Computes the least memory coding a file through the pipeline takes with
+ * the blocks the options' memory limit allows. Any share of the limit at
+ * least that large is planned with the same blocks, so files coded side by
+ * side are split into blocks as they would be one at a time. Decoding is
+ * planned for the largest blocks a stream may have within the limit.
+ * Without a plan within the limit, the result exceeds it.
+ *
+ * @param options options to code the file with
+ * @param compress 1 for encoding, 0 for decoding
+ * @return Number of bytes.
+ */
+unsigned long long huffman_pipeline_min_memory(const huffman_options* options, int compress);
+
+/**
+ * Encodes a stream through the pipeline, starting with its header, which
+ * records the size of the blocks the memory limit allows.
+ *
+ * @param in file to encode
+ * @param out output file
+ * @param options options to encode the file with
+ * @param stats(out) counts gathered while encoding the file
+ * @return A flag indicating if encoding was successful.
+ */
+int huffman_pipeline_encode(FILE* in, FILE* out, const huffman_options* options, huffman_stats* stats);
+
+/**
+ * Decodes the blocks of a stream through the pipeline, after the stream
+ * header is read. The file is left right after the stream's end block.
+ *
+ * @param in file to decode
+ * @param out output file
+ * @param options options holding the I/O backend to use
+ * @param block_size size of the stream's largest blocks, from its header
+ * @return A flag indicating if decoding was successful.
+ */
+int huffman_pipeline_decode(FILE* in, FILE* out, const huffman_options* options, unsigned int block_size);
+
+#endif //HUFFMAN_PIPELINE_H
@@ -0,0 +1,666 @@
+/**
+ * Copyright (c) 2011-2014, Vasileios Daras. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+#define _GNU_SOURCE
+
+#include "huffman_server.h"
+#include "huffman_block.h"
+#include "thread_pool.h"
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+static const unsigned int MAX_EVENTS = 64;
+static const unsigned int WARM_UP_SIZE = 1 << 16;
+/* How long a response waits for a client that stopped reading. */
+static const int SEND_TIMEOUT = 30000;
+/* First buffer a request is read into, doubled as more of it arrives. */
+static const unsigned int RECEIVE_SIZE = 1 << 16;
+/* Bytes held for requests and responses when no memory limit is given. */
+static const unsigned long long DEFAULT_MEMORY = 1ULL << 30;
+
+typedef struct server_connection_t server_connection;
+
+typedef struct {
+    huffman_options options;
+    int listen_fd;
+    int signal_fd;
+    int epoll_fd;
+    thread_pool* pool;
+    pthread_key_t context_key;
+
+    pthread_cond_t warmed_up;
+    int warm_up_threads;
+    int warm_up_arrived;
+    int warm_up_status;
+    int bound;
+
+    pthread_mutex_t lock;
+    server_connection* connections;
+    /* Bytes of request and response buffers, bounded by memory_cap. */
+    unsigned long long memory_used;
+    unsigned long long memory_cap;
+} huffman_server;
+
+/**
+ * A client connection. Until a whole request is read, the connection
+ * belongs to the thread running epoll; it then belongs to the thread
+ * serving the request until the response is sent and the connection is
+ * watched again. Its socket is watched with EPOLLONESHOT so that only one
+ * of them handles it at a time.
+ */
+struct server_connection_t {
+    int fd;
+    huffman_server* server;
+
+    unsigned char header[HUFFMAN_SERVER_HEADER_SIZE];
+    unsigned int header_fill;
+    unsigned char operation;
+    unsigned int size;
+    unsigned char* payload;
+    unsigned int payload_cap;
+    unsigned int payload_fill;
+    int status;
+
+    server_connection* previous;
+    server_connection* next;
+};
+
+static void write_u32(unsigned char* buffer, unsigned int value) {
+    buffer[0] = value & 0xFF;
+    buffer[1] = (value >> 8) & 0xFF;
+    buffer[2] = (value >> 16) & 0xFF;
+    buffer[3] = (value >> 24) & 0xFF;
+}
+
+static unsigned int read_u32(const unsigned char* buffer) {
+    return buffer[0] | (buffer[1] << 8) | (buffer[2] << 16) | ((unsigned int) buffer[3] << 24);
+}
+
+static void destroy_context(void* data) {
+    huffman_context* context = data;
+    huffman_context_destroy(&context);
+}
+
+/**
+ * Returns the context of the calling thread, creating it on first use.
+ */
+static int thread_context(huffman_server* server, huffman_context** context) {
+    (*context) = pthread_getspecific(server->context_key);
+    if((*context) != NULL) {
+        return HUFFMAN_SUCCESS;
+    }
+
+    int status = huffman_context_create(context, &server->options);
+    if(status != HUFFMAN_SUCCESS) {
+        return status;
+    }
+    if(pthread_setspecific(server->context_key, (*context)) != 0) {
+        huffman_context_destroy(context);
+        return HUFFMAN_ALLOC_ERROR;
+    }
+
+    return HUFFMAN_SUCCESS;
+}
+
+/**
+ * Creates the context of a pool thread and runs a compression and a
+ * decompression through it, so that its buffers are allocated and touched
+ * and the processor features are detected. Every thread waits for the
+ * others, so each one runs exactly one of these.
+ */
+static void warm_up_thread(void* data) {
+    huffman_server* server = data;
+
+    huffman_context* context;
+    int status = thread_context(server, &context);
+
+    unsigned char* sample = malloc(WARM_UP_SIZE);
+    unsigned char* decoded = malloc(WARM_UP_SIZE);
+    size_t bound = huffman_compress_bound(WARM_UP_SIZE);
+    unsigned char* compressed = malloc(bound);
+    if(sample == NULL || decoded == NULL || compressed == NULL) {
+        status = HUFFMAN_ALLOC_ERROR;
+    }
+
+    if(status == HUFFMAN_SUCCESS) {
+        for(unsigned int i = 0; i < WARM_UP_SIZE; i++) {
+            sample[i] = 'a' + (i * i + (i >> 5)) % 26;
+        }
+
+        size_t compressed_size, decoded_size;
+        status = huffman_context_compress(context, sample, WARM_UP_SIZE, compressed, bound, &compressed_size);
+        if(status == HUFFMAN_SUCCESS) {
+            status = huffman_context_decompress(context, compressed, compressed_size,
+                                                decoded, WARM_UP_SIZE, &decoded_size);
+        }
+    }
+
+    free(sample);
+    free(decoded);
+    free(compressed);
+
+    pthread_mutex_lock(&server->lock);
+    if(status != HUFFMAN_SUCCESS) {
+        server->warm_up_status = status;
+    }
+    server->warm_up_arrived++;
+    pthread_cond_broadcast(&server->warmed_up);
+    while(server->warm_up_arrived < server->warm_up_threads) {
+        pthread_cond_wait(&server->warmed_up, &server->lock);
+    }
+    pthread_mutex_unlock(&server->lock);
+}
+
+/**
+ * Takes bytes from the memory the server holds for requests and responses.
+ *
+ * @return A flag indicating if the bytes fit.
+ */
+static int reserve_memory(huffman_server* server, size_t bytes) {
+    pthread_mutex_lock(&server->lock);
+    int reserved = bytes <= server->memory_cap - server->memory_used;
+    if(reserved) {
+        server->memory_used += bytes;
+    }
+    pthread_mutex_unlock(&server->lock);
+    return reserved;
+}
+
+static void release_memory(huffman_server* server, size_t bytes) {
+    pthread_mutex_lock(&server->lock);
+    server->memory_used -= bytes;
+    pthread_mutex_unlock(&server->lock);
+}
+
+/**
+ * Finds the size a compressed stream decodes to from its block headers.
+ */
+static int decoded_size(const unsigned char* in, size_t in_len, size_t* size) {
+    if(in_len < HUFFMAN_STREAM_HEADER_SIZE || !huffman_stream_header_check(in)) {
+        return HUFFMAN_ENCODING_ERROR;
+    }
+
+    size_t position = HUFFMAN_STREAM_HEADER_SIZE;
+    size_t total = 0;
+    while(1) {
+        if(in_len - position < HUFFMAN_BLOCK_HEADER_SIZE) {
+            return HUFFMAN_ENCODING_ERROR;
+        }
+
+        huffman_block_header header;
+        int retval = huffman_block_header_read(&header, in + position);
+        if(retval != HUFFMAN_SUCCESS) {
+            return retval;
+        }
+        position += HUFFMAN_BLOCK_HEADER_SIZE;
+
+        if(header.body_size > in_len - position) {
+            return HUFFMAN_ENCODING_ERROR;
+        }
+        position += header.body_size;
+
+        if(header.type == HUFFMAN_BLOCK_END) {
+            (*size) = total;
+            return HUFFMAN_SUCCESS;
+        }
+
+        total += header.raw_size;
+        if(total > HUFFMAN_SERVER_MAX_SIZE) {
+            return HUFFMAN_BUFFER_ERROR;
+        }
+    }
+}
+
+/**
+ * Reads from a socket until a buffer is full.
+ *
+ * @return 1 if the buffer is full, 0 if the socket has no more data for
+ *         now, -1 if the connection is closed or broken.
+ */
+static int receive(int fd, unsigned char* buffer, unsigned int size, unsigned int* fill) {
+    while((*fill) < size) {
+        ssize_t received = recv(fd, buffer + (*fill), size - (*fill), 0);
+        if(received > 0) {
+            (*fill) += received;
+        } else if(received == 0) {
+            return -1;
+        } else if(errno == EAGAIN || errno == EWOULDBLOCK) {
+            return 0;
+        } else if(errno != EINTR) {
+            return -1;
+        }
+    }
+
+    return 1;
+}
+
+/**
+ * Grows the buffer of a request that filled it, so that memory is only
+ * taken for data that arrived.
+ *
+ * @return A flag indicating if the buffer grew, or the status of the
+ *         connection is set.
+ */
+static int grow_payload(server_connection* connection) {
+    unsigned int capacity = connection->payload_cap == 0 ? RECEIVE_SIZE : connection->payload_cap * 2;
+    if(capacity > connection->size) {
+        capacity = connection->size;
+    }
+
+    if(!reserve_memory(connection->server, capacity - connection->payload_cap)) {
+        connection->status = HUFFMAN_MEMORY_ERROR;
+        return 0;
+    }
+    unsigned char* payload = realloc(connection->payload, capacity);
+    if(payload == NULL) {
+        release_memory(connection->server, capacity - connection->payload_cap);
+        connection->status = HUFFMAN_ALLOC_ERROR;
+        return 0;
+    }
+    connection->payload = payload;
+    connection->payload_cap = capacity;
+
+    return 1;
+}
+
+static void free_payload(server_connection* connection) {
+    free(connection->payload);
+    release_memory(connection->server, connection->payload_cap);
+    connection->payload = NULL;
+    connection->payload_cap = 0;
+}
+
+/**
+ * Reads as much of a request as the socket has.
+ *
+ * @return 1 if the request is complete or can't be served, in which case
+ *         the connection's status is set, 0 if more data is needed, -1 if
+ *         the connection is closed or broken.
+ */
+static int read_request(server_connection* connection) {
+    if(connection->header_fill < HUFFMAN_SERVER_HEADER_SIZE) {
+        int retval = receive(connection->fd, connection->header, HUFFMAN_SERVER_HEADER_SIZE, &connection->header_fill);
+        if(retval != 1) {
+            return retval;
+        }
+
+        connection->operation = connection->header[0];
+        connection->size = read_u32(connection->header + 4);
+        if((connection->operation != HUFFMAN_SERVER_COMPRESS && connection->operation != HUFFMAN_SERVER_DECOMPRESS)
+           || connection->header[1] != 0 || connection->header[2] != 0 || connection->header[3] != 0) {
+            connection->status = HUFFMAN_ENCODING_ERROR;
+            return 1;
+        }
+        if(connection->size > HUFFMAN_SERVER_MAX_SIZE) {
+            connection->status = HUFFMAN_BUFFER_ERROR;
+            return 1;
+        }
+    }
+
+    while(1) {
+        if(connection->payload_fill == connection->payload_cap && connection->payload_cap < connection->size
+           && !grow_payload(connection)) {
+            return 1;
+        }
+
+        int retval = receive(connection->fd, connection->payload, connection->payload_cap, &connection->payload_fill);
+        if(retval != 1 || connection->payload_fill == connection->size) {
+            return retval;
+        }
+    }
+}
+
+/**
+ * Writes a whole buffer to a socket, waiting for the client to read when
+ * the socket is full.
+ *
+ * @return A flag indicating if the buffer was sent.
+ */
+static int send_all(int fd, const unsigned char* buffer, size_t size) {
+    while(size > 0) {
+        ssize_t sent = send(fd, buffer, size, MSG_NOSIGNAL);
+        if(sent > 0) {
+            buffer += sent;
+            size -= sent;
+        } else if(sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            struct pollfd wait = { .fd = fd, .events = POLLOUT };
+            int ready = poll(&wait, 1, SEND_TIMEOUT);
+            if(ready == 0 || (ready < 0 && errno != EINTR)) {
+                return 0;
+            }
+        } else if(sent == 0 || errno != EINTR) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+static void close_connection(server_connection* connection) {
+    huffman_server* server = connection->server;
+
+    pthread_mutex_lock(&server->lock);
+    if(connection->previous != NULL) {
+        connection->previous->next = connection->next;
+    } else {
+        server->connections = connection->next;
+    }
+    if(connection->next != NULL) {
+        connection->next->previous = connection->previous;
+    }
+    pthread_mutex_unlock(&server->lock);
+
+    close(connection->fd);
+    free_payload(connection);
+    free(connection);
+}
+
+static int watch_connection(server_connection* connection, int operation) {
+    struct epoll_event event;
+    event.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+    event.data.ptr = connection;
+    return epoll_ctl(connection->server->epoll_fd, operation, connection->fd, &event) == 0;
+}
+
+/**
+ * Codes a complete request on a pool thread, sends the response and
+ * either hands the connection back to epoll or closes it.
+ */
+static void serve_request(void* data) {
+    server_connection* connection = data;
+    huffman_server* server = connection->server;
+
+    int status = connection->status;
+    unsigned char* out = NULL;
+    size_t out_cap = 0;
+    size_t out_len = 0;
+
+    huffman_context* context = NULL;
+    if(status == HUFFMAN_SUCCESS) {
+        status = thread_context(server, &context);
+    }
+
+    if(status == HUFFMAN_SUCCESS) {
+        if(connection->operation == HUFFMAN_SERVER_COMPRESS) {
+            out_cap = huffman_compress_bound(connection->size);
+        } else {
+            status = decoded_size(connection->payload, connection->size, &out_cap);
+        }
+
+        if(status == HUFFMAN_SUCCESS && !reserve_memory(server, out_cap)) {
+            out_cap = 0;
+            status = HUFFMAN_MEMORY_ERROR;
+        }
+        if(status == HUFFMAN_SUCCESS) {
+            out = malloc(out_cap == 0 ? 1 : out_cap);
+            if(out == NULL) {
+                status = HUFFMAN_ALLOC_ERROR;
+            }
+        }
+
+        if(status == HUFFMAN_SUCCESS) {
+            if(connection->operation == HUFFMAN_SERVER_COMPRESS) {
+                status = huffman_context_compress(context, connection->payload, connection->size,
+                                                  out, out_cap, &out_len);
+            } else {
+                status = huffman_context_decompress(context, connection->payload, connection->size,
+                                                    out, out_cap, &out_len);
+            }
+        }
+    }
+
+    if(status != HUFFMAN_SUCCESS) {
+        out_len = 0;
+    }
+
+    unsigned char header[HUFFMAN_SERVER_HEADER_SIZE];
+    write_u32(header, (unsigned int) status);
+    write_u32(header + 4, (unsigned int) out_len);
+    int sent = send_all(connection->fd, header, HUFFMAN_SERVER_HEADER_SIZE)
+               && send_all(connection->fd, out, out_len);
+    free(out);
+    release_memory(server, out_cap);
+
+    if(!sent || connection->status != HUFFMAN_SUCCESS) {
+        close_connection(connection);
+        return;
+    }
+
+    free_payload(connection);
+    connection->header_fill = 0;
+    connection->payload_fill = 0;
+
+    if(!watch_connection(connection, EPOLL_CTL_MOD)) {
+        close_connection(connection);
+    }
+}
+
+static void accept_connections(huffman_server* server) {
+    while(1) {
+        int fd = accept4(server->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if(fd < 0) {
+            if(errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            return;
+        }
+
+        server_connection* connection = calloc(1, sizeof(server_connection));
+        if(connection == NULL) {
+            close(fd);
+            continue;
+        }
+        connection->fd = fd;
+        connection->server = server;
+        connection->status = HUFFMAN_SUCCESS;
+
+        pthread_mutex_lock(&server->lock);
+        connection->next = server->connections;
+        if(server->connections != NULL) {
+            server->connections->previous = connection;
+        }
+        server->connections = connection;
+        pthread_mutex_unlock(&server->lock);
+
+        if(!watch_connection(connection, EPOLL_CTL_ADD)) {
+            close_connection(connection);
+        }
+    }
+}
+
+static void handle_connection(server_connection* connection) {
+    int retval = read_request(connection);
+    if(retval == 0) {
+        if(!watch_connection(connection, EPOLL_CTL_MOD)) {
+            close_connection(connection);
+        }
+    } else if(retval < 0 || thread_pool_submit(connection->server->pool, serve_request, connection) != THREAD_POOL_SUCCESS) {
+        close_connection(connection);
+    }
+}
+
+static int open_socket(huffman_server* server, const char* path) {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if(strlen(path) >= sizeof(address.sun_path)) {
+        return HUFFMAN_IO_ERROR;
+    }
+    strcpy(address.sun_path, path);
+
+    struct stat info;
+    if(lstat(path, &info) == 0 && S_ISSOCK(info.st_mode)) {
+        unlink(path);
+    }
+
+    server->listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(server->listen_fd < 0) {
+        return HUFFMAN_IO_ERROR;
+    }
+    if(bind(server->listen_fd, (struct sockaddr*) &address, sizeof(address)) != 0) {
+        return HUFFMAN_IO_ERROR;
+    }
+    server->bound = 1;
+    if(listen(server->listen_fd, SOMAXCONN) != 0) {
+        return HUFFMAN_IO_ERROR;
+    }
+
+    return HUFFMAN_SUCCESS;
+}
+
+static int serve(huffman_server* server, const char* path) {
+    int status = open_socket(server, path);
+    if(status != HUFFMAN_SUCCESS) {
+        return status;
+    }
+
+    server->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if(server->epoll_fd < 0) {
+        return HUFFMAN_IO_ERROR;
+    }
+
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.ptr = server;
+    if(epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, server->listen_fd, &event) != 0) {
+        return HUFFMAN_IO_ERROR;
+    }
+    event.data.ptr = &server->signal_fd;
+    if(epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, server->signal_fd, &event) != 0) {
+        return HUFFMAN_IO_ERROR;
+    }
+
+    struct epoll_event events[MAX_EVENTS];
+    while(1) {
+        int count = epoll_wait(server->epoll_fd, events, MAX_EVENTS, -1);
+        if(count < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            return HUFFMAN_IO_ERROR;
+        }
+
+        for(int i = 0; i < count; i++) {
+            if(events[i].data.ptr == &server->signal_fd) {
+                /* Taken so that it isn't delivered once it is unblocked. */
+                struct signalfd_siginfo info;
+                if(read(server->signal_fd, &info, sizeof(info)) < 0) {
+                    return HUFFMAN_IO_ERROR;
+                }
+                return HUFFMAN_SUCCESS;
+            } else if(events[i].data.ptr == server) {
+                accept_connections(server);
+            } else {
+                handle_connection(events[i].data.ptr);
+            }
+        }
+    }
+}
+
+int huffman_server_run(const char* path, const huffman_options* options, int threads) {
+    huffman_server server;
+    server.options = (*options);
+    server.listen_fd = -1;
+    server.signal_fd = -1;
+    server.epoll_fd = -1;
+    server.warm_up_threads = threads;
+    server.warm_up_arrived = 0;
+    server.warm_up_status = HUFFMAN_SUCCESS;
+    server.bound = 0;
+    server.connections = NULL;
+    server.memory_used = 0;
+    server.memory_cap = options->memory_limit != 0 ? options->memory_limit : DEFAULT_MEMORY;
+
+    /* Signals are blocked in every thread and read from the epoll loop. */
+    sigset_t signals, old_signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, &old_signals);
+
+    if(pthread_key_create(&server.context_key, destroy_context) != 0) {
+        pthread_sigmask(SIG_SETMASK, &old_signals, NULL);
+        return HUFFMAN_ALLOC_ERROR;
+    }
+    pthread_mutex_init(&server.lock, NULL);
+    pthread_cond_init(&server.warmed_up, NULL);
+
+    int status = HUFFMAN_SUCCESS;
+    if(thread_pool_create(&server.pool, threads) != THREAD_POOL_SUCCESS) {
+        status = HUFFMAN_ALLOC_ERROR;
+    }
+
+    if(status == HUFFMAN_SUCCESS) {
+        for(int i = 0; i < threads; i++) {
+            if(thread_pool_submit(server.pool, warm_up_thread, &server) != THREAD_POOL_SUCCESS) {
+                /* Releases the threads that are waiting for the rest. */
+                pthread_mutex_lock(&server.lock);
+                server.warm_up_threads = i;
+                server.warm_up_status = HUFFMAN_ALLOC_ERROR;
+                pthread_cond_broadcast(&server.warmed_up);
+                pthread_mutex_unlock(&server.lock);
+                break;
+            }
+        }
+        thread_pool_wait(server.pool);
+        status = server.warm_up_status;
+    }
+
+    if(status == HUFFMAN_SUCCESS) {
+        server.signal_fd = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+        status = server.signal_fd < 0 ? HUFFMAN_IO_ERROR : serve(&server, path);
+    }
+
+    if(server.pool != NULL) {
+        thread_pool_destroy(&server.pool);
+    }
+    while(server.connections != NULL) {
+        close_connection(server.connections);
+    }
+
+    if(server.listen_fd >= 0) {
+        close(server.listen_fd);
+    }
+    if(server.bound) {
+        unlink(path);
+    }
+    if(server.epoll_fd >= 0) {
+        close(server.epoll_fd);
+    }
+    if(server.signal_fd >= 0) {
+        close(server.signal_fd);
+    }
+
+    pthread_cond_destroy(&server.warmed_up);
+    pthread_mutex_destroy(&server.lock);
+    pthread_key_delete(server.context_key);
+    pthread_sigmask(SIG_SETMASK, &old_signals, NULL);
+
+    return status;
+}
@@ -0,0 +1,63 @@
+/**
+ * Copyright (c) 2011-2014, Vasileios Daras. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+#ifndef HUFFMAN_SERVER_H
+#define HUFFMAN_SERVER_H
+
+#include "huffman_encoding.h"
+
+#define HUFFMAN_SERVER_COMPRESS 'c'
+#define HUFFMAN_SERVER_DECOMPRESS 'd'
+
+#define HUFFMAN_SERVER_HEADER_SIZE 8
+/* Largest request, and largest output of a decompression, that is served. */
+#define HUFFMAN_SERVER_MAX_SIZE (64u << 20)
+
+/**
+ * Serves compression over a Unix domain stream socket. A client sends any
+ * number of requests on a connection, each one a header of
+ * HUFFMAN_SERVER_HEADER_SIZE bytes, holding the operation
+ * (HUFFMAN_SERVER_COMPRESS or HUFFMAN_SERVER_DECOMPRESS), three zero bytes
+ * and the size of the data that follows, and then the data. Every request
+ * gets a response in the same order, a header holding the status of the
+ * request and the size of the data that follows, and then the compressed
+ * or decompressed data. Integers are stored in little endian. A request
+ * larger than HUFFMAN_SERVER_MAX_SIZE, or one with an unknown operation,
+ * gets an error and the connection is closed.
+ *
+ * Connections are watched with epoll by the calling thread, which reads
+ * requests and hands them to a pool of threads. Each thread codes them with
+ * a huffman_context of its own, created and used once before the socket is
+ * opened so that the first requests don't pay for it.
+ *
+ * A request's buffer grows as its data arrives. The buffers of all requests
+ * and responses share the memory limit of the options, or 1 GiB without
+ * one, and a request that doesn't fit in what is left gets
+ * HUFFMAN_MEMORY_ERROR.
+ *
+ * @param path Path of the socket. A socket already at the path is replaced.
+ * @param options Options to compress with, the verify option for
+ *        decompression, and the memory limit of the server.
+ * @param threads Number of threads that code requests.
+ * @return A flag indicating if the server ran and stopped cleanly, which it
+ *         does on SIGINT or SIGTERM.
+ */
+int huffman_server_run(const char* path, const huffman_options* options, int threads);
+
+#endif //HUFFMAN_SERVER_H
@@ -0,0 +1,362 @@
+/**
+ * Copyright (c) 2011-2014, Vasileios Daras. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+#include "huffman_stream.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define DSTREAM_STREAM_HEADER 0
+#define DSTREAM_BLOCK_HEADER 1
+#define DSTREAM_BODY 2
+#define DSTREAM_STORED 3
+#define DSTREAM_OUTPUT 4
+#define DSTREAM_END 5
+#define DSTREAM_ERROR 6
+
+static size_t min_size(size_t size1, size_t size2) {
+    return size1 < size2 ? size1 : size2;
+}
+
+int huffman_dstream_create(huffman_dstream** stream) {
+    (*stream) = malloc(sizeof(huffman_dstream));
+    if((*stream) == NULL) {
+        return HUFFMAN_ALLOC_ERROR;
+    }
+
+    memset((*stream), 0, sizeof(huffman_dstream));
+    (*stream)->state = DSTREAM_STREAM_HEADER;
+
+    int retval = huffman_block_decoder_create(&(*stream)->decoder);
+    if(retval != HUFFMAN_SUCCESS) {
+        free((*stream));
+        (*stream) = NULL;
+        return retval;
+    }
+
+    return HUFFMAN_SUCCESS;
+}
+
+void huffman_dstream_destroy(huffman_dstream** stream) {
+    huffman_block_decoder_destroy(&(*stream)->decoder);
+    free((*stream)->body);
+    free((*stream)->pending);
+    free((*stream));
+    (*stream) = NULL;
+}
+
+static int dstream_fail(huffman_dstream* stream, int error) {
+    stream->state = DSTREAM_ERROR;
+    stream->error = error;
+    return error;
+}
+
+/**
+ * Moves input into the header buffer until it holds size bytes. Returns if
+ * the header is complete.
+ */
+static int dstream_fill_header(huffman_dstream* stream, unsigned int size, const unsigned char* in, size_t in_len, size_t* consumed) {
+    size_t count = min_size(size - stream->header_fill, in_len - (*consumed));
+    memcpy(stream->header_bytes + stream->header_fill, in + (*consumed), count);
+    stream->header_fill += count;
+    (*consumed) += count;
+
+    return stream->header_fill == size;
+}
+
+/**
+ * Starts the block whose header was read: stored blocks without checksums
+ * are passed through and other blocks, and end blocks with a checksum,
+ * have their body collected.
+ */
+static int dstream_start_block(huffman_dstream* stream) {
+
+    int retval = huffman_block_header_read(&stream->header, stream->header_bytes);
+    if(retval != HUFFMAN_SUCCESS) {
+        return dstream_fail(stream, retval);
+    }
+
+    if(stream->header.type == HUFFMAN_BLOCK_END && stream->header.body_size == 0) {
+        stream->state = DSTREAM_END;
+    } else if(stream->header.type == HUFFMAN_BLOCK_STORED
+           && (stream->header.flags & (HUFFMAN_BLOCK_FLAG_RLE | HUFFMAN_BLOCK_FLAG_CHECKSUM)) == 0) {
+        if(stream->header.body_size != stream->header.raw_size) {
+            return dstream_fail(stream, HUFFMAN_ENCODING_ERROR);
+        }
+        stream->stored_left = stream->header.raw_size;
+        stream->state = DSTREAM_STORED;
+    } else {
+        if(stream->body == NULL) {
+            stream->body = malloc(HUFFMAN_BLOCK_SIZE + HUFFMAN_BLOCK_CHECKSUM_SIZE);
+            stream->pending = malloc(HUFFMAN_BLOCK_SIZE);
+            if(stream->body == NULL || stream->pending == NULL) {
+                return dstream_fail(stream, HUFFMAN_ALLOC_ERROR);
+            }
+        }
+        stream->body_fill = 0;
+        stream->state = DSTREAM_BODY;
+    }
+
+    return HUFFMAN_SUCCESS;
+}
+
+int huffman_dstream_feed(huffman_dstream* stream, const unsigned char* in, size_t in_len, size_t* consumed,
+                         unsigned char* out, size_t out_cap, size_t* produced) {
+
+    (*consumed) = 0;
+    (*produced) = 0;
+
+    while(1) {
+        size_t count;
+        int retval;
+
+        switch(stream->state) {
+
+            case DSTREAM_STREAM_HEADER:
+                if(!dstream_fill_header(stream, HUFFMAN_STREAM_HEADER_SIZE, in, in_len, consumed)) {
+                    return HUFFMAN_SUCCESS;
+                }
+                if(!huffman_stream_header_check(stream->header_bytes)) {
+                    return dstream_fail(stream, HUFFMAN_ENCODING_ERROR);
+                }
+                stream->header_fill = 0;
+                stream->state = DSTREAM_BLOCK_HEADER;
+                break;
+
+            case DSTREAM_BLOCK_HEADER:
+                if(!dstream_fill_header(stream, HUFFMAN_BLOCK_HEADER_SIZE, in, in_len, consumed)) {
+                    return HUFFMAN_SUCCESS;
+                }
+                stream->header_fill = 0;
+                retval = dstream_start_block(stream);
+                if(retval != HUFFMAN_SUCCESS) {
+                    return retval;
+                }
+                break;
+
+            case DSTREAM_BODY:
+                count = min_size(stream->header.body_size - stream->body_fill, in_len - (*consumed));
+                memcpy(stream->body + stream->body_fill, in + (*consumed), count);
+                stream->body_fill += count;
+                (*consumed) += count;
+
+                if(stream->body_fill < stream->header.body_size) {
+                    return HUFFMAN_SUCCESS;
+                }
+
+                if(stream->header.type == HUFFMAN_BLOCK_END) {
+                    retval = huffman_block_decoder_end(stream->decoder, &stream->header, stream->body);
+                    if(retval != HUFFMAN_SUCCESS) {
+                        return dstream_fail(stream, retval);
+                    }
+                    stream->state = DSTREAM_END;
+                    break;
+                }
+
+                retval = huffman_block_decode(stream->decoder, &stream->header, stream->body, stream->pending);
+                if(retval != HUFFMAN_SUCCESS) {
+                    return dstream_fail(stream, retval);
+                }
+                stream->pending_position = 0;
+                stream->state = DSTREAM_OUTPUT;
+                break;
+
+            case DSTREAM_STORED:
+                count = min_size(stream->stored_left, min_size(in_len - (*consumed), out_cap - (*produced)));
+                memcpy(out + (*produced), in + (*consumed), count);
+                stream->stored_left -= count;
+                (*consumed) += count;
+                (*produced) += count;
+
+                if(stream->stored_left != 0) {
+                    return HUFFMAN_SUCCESS;
+                }
+                stream->state = DSTREAM_BLOCK_HEADER;
+                break;
+
+            case DSTREAM_OUTPUT:
+                count = min_size(stream->header.raw_size - stream->pending_position, out_cap - (*produced));
+                memcpy(out + (*produced), stream->pending + stream->pending_position, count);
+                stream->pending_position += count;
+                (*produced) += count;
+
+                if(stream->pending_position < stream->header.raw_size) {
+                    return HUFFMAN_SUCCESS;
+                }
+                stream->state = DSTREAM_BLOCK_HEADER;
+                break;
+
+            case DSTREAM_END:
+                return HUFFMAN_STREAM_END;
+
+            default:
+                return stream->error;
+        }
+    }
+}
+
+int huffman_cstream_create(huffman_cstream** stream, const huffman_options* options) {
+    (*stream) = malloc(sizeof(huffman_cstream));
+    if((*stream) == NULL) {
+        return HUFFMAN_ALLOC_ERROR;
+    }
+
+    memset((*stream), 0, sizeof(huffman_cstream));
+
+    (*stream)->block = malloc(HUFFMAN_BLOCK_SIZE);
+    if((*stream)->block == NULL) {
+        free((*stream));
+        (*stream) = NULL;
+        return HUFFMAN_ALLOC_ERROR;
+    }
+
+    huffman_options copy;
+    huffman_options_copy(&copy, options);
+
+    int retval = huffman_block_encoder_create(&(*stream)->encoder, &copy, HUFFMAN_BLOCK_SIZE);
+    if(retval != HUFFMAN_SUCCESS) {
+        free((*stream)->block);
+        free((*stream));
+        (*stream) = NULL;
+        return retval;
+    }
+
+    huffman_stream_header_write((*stream)->header_bytes, HUFFMAN_BLOCK_SIZE);
+    (*stream)->pending = (*stream)->header_bytes;
+    (*stream)->pending_size = HUFFMAN_STREAM_HEADER_SIZE;
+
+    return HUFFMAN_SUCCESS;
+}
+
+void huffman_cstream_destroy(huffman_cstream** stream) {
+    huffman_block_encoder_destroy(&(*stream)->encoder);
+    free((*stream)->block);
+    free((*stream));
+    (*stream) = NULL;
+}
+
+/**
+ * Moves pending output to out. Returns if nothing is left pending.
+ */
+static int cstream_drain(huffman_cstream* stream, unsigned char* out, size_t out_cap, size_t* produced) {
+    size_t count = min_size(stream->pending_size - stream->pending_position, out_cap - (*produced));
+    memcpy(out + (*produced), stream->pending + stream->pending_position, count);
+    stream->pending_position += count;
+    (*produced) += count;
+
+    return stream->pending_position == stream->pending_size;
+}
+
+/**
+ * Compresses the collected block into the encoder's record, which becomes
+ * the pending output.
+ */
+static int cstream_compress_block(huffman_cstream* stream) {
+
+    unsigned char* record;
+    unsigned int record_size;
+    int retval = huffman_block_encode(stream->encoder, stream->block, stream->block_fill, &record, &record_size);
+    if(retval != HUFFMAN_SUCCESS) {
+        stream->error = retval;
+        return retval;
+    }
+
+    stream->block_fill = 0;
+    stream->pending = record;
+    stream->pending_size = record_size;
+    stream->pending_position = 0;
+    return HUFFMAN_SUCCESS;
+}
+
+int huffman_cstream_write(huffman_cstream* stream, const unsigned char* in, size_t in_len, size_t* consumed,
+                          unsigned char* out, size_t out_cap, size_t* produced) {
+
+    (*consumed) = 0;
+    (*produced) = 0;
+
+    if(stream->error != HUFFMAN_SUCCESS) {
+        return stream->error;
+    }
+    if(stream->ended) {
+        return HUFFMAN_ENCODING_ERROR;
+    }
+
+    while(cstream_drain(stream, out, out_cap, produced) && (*consumed) < in_len) {
+
+        size_t count = min_size(HUFFMAN_BLOCK_SIZE - stream->block_fill, in_len - (*consumed));
+        memcpy(stream->block + stream->block_fill, in + (*consumed), count);
+        stream->block_fill += count;
+        (*consumed) += count;
+
+        if(stream->block_fill == HUFFMAN_BLOCK_SIZE) {
+            int retval = cstream_compress_block(stream);
+            if(retval != HUFFMAN_SUCCESS) {
+                return retval;
+            }
+        }
+    }
+
+    return HUFFMAN_SUCCESS;
+}
+
+int huffman_cstream_flush(huffman_cstream* stream, unsigned char* out, size_t out_cap, size_t* produced) {
+
+    (*produced) = 0;
+
+    if(stream->error != HUFFMAN_SUCCESS) {
+        return stream->error;
+    }
+    if(!cstream_drain(stream, out, out_cap, produced)) {
+        return HUFFMAN_STREAM_PENDING;
+    }
+
+    if(stream->block_fill != 0) {
+        int retval = cstream_compress_block(stream);
+        if(retval != HUFFMAN_SUCCESS) {
+            return retval;
+        }
+
+        if(!cstream_drain(stream, out, out_cap, produced)) {
+            return HUFFMAN_STREAM_PENDING;
+        }
+    }
+
+    return HUFFMAN_SUCCESS;
+}
+
+int huffman_cstream_end(huffman_cstream* stream, unsigned char* out, size_t out_cap, size_t* produced) {
+
+    if(!stream->ended) {
+        int retval = huffman_cstream_flush(stream, out, out_cap, produced);
+        if(retval != HUFFMAN_SUCCESS) {
+            return retval;
+        }
+
+        stream->pending = stream->header_bytes;
+        stream->pending_size = huffman_block_encoder_end(stream->encoder, stream->header_bytes);
+        stream->pending_position = 0;
+        stream->ended = 1;
+    } else {
+        (*produced) = 0;
+        if(stream->error != HUFFMAN_SUCCESS) {
+            return stream->error;
+        }
+    }
+
+    return cstream_drain(stream, out, out_cap, produced) ? HUFFMAN_STREAM_END : HUFFMAN_STREAM_PENDING;
+}
@@ -0,0 +1,74 @@
+/**
+ * Copyright (c) 2011-2014, Vasileios Daras. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+#ifndef HUFFMAN_STREAM_H
+#define HUFFMAN_STREAM_H
+
+#include <stddef.h>
+#include "huffman_block.h"
+
+/**
+ * Decoder for a compressed stream that arrives in pieces. Input is taken
+ * as it comes and kept only until the block it belongs to is complete, so
+ * memory use doesn't depend on the stream's size: a block's body and its
+ * decoded bytes, at most HUFFMAN_BLOCK_SIZE each. Stored blocks are copied
+ * straight from the input to the output without being kept at all, unless
+ * they carry a checksum. Checksums are verified unless the decoder's verify
+ * is cleared.
+ */
+struct huffman_dstream_t {
+    int state;
+    int error;
+
+    unsigned char header_bytes[HUFFMAN_BLOCK_HEADER_SIZE];
+    unsigned int header_fill;
+    huffman_block_header header;
+
+    unsigned char* body;
+    unsigned int body_fill;
+    unsigned int stored_left;
+
+    unsigned char* pending;
+    unsigned int pending_position;
+
+    huffman_block_decoder* decoder;
+};
+
+/**
+ * Compressor for data that arrives in pieces. Input is collected into a
+ * block of up to HUFFMAN_BLOCK_SIZE bytes which is compressed when it is
+ * full or the stream is flushed, with the same encoder throughout so that
+ * later blocks can repeat the tables of earlier ones. A compressed block
+ * waits in the encoder's record until the caller has taken all of it.
+ */
+struct huffman_cstream_t {
+    int error;
+    int ended;
+
+    huffman_block_encoder* encoder;
+    unsigned char* block;
+    unsigned int block_fill;
+
+    unsigned char header_bytes[HUFFMAN_BLOCK_HEADER_SIZE + HUFFMAN_BLOCK_CHECKSUM_SIZE];
+    const unsigned char* pending;
+    unsigned int pending_size;
+    unsigned int pending_position;
+};
+
+#endif //HUFFMAN_STREAM_H
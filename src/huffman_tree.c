@@ -28,8 +28,12 @@ static int compare_huffman_nodes(void* node1, void* node2) {
     huffman_node* huff_node_1 = (huffman_node*) node1;
     huffman_node* huff_node_2 = (huffman_node*) node2;
     
-    return huff_node_1->frequency < huff_node_2->frequency ? 1 :
-            huff_node_1->frequency == huff_node_2->frequency ? 0 : -1;
+    if(huff_node_1->frequency != huff_node_2->frequency) {
+        return huff_node_1->frequency < huff_node_2->frequency ? 1 : -1;
+    }
+
+    return huff_node_1->order < huff_node_2->order ? 1 :
+            huff_node_1->order == huff_node_2->order ? 0 : -1;
 }
 
 int huffman_node_create(huffman_node** node) {
@@ -39,6 +43,7 @@ int huffman_node_create(huffman_node** node) {
     }
     (*node)->which_char = 0;
     (*node)->frequency = 0;
+    (*node)->order = 0;
     (*node)->is_leaf = 1;
     (*node)->left = (*node)->right = NULL;
     (*node)->parent = NULL;
@@ -62,7 +67,9 @@ static void huffman_node_destroy(void* node) {
  * inserted to a heap. To construct the tree, two nodes with the highest priority
  * are extracted from the heap and a new node is created with the extracted nodes as
  * its left and right children. This is repeated until only one node is left in the heap 
- * which is the root of the Huffman tree.
+ * which is the root of the Huffman tree. Nodes of equal frequency are taken leaves
+ * first, by byte, and then internal nodes in the order they were made, so the
+ * tree depends only on the frequencies and not on how the heap orders ties.
  */
 int huffman_tree_create(huffman_node** root, unsigned int frequencies[256]) {
     
@@ -85,6 +92,7 @@ int huffman_tree_create(huffman_node** root, unsigned int frequencies[256]) {
             }
             
             node->which_char = (unsigned char) i;
+            node->order = i;
             node->frequency = frequencies[i];
             
             retval = binary_heap_insert(heap, node);
@@ -98,6 +106,36 @@ int huffman_tree_create(huffman_node** root, unsigned int frequencies[256]) {
         }
     }
     
+    /*
+     * A tree with a single leaf would give its byte a zero length code, so a second
+     * leaf with no occurrences is added to make every code at least one bit long.
+     */
+    if(node_count == 1) {
+        huffman_node* node;
+        retval = huffman_node_create(&node);
+        if(retval == HUFFMAN_ALLOC_ERROR) {
+            binary_heap_destroy(&heap);
+            return HUFFMAN_ALLOC_ERROR;
+        }
+
+        for(unsigned int i = 0; i < 256; i++) {
+            if(frequencies[i] != 0) {
+                node->which_char = (unsigned char) (i + 1);
+                node->order = i + 1;
+                break;
+            }
+        }
+
+        retval = binary_heap_insert(heap, node);
+        if(retval == BINARYHEAP_ALLOC_ERROR) {
+            huffman_node_destroy(node);
+            binary_heap_destroy(&heap);
+            return HUFFMAN_ALLOC_ERROR;
+        }
+
+        node_count++;
+    }
+
     for(int i = 0; i < node_count - 1; i++) {
         huffman_node* new_node = NULL;
         retval = huffman_node_create(&new_node);
@@ -122,6 +160,7 @@ int huffman_tree_create(huffman_node** root, unsigned int frequencies[256]) {
         left->parent = right->parent = new_node;
         
         new_node->frequency = left->frequency + right->frequency;
+        new_node->order = 256 + i;
         new_node->is_leaf = 0;
         
         if(binary_heap_insert(heap, new_node) == BINARYHEAP_ALLOC_ERROR) {
@@ -217,7 +256,7 @@ static int huffman_tree_serialize_recurse(huffman_node* curr_node, bitset* tree_
     return HUFFMAN_SUCCESS;
 }
 
-int huffman_tree_serialize(huffman_node* root, FILE* fp) {
+static int huffman_tree_to_sized_bitset(huffman_node* root, bitset** tree_binary_rep, int compact) {
 
     bitset* bset;
     int bitset_creation_status = bitset_create(&bset, 30);
@@ -232,103 +271,195 @@ int huffman_tree_serialize(huffman_node* root, FILE* fp) {
         return serialization_status;
     }
 
-    bitset_serialize(bset, fp);
-    bitset_destroy(&bset);
+    /* Shrinking keeps the buffer, whose bits past bits_stored are all clear. */
+    if(compact) {
+        bitset_resize(bset, bits_stored);
+    }
+
+    (*tree_binary_rep) = bset;
     return HUFFMAN_SUCCESS;
 }
 
+int huffman_tree_to_bitset(huffman_node* root, bitset** tree_binary_rep) {
+    return huffman_tree_to_sized_bitset(root, tree_binary_rep, 0);
+}
 
-static int huffman_tree_deserialize_recurse(huffman_node* curr_node, bitset* tree_binary_rep, int *bits_read) {
-    if((*bits_read) >= tree_binary_rep->total_bits) {
-        return HUFFMAN_SUCCESS;
-    }
+int huffman_tree_to_compact_bitset(huffman_node* root, bitset** tree_binary_rep) {
+    return huffman_tree_to_sized_bitset(root, tree_binary_rep, 1);
+}
 
-    int node_creation_status, deserialization_status;
+int huffman_tree_serialize(huffman_node* root, FILE* fp) {
 
-    unsigned int curr_bit;
-    bitset_get_bit(tree_binary_rep, *bits_read, &curr_bit);
-    (*bits_read)++;
+    bitset* bset;
+    int serialization_status = huffman_tree_to_bitset(root, &bset);
+    if(serialization_status != HUFFMAN_SUCCESS) {
+        return serialization_status;
+    }
 
-    if(curr_bit == 0) {
-        
-        huffman_node* new_node;
-        node_creation_status = huffman_node_create(&new_node);
-        if(node_creation_status != HUFFMAN_SUCCESS) {
-            return node_creation_status;
-        }
+    bitset_serialize(bset, fp);
+    bitset_destroy(&bset);
+    return HUFFMAN_SUCCESS;
+}
 
-        deserialization_status = huffman_tree_deserialize_recurse(new_node, tree_binary_rep, bits_read);
-        if(deserialization_status != HUFFMAN_SUCCESS) {
-            huffman_node_destroy(new_node);
-            return deserialization_status;
-        }
 
-        curr_node->left = new_node;
+/**
+ * Rebuilds a tree from its representation in preorder, a 0 bit for an
+ * internal node and a 1 bit followed by the byte for a leaf. Nodes still to
+ * be read are kept on a stack instead of the call stack, which can't hold
+ * more than a node per level of a tree of HUFFMAN_TREE_MAX_DEPTH, so a
+ * hostile representation can neither overflow it nor build a large tree.
+ * Nodes are attached as soon as they are created, so destroying the root
+ * frees a partly built tree.
+ */
+static int huffman_tree_from_bitset(huffman_node** root, bitset* tree_binary_rep) {
 
-        node_creation_status = huffman_node_create(&new_node);
-        if(node_creation_status != HUFFMAN_SUCCESS) {
-            return node_creation_status;
-        }
+    huffman_node* temp_root;
+    int node_creation_status = huffman_node_create(&temp_root);
+    if(node_creation_status == HUFFMAN_ALLOC_ERROR) {
+        return HUFFMAN_ALLOC_ERROR;
+    }
 
-        deserialization_status = huffman_tree_deserialize_recurse(new_node, tree_binary_rep, bits_read);
-        if(deserialization_status != HUFFMAN_SUCCESS) {
-            huffman_node_destroy(new_node);
-            return deserialization_status;
+    huffman_node* pending[HUFFMAN_TREE_MAX_DEPTH + 1];
+    unsigned int depths[HUFFMAN_TREE_MAX_DEPTH + 1];
+    int pending_count = 1;
+    pending[0] = temp_root;
+    depths[0] = 0;
+
+    unsigned int bits_read = 0;
+    int leaves = 0;
+    int retval = HUFFMAN_SUCCESS;
+
+    while(pending_count != 0 && retval == HUFFMAN_SUCCESS) {
+        pending_count--;
+        huffman_node* curr_node = pending[pending_count];
+        unsigned int depth = depths[pending_count];
+
+        unsigned int curr_bit;
+        if(bitset_get_bit(tree_binary_rep, bits_read, &curr_bit) != BITSET_SUCCESS) {
+            retval = HUFFMAN_ENCODING_ERROR;
+            break;
         }
+        bits_read++;
 
-        curr_node->right = new_node;
-
-        curr_node->is_leaf = 0;
-    } else {
-
-        unsigned char byte = 0;
+        if(curr_bit == 0) {
+            if(depth == HUFFMAN_TREE_MAX_DEPTH) {
+                retval = HUFFMAN_ENCODING_ERROR;
+                break;
+            }
 
-        
-        for(int i = 0; i < 8; i++) {
-            
-            unsigned int bit;
-            int bit_read_status = bitset_get_bit(tree_binary_rep, *bits_read, &bit);
-            if(bit_read_status == BITSET_OUT_OF_BOUNDS) {
-                return HUFFMAN_ENCODING_ERROR;
+            if(huffman_node_create(&curr_node->left) != HUFFMAN_SUCCESS
+            || huffman_node_create(&curr_node->right) != HUFFMAN_SUCCESS) {
+                retval = HUFFMAN_ALLOC_ERROR;
+                break;
+            }
+            curr_node->left->parent = curr_node;
+            curr_node->right->parent = curr_node;
+            curr_node->is_leaf = 0;
+
+            /* The left subtree comes first in the representation. */
+            pending[pending_count] = curr_node->right;
+            depths[pending_count] = depth + 1;
+            pending[pending_count + 1] = curr_node->left;
+            depths[pending_count + 1] = depth + 1;
+            pending_count += 2;
+        } else {
+            leaves++;
+            if(leaves > HUFFMAN_TREE_MAX_LEAVES || bits_read + 8 > tree_binary_rep->total_bits) {
+                retval = HUFFMAN_ENCODING_ERROR;
+                break;
             }
-            (*bits_read)++;
 
-            if(bit == 1) {  
-                unsigned char mask = 1 << (8 - i - 1);      
-                byte |= mask;
+            unsigned char byte = 0;
+            for(int i = 0; i < 8; i++) {
+                unsigned int bit;
+                bitset_get_bit(tree_binary_rep, bits_read, &bit);
+                bits_read++;
+                byte = (byte << 1) | bit;
             }
+
+            curr_node->which_char = byte;
         }
+    }
 
-        curr_node->which_char = byte;
+    if(retval != HUFFMAN_SUCCESS) {
+        huffman_tree_destroy(&temp_root);
+        return retval;
     }
 
+    (*root) = temp_root;
     return HUFFMAN_SUCCESS;
 }
 
 int huffman_tree_deserialize(huffman_node** root, FILE* fp) {
 
     bitset* tree_binary_rep;
-    int deserialization_status = bitset_deserialize(&tree_binary_rep, fp);
+    int deserialization_status = bitset_deserialize(&tree_binary_rep, fp, HUFFMAN_TREE_MAX_BITS);
     if(deserialization_status == BITSET_ALLOC_ERROR) {
         return HUFFMAN_ALLOC_ERROR;
+    } else if(deserialization_status != BITSET_SUCCESS) {
+        return HUFFMAN_ENCODING_ERROR;
     }
 
-    huffman_node* temp_root;
-    int node_creation_status = huffman_node_create(&temp_root);
-    if(node_creation_status == HUFFMAN_ALLOC_ERROR) {
-        bitset_destroy(&tree_binary_rep);
+    deserialization_status = huffman_tree_from_bitset(root, tree_binary_rep);
+    bitset_destroy(&tree_binary_rep);
+    return deserialization_status;
+}
+
+int huffman_tree_deserialize_buffer(huffman_node** root, const unsigned char* buffer, unsigned int size, unsigned int* bytes_read) {
+
+    bitset* tree_binary_rep;
+    int deserialization_status = bitset_deserialize_buffer(&tree_binary_rep, buffer, size, HUFFMAN_TREE_MAX_BITS, bytes_read);
+    if(deserialization_status == BITSET_ALLOC_ERROR) {
         return HUFFMAN_ALLOC_ERROR;
+    } else if(deserialization_status != BITSET_SUCCESS) {
+        return HUFFMAN_ENCODING_ERROR;
     }
 
-    int bits_read = 0;
-    deserialization_status = huffman_tree_deserialize_recurse(temp_root, tree_binary_rep, &bits_read);
-    if(deserialization_status != HUFFMAN_SUCCESS) {
-        huffman_tree_destroy(&temp_root);
-        bitset_destroy(&tree_binary_rep);
-        return deserialization_status;
+    deserialization_status = huffman_tree_from_bitset(root, tree_binary_rep);
+    bitset_destroy(&tree_binary_rep);
+    return deserialization_status;
+}
+
+static void huffman_tree_code_lengths_recurse(huffman_node* curr_node, unsigned int lengths[256], unsigned int depth) {
+    if(curr_node->is_leaf) {
+        lengths[curr_node->which_char] = depth;
+    } else {
+        huffman_tree_code_lengths_recurse(curr_node->left, lengths, depth + 1);
+        huffman_tree_code_lengths_recurse(curr_node->right, lengths, depth + 1);
     }
+}
 
-    (*root) = temp_root;
-    bitset_destroy(&tree_binary_rep);
-    return HUFFMAN_SUCCESS;
+void huffman_tree_code_lengths(huffman_node* root, unsigned int lengths[256]) {
+    for(int i = 0; i < 256; i++) {
+        lengths[i] = 0;
+    }
+
+    huffman_tree_code_lengths_recurse(root, lengths, 0);
+}
+
+static int huffman_tree_codes_recurse(huffman_node* node, unsigned int code, int depth, int max_length,
+                                      unsigned int symbols[256], unsigned int codes[256], unsigned char lengths[256],
+                                      int* count) {
+
+    if(node->is_leaf) {
+        symbols[*count] = node->which_char;
+        codes[*count] = code;
+        lengths[*count] = depth;
+        (*count)++;
+        return depth;
+    }
+
+    if(depth == max_length) {
+        return depth + 1;
+    }
+
+    int left_depth = huffman_tree_codes_recurse(node->left, code << 1, depth + 1, max_length, symbols, codes, lengths, count);
+    int right_depth = huffman_tree_codes_recurse(node->right, (code << 1) | 1, depth + 1, max_length, symbols, codes, lengths, count);
+    return left_depth > right_depth ? left_depth : right_depth;
+}
+
+int huffman_tree_codes(huffman_node* root, int max_length, unsigned int symbols[256], unsigned int codes[256],
+                       unsigned char lengths[256], int* count) {
+    (*count) = 0;
+    return huffman_tree_codes_recurse(root, 0, 0, max_length, symbols, codes, lengths, count);
 }
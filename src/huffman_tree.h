@@ -21,15 +21,24 @@
 #define HUFFMAN_TREE_H
 
 #include <stdio.h>
+#include "bitset.h"
+#include "huffman.h"
 
-#define HUFFMAN_SUCCESS 0
-#define HUFFMAN_ALLOC_ERROR -1
-#define HUFFMAN_ENCODING_ERROR -2
-#define HUFFMAN_TREE_EMPTY -3
+/*
+ * Limits of deserialized trees: a leaf per byte value, the depth of a tree
+ * with that many leaves, and the bits of its representation. That takes a
+ * bit per node and a byte per leaf, but is written with the room it was
+ * grown to by doubling, up to twice as many bits.
+ */
+#define HUFFMAN_TREE_MAX_LEAVES 256
+#define HUFFMAN_TREE_MAX_DEPTH (HUFFMAN_TREE_MAX_LEAVES - 1)
+#define HUFFMAN_TREE_MAX_BITS (2 * (2 * HUFFMAN_TREE_MAX_LEAVES - 1 + 8 * HUFFMAN_TREE_MAX_LEAVES))
 
 typedef struct huffman_node_t {
     unsigned char which_char;
     int frequency;
+    /* Breaks ties in frequency: a leaf's byte, or 256 and up for internal nodes in the order they are made. */
+    int order;
     int is_leaf;
     struct huffman_node_t *parent;
     struct huffman_node_t *left, *right;
@@ -52,6 +61,26 @@ int huffman_tree_create(huffman_node** root, unsigned int frequencies[256]);
  */
 void huffman_tree_destroy(huffman_node** root);
 
+/**
+ * Creates the binary representation of a huffman tree that is written by
+ * huffman_tree_serialize.
+ *
+ * @param root The root of the huffman tree.
+ * @param tree_binary_rep(out) The binary representation is stored in here.
+ * @return A flag indicating if the conversion was successful.
+ */
+int huffman_tree_to_bitset(huffman_node* root, bitset** tree_binary_rep);
+
+/**
+ * Creates the binary representation of a huffman tree holding only the bits
+ * the tree takes, rather than the room huffman_tree_to_bitset grows it to.
+ *
+ * @param root The root of the huffman tree.
+ * @param tree_binary_rep(out) The binary representation is stored in here.
+ * @return A flag indicating if the conversion was successful.
+ */
+int huffman_tree_to_compact_bitset(huffman_node* root, bitset** tree_binary_rep);
+
 /**
  * Serializes the huffman tree to a file.
  *
@@ -62,7 +91,9 @@ void huffman_tree_destroy(huffman_node** root);
 int huffman_tree_serialize(huffman_node* root, FILE* fp);
 
 /**
- * Deserializes a huffman tree from a file.
+ * Deserializes a huffman tree from a file. Representations that are
+ * truncated or describe a tree beyond the HUFFMAN_TREE_MAX_ limits are
+ * rejected with HUFFMAN_ENCODING_ERROR.
  *
  * @param root(out) Huffman tree's root node is stored in here.
  * @param fp File to read the tree from.
@@ -70,4 +101,40 @@ int huffman_tree_serialize(huffman_node* root, FILE* fp);
  */
 int huffman_tree_deserialize(huffman_node** root, FILE* fp);
 
+/**
+ * Deserializes a huffman tree from a memory buffer holding the same
+ * representation huffman_tree_serialize writes to a file.
+ *
+ * @param root(out) Huffman tree's root node is stored in here.
+ * @param buffer Buffer to read the tree from.
+ * @param size Size of the buffer in bytes.
+ * @param bytes_read(out) Number of bytes the tree occupied.
+ * @return A flag indicating if deserialization was successful.
+ */
+int huffman_tree_deserialize_buffer(huffman_node** root, const unsigned char* buffer, unsigned int size, unsigned int* bytes_read);
+
+/**
+ * Computes the code length of every byte in a huffman tree. Bytes that
+ * are not in the tree get a length of 0.
+ *
+ * @param root The root of the huffman tree.
+ * @param lengths(out) Code length of each byte from 0 to 255.
+ */
+void huffman_tree_code_lengths(huffman_node* root, unsigned int lengths[256]);
+
+/**
+ * Collects the code of every leaf of a huffman tree, most significant bit
+ * first, stopping at codes longer than max_length.
+ *
+ * @param root The root of the huffman tree.
+ * @param max_length Longest code to collect, at most 31.
+ * @param symbols(out) Byte of each leaf.
+ * @param codes(out) Code of each leaf.
+ * @param lengths(out) Code length of each leaf.
+ * @param count(out) Number of leaves collected.
+ * @return The length of the longest code, more than max_length if a code is too long.
+ */
+int huffman_tree_codes(huffman_node* root, int max_length, unsigned int symbols[256], unsigned int codes[256],
+                       unsigned char lengths[256], int* count);
+
 #endif //HUFFMAN_TREE_H
\ No newline at end of file
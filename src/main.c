@@ -18,19 +18,340 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 
 #include "huffman_encoding.h"
+#include "huffman_io.h"
+#include "huffman_batch.h"
+#include "huffman_archive.h"
+#include "huffman_server.h"
+#include "huffman_legacy.h"
+#include "thread_pool.h"
 
 void print_usage() {
-    printf("Usage: huffman_encoding -c[-d] infile outfile.\n");
+    printf("Usage: huffman_encoding -c[-d] [options] infile outfile.\n");
+    printf("       huffman_encoding -c[-d] --batch [options] file... | @listfile | -\n");
+    printf("       huffman_encoding -a [options] archive file... | @listfile | -\n");
+    printf("       huffman_encoding -l archive\n");
+    printf("       huffman_encoding -x archive member outfile\n");
+    printf("       huffman_encoding --serve [options] socket\n");
+    printf("       huffman_encoding --build-index [--interval KiB] file...\n");
+    printf("       huffman_encoding --estimate [options] file...\n");
+    printf("Options:\n");
+    printf("  --order1      code each byte with a table chosen by the byte before it.\n");
+    printf("  --rle         run-length encode blocks before coding them.\n");
+    printf("  --wide        code pairs of bytes as 16 bit symbols when that is smaller.\n");
+    printf("  --fast        build the code of large blocks from a sample of their bytes.\n");
+    printf("  --stats       print how the input was compressed.\n");
+    printf("  --checksum    store a checksum of every block and of the whole stream.\n");
+    printf("  --no-verify   don't check checksums when decompressing.\n");
+    printf("  --io-uring    read and write regular files through io_uring.\n");
+    printf("  --batch       process every file given, listed in @listfile or on stdin (-).\n");
+    printf("  --interval    KiB of output between the checkpoints of an index, 1024 by default.\n");
+    printf("  --range o:n   decompress n bytes from offset o, with the file's index.\n");
+    printf("  --memory-limit size[K|M|G]\n");
+    printf("                bytes of memory coding a file may take, bounding its\n");
+    printf("                buffers, blocks and threads, or that --serve\n");
+    printf("                holds for requests, 1G by default.\n");
+    printf("  -T, --threads number of files processed at once in batch mode, of\n");
+    printf("                requests served at once with --serve, or of threads\n");
+    printf("                decompressing a file in the format without blocks.\n");
+}
+
+void print_stats(const huffman_stats* stats) {
+    printf("Blocks: %u, %u stored, %u repeating the previous tables, %u coded from a sample.\n",
+           stats->blocks, stats->stored_blocks, stats->repeated_blocks, stats->sampled_blocks);
+    printf("Size: %llu -> %llu bytes (%.2f%%).\n", stats->input_size, stats->output_size,
+           stats->input_size == 0 ? 100.0 : 100.0 * stats->output_size / stats->input_size);
+
+    if(stats->sampled_blocks != 0) {
+        long long loss = (long long) stats->sampled_size - (long long) stats->exact_size;
+        printf("Sampling: %lld bytes (%+.3f%%) over exact counts.\n", loss,
+               stats->exact_size == 0 ? 0.0 : 100.0 * loss / stats->exact_size);
+    }
+
+    printf("Planned memory: %llu KiB.\n", (stats->planned_memory + 1023) / 1024);
+}
+
+/**
+ * Parses a size in bytes, optionally followed by K, M or G for KiB, MiB or
+ * GiB. Returns 0 for anything else.
+ */
+size_t parse_size(const char* text) {
+    char* end;
+    unsigned long long size = strtoull(text, &end, 10);
+    if(end == text) {
+        return 0;
+    }
+
+    if((*end) == 'K' || (*end) == 'k') {
+        size <<= 10;
+        end++;
+    } else if((*end) == 'M' || (*end) == 'm') {
+        size <<= 20;
+        end++;
+    } else if((*end) == 'G' || (*end) == 'g') {
+        size <<= 30;
+        end++;
+    }
+
+    return (*end) == '\0' ? (size_t) size : 0;
+}
+
+int create_archive(char** files, int file_count, const huffman_options* options) {
+
+    if(file_count < 1) {
+        printf("Expected an archive and the files to store in it.\n");
+        print_usage();
+        return -1;
+    }
+
+    char** names;
+    int name_count;
+    if(huffman_batch_collect(files + 1, file_count - 1, &names, &name_count) != 0) {
+        return -2;
+    }
+
+    FILE* out = fopen(files[0], "wb");
+    if(out == NULL) {
+        printf("Can't open %s for writing.\n", files[0]);
+        huffman_batch_free_names(names, name_count);
+        return -2;
+    }
+
+    int failed;
+    int status = huffman_archive_write(out, names, name_count, options, &failed);
+    if(fclose(out) != 0 && status == 0) {
+        status = HUFFMAN_IO_ERROR;
+    }
+
+    if(status == 0) {
+        printf("Archived %d files.\n", name_count);
+    } else if(failed >= 0 && status == HUFFMAN_IO_ERROR) {
+        printf("Can't read %s.\n", names[failed]);
+    } else if(failed >= 0) {
+        printf("Archiving %s failed: %s.\n", names[failed], huffman_error_string(status));
+    } else {
+        printf("Archiving failed: %s.\n", huffman_error_string(status));
+    }
+    huffman_batch_free_names(names, name_count);
+
+    return status == 0 ? 0 : -2;
+}
+
+int read_archive(char mode, char** files, int file_count) {
+
+    if((mode == 'l' && file_count != 1) || (mode == 'x' && file_count != 3)) {
+        printf("Unexpected number of arguments.\n");
+        print_usage();
+        return -1;
+    }
+
+    FILE* in = fopen(files[0], "rb");
+    if(in == NULL) {
+        printf("File %s doesn't exist.\n", files[0]);
+        return -2;
+    }
+
+    huffman_archive* archive;
+    int status = huffman_archive_open(&archive, in);
+    if(status != 0) {
+        printf("Can't read archive %s: %s.\n", files[0], huffman_error_string(status));
+        fclose(in);
+        return -2;
+    }
+
+    if(mode == 'l') {
+        for(unsigned int i = 0; i < archive->entry_count; i++) {
+            printf("%12llu %12llu %s\n", archive->entries[i].original_size,
+                   archive->entries[i].compressed_size, archive->entries[i].name);
+        }
+
+        huffman_archive_close(&archive);
+        return 0;
+    }
+
+    int index = huffman_archive_find(archive, files[1]);
+    if(index < 0) {
+        printf("Archive %s has no member %s.\n", files[0], files[1]);
+        huffman_archive_close(&archive);
+        return -2;
+    }
+
+    FILE* out = fopen(files[2], "wb");
+    if(out == NULL) {
+        printf("Can't open %s for writing.\n", files[2]);
+        huffman_archive_close(&archive);
+        return -2;
+    }
+
+    status = huffman_archive_extract(archive, index, out);
+    fclose(out);
+    huffman_archive_close(&archive);
+
+    if(status == 0) {
+        printf("Extraction successful.\n");
+    } else {
+        printf("Extraction failed: %s.\n", huffman_error_string(status));
+        return -2;
+    }
+
+    return 0;
+}
+
+int build_indexes(char** files, int file_count, unsigned int interval) {
+
+    if(file_count < 1) {
+        printf("Expected the files to index.\n");
+        print_usage();
+        return -1;
+    }
+
+    int failed = 0;
+    for(int i = 0; i < file_count; i++) {
+        FILE* in = fopen(files[i], "rb");
+        if(in == NULL) {
+            printf("File %s doesn't exist.\n", files[i]);
+            failed++;
+            continue;
+        }
+
+        huffman_legacy_index* index;
+        int status = huffman_legacy_index_build(&index, in, interval);
+        fclose(in);
+
+        if(status == 0) {
+            char index_name[strlen(files[i]) + sizeof(HUFFMAN_LEGACY_INDEX_SUFFIX)];
+            sprintf(index_name, "%s%s", files[i], HUFFMAN_LEGACY_INDEX_SUFFIX);
+
+            FILE* out = fopen(index_name, "wb");
+            if(out == NULL) {
+                status = HUFFMAN_IO_ERROR;
+            } else {
+                status = huffman_legacy_index_write(index, out);
+                if(fclose(out) != 0 && status == 0) {
+                    status = HUFFMAN_IO_ERROR;
+                }
+            }
+
+            if(status == 0) {
+                printf("%s: %llu checkpoints over %llu bytes.\n", index_name, index->count, index->output_size);
+            }
+            huffman_legacy_index_destroy(&index);
+        }
+
+        if(status != 0) {
+            printf("Indexing %s failed: %s.\n", files[i], huffman_error_string(status));
+            failed++;
+        }
+    }
+
+    return failed == 0 ? 0 : -2;
+}
+
+int estimate_files(char** files, int file_count, const huffman_options* options) {
+
+    if(file_count < 1) {
+        printf("Expected the files to estimate.\n");
+        print_usage();
+        return -1;
+    }
+
+    int failed = 0;
+    for(int i = 0; i < file_count; i++) {
+        FILE* in = fopen(files[i], "rb");
+        if(in == NULL) {
+            printf("File %s doesn't exist.\n", files[i]);
+            failed++;
+            continue;
+        }
+
+        huffman_stats stats;
+        huffman_stats_init(&stats);
+        int status = huffman_estimate(in, options, &stats);
+        fclose(in);
+
+        if(status == 0) {
+            printf("%s: %llu -> about %llu bytes (%.2f%%).\n", files[i], stats.input_size, stats.output_size,
+                   stats.input_size == 0 ? 100.0 : 100.0 * stats.output_size / stats.input_size);
+        } else {
+            printf("Estimating %s failed: %s.\n", files[i], huffman_error_string(status));
+            failed++;
+        }
+    }
+
+    return failed == 0 ? 0 : -2;
+}
+
+/**
+ * Loads the index next to a file, if it has one that was built from it.
+ */
+huffman_legacy_index* load_index(const char* in_name, FILE* in) {
+
+    char index_name[strlen(in_name) + sizeof(HUFFMAN_LEGACY_INDEX_SUFFIX)];
+    sprintf(index_name, "%s%s", in_name, HUFFMAN_LEGACY_INDEX_SUFFIX);
+
+    FILE* fp = fopen(index_name, "rb");
+    if(fp == NULL) {
+        return NULL;
+    }
+
+    huffman_legacy_index* index;
+    int status = huffman_legacy_index_read(&index, fp);
+    fclose(fp);
+    if(status == 0) {
+        status = huffman_legacy_index_check(index, in);
+        if(status != 0) {
+            huffman_legacy_index_destroy(&index);
+        }
+    }
+
+    if(status != 0) {
+        printf("Ignoring index %s: %s.\n", index_name, huffman_error_string(status));
+        return NULL;
+    }
+    return index;
+}
+
+/**
+ * Removes the output of a failed run, unless it is not a regular file,
+ * such as a device or a pipe the output went to.
+ */
+void remove_output(const char* out_name) {
+    struct stat info;
+    if(stat(out_name, &info) == 0 && S_ISREG(info.st_mode)) {
+        remove(out_name);
+    }
+}
+
+int serve(char** files, int file_count, const huffman_options* options, int threads) {
+
+    if(file_count != 1) {
+        printf("Expected the path of a socket.\n");
+        print_usage();
+        return -1;
+    }
+
+    printf("Serving on %s with %d threads.\n", files[0], threads);
+    fflush(stdout);
+
+    int status = huffman_server_run(files[0], options, threads);
+    if(status != 0) {
+        printf("Serving failed: %s.\n", huffman_error_string(status));
+        return -2;
+    }
+
+    return 0;
 }
 
 int main(int argc, char **argv) {
 
     int compress = 0;
+    char mode;
 
-    if(argc < 4) {
+    if(argc < 3) {
         printf("Insufficient arguments.\n");
         print_usage();
         return -1;
@@ -38,23 +359,148 @@ int main(int argc, char **argv) {
      
     if(strcmp(argv[1], "-c") == 0) {
         compress = 1;
+        mode = 'c';
     } else if(strcmp(argv[1], "-d") == 0) {
         compress = 0;
+        mode = 'd';
+    } else if(strcmp(argv[1], "-a") == 0 || strcmp(argv[1], "-l") == 0 || strcmp(argv[1], "-x") == 0) {
+        mode = argv[1][1];
+    } else if(strcmp(argv[1], "--serve") == 0) {
+        mode = 's';
+    } else if(strcmp(argv[1], "--build-index") == 0) {
+        mode = 'i';
+    } else if(strcmp(argv[1], "--estimate") == 0) {
+        mode = 'e';
     } else {
         printf("Unrecognized option %s.\n", argv[1]);
         print_usage();
         return -1;
     }
 
-    FILE* in = fopen(argv[2], "rb");
+    huffman_options options;
+    huffman_options_init(&options);
+
+    int batch = 0;
+    int threads = thread_pool_default_threads();
+    unsigned int interval = HUFFMAN_LEGACY_INDEX_INTERVAL;
+    int range = 0;
+    unsigned long long range_offset = 0;
+    unsigned long long range_size = 0;
+    char* files[argc];
+    int file_count = 0;
+
+    for(int i = 2; i < argc; i++) {
+        if(strcmp(argv[i], "--order1") == 0) {
+            options.order1 = 1;
+        } else if(strcmp(argv[i], "--rle") == 0) {
+            options.rle = 1;
+        } else if(strcmp(argv[i], "--wide") == 0) {
+            options.wide = 1;
+        } else if(strcmp(argv[i], "--fast") == 0) {
+            options.fast = 1;
+        } else if(strcmp(argv[i], "--stats") == 0) {
+            options.stats = 1;
+        } else if(strcmp(argv[i], "--checksum") == 0) {
+            options.checksum = 1;
+        } else if(strcmp(argv[i], "--no-verify") == 0) {
+            options.verify = 0;
+        } else if(strcmp(argv[i], "--io-uring") == 0) {
+            if(!huffman_io_uring_available()) {
+                printf("This build has no io_uring support, using stdio.\n");
+            }
+            options.io = HUFFMAN_IO_URING;
+        } else if(strcmp(argv[i], "--batch") == 0) {
+            batch = 1;
+        } else if(strcmp(argv[i], "-T") == 0 || strcmp(argv[i], "--threads") == 0) {
+            if(i + 1 >= argc || (threads = atoi(argv[i + 1])) < 1) {
+                printf("Option %s needs a number of threads.\n", argv[i]);
+                print_usage();
+                return -1;
+            }
+            i++;
+        } else if(strcmp(argv[i], "--memory-limit") == 0) {
+            if(i + 1 >= argc || (options.memory_limit = parse_size(argv[i + 1])) == 0) {
+                printf("Option %s needs a number of bytes, optionally followed by K, M or G.\n", argv[i]);
+                print_usage();
+                return -1;
+            }
+            i++;
+        } else if(strcmp(argv[i], "--interval") == 0) {
+            long kib;
+            if(i + 1 >= argc || (kib = atol(argv[i + 1])) < 1 || kib > HUFFMAN_LEGACY_INDEX_MAX_INTERVAL / 1024) {
+                printf("Option %s needs a number of KiB from 1 to %d.\n", argv[i], HUFFMAN_LEGACY_INDEX_MAX_INTERVAL / 1024);
+                print_usage();
+                return -1;
+            }
+            interval = (unsigned int) kib * 1024;
+            i++;
+        } else if(strcmp(argv[i], "--range") == 0) {
+            if(i + 1 >= argc || sscanf(argv[i + 1], "%llu:%llu", &range_offset, &range_size) != 2) {
+                printf("Option %s needs an offset and a size, as offset:size.\n", argv[i]);
+                print_usage();
+                return -1;
+            }
+            range = 1;
+            i++;
+        } else if(argv[i][0] == '-' && argv[i][1] != '\0') {
+            printf("Unrecognized option %s.\n", argv[i]);
+            print_usage();
+            return -1;
+        } else {
+            files[file_count] = argv[i];
+            file_count++;
+        }
+    }
+
+    /* Batch mode already runs a file per thread. */
+    options.threads = batch ? 1 : threads;
+
+    if(mode == 'a') {
+        return create_archive(files, file_count, &options);
+    } else if(mode == 'l' || mode == 'x') {
+        return read_archive(mode, files, file_count);
+    } else if(mode == 's') {
+        return serve(files, file_count, &options, threads);
+    } else if(mode == 'i') {
+        return build_indexes(files, file_count, interval);
+    } else if(mode == 'e') {
+        return estimate_files(files, file_count, &options);
+    }
+
+    if(batch) {
+        char** names;
+        int name_count;
+        if(huffman_batch_collect(files, file_count, &names, &name_count) != 0) {
+            return -2;
+        }
+
+        int failed = huffman_batch_run(names, name_count, compress, &options, threads);
+        huffman_batch_free_names(names, name_count);
+
+        if(failed != 0) {
+            printf("%d of %d files failed.\n", failed < 0 ? name_count : failed, name_count);
+            return -2;
+        }
+        return 0;
+    }
+
+    if(file_count != 2) {
+        printf("Expected an input and an output file.\n");
+        print_usage();
+        return -1;
+    }
+
+    const char* in_name = files[0];
+    const char* out_name = files[1];
+    FILE* in = fopen(in_name, "rb");
     if(in == NULL) {
-        printf("File %s doesn't exist.\n", argv[2]);
+        printf("File %s doesn't exist.\n", in_name);
         return -2;
     }
 
-    FILE* out = fopen(argv[3], "wb");
+    FILE* out = fopen(out_name, "wb");
     if(out == NULL) {
-        printf("Can't open %s for writing.\n", argv[3]);
+        printf("Can't open %s for writing.\n", out_name);
         fclose(in);
         return -2;
     }
@@ -62,25 +508,54 @@ int main(int argc, char **argv) {
     int status;
     if(compress == 1) {
 
-        status = huffman_encode(in, out);
+        huffman_stats stats;
+        huffman_stats_init(&stats);
+        status = huffman_encode_with_stats(in, out, &options, &stats);
         if(status == 0) {
             printf("Compression successful.\n");
+            if(options.stats) {
+                print_stats(&stats);
+            }
         } else {
-            printf("Compression failed.\n");
+            printf("Compression failed: %s.\n", huffman_error_string(status));
         }
 
     } else {
 
-        status = huffman_decode(in, out);
+        huffman_legacy_index* index = load_index(in_name, in);
+        if(range && index == NULL) {
+            printf("Decompressing a range needs the file's index, built with --build-index.\n");
+            fclose(in);
+            fclose(out);
+            remove_output(out_name);
+            return -2;
+        }
+
+        if(range) {
+            status = huffman_legacy_decode_range(in, index, range_offset, range_size, out);
+        } else if(index != NULL) {
+            status = huffman_legacy_decode(in, out, &options, index);
+        } else {
+            status = huffman_decode_with_options(in, out, &options);
+        }
+        if(index != NULL) {
+            huffman_legacy_index_destroy(&index);
+        }
+
         if(status == 0) {
             printf("Decompression successful.\n");
         } else {
-            printf("Deompression failed.\n");
+            printf("Decompression failed: %s.\n", huffman_error_string(status));
         }
 
     }
 
     fclose(in);
     fclose(out);
+
+    if(status != 0) {
+        remove_output(out_name);
+        return -2;
+    }
     return 0;
 }
\ No newline at end of file
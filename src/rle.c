@@ -0,0 +1,118 @@
+/**
+ * Copyright (c) 2011-2014, Vasileios Daras. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+#include "rle.h"
+#include <string.h>
+
+int rle_encode(const unsigned char* in, unsigned int in_size, unsigned char* out, unsigned int out_capacity, unsigned int* out_size) {
+
+    unsigned int bytes_read = 0;
+    unsigned int bytes_written = 0;
+
+    while(bytes_read < in_size) {
+
+        unsigned char byte = in[bytes_read];
+        unsigned int run = 1;
+        while(bytes_read + run < in_size && in[bytes_read + run] == byte) {
+            run++;
+        }
+        bytes_read += run;
+
+        if(run < RLE_MIN_RUN) {
+            if(out_capacity - bytes_written < run) {
+                return RLE_OVERFLOW;
+            }
+
+            for(unsigned int i = 0; i < run; i++) {
+                out[bytes_written++] = byte;
+            }
+        } else {
+            /* A run's length takes at most 5 bytes. */
+            if(out_capacity - bytes_written < RLE_MIN_RUN + 5) {
+                return RLE_OVERFLOW;
+            }
+
+            for(unsigned int i = 0; i < RLE_MIN_RUN; i++) {
+                out[bytes_written++] = byte;
+            }
+
+            unsigned int repeats = run - RLE_MIN_RUN;
+            while(repeats >= 0x80) {
+                out[bytes_written++] = (repeats & 0x7F) | 0x80;
+                repeats >>= 7;
+            }
+            out[bytes_written++] = repeats;
+        }
+    }
+
+    (*out_size) = bytes_written;
+    return RLE_SUCCESS;
+}
+
+int rle_decode(const unsigned char* in, unsigned int in_size, unsigned char* out, unsigned int out_capacity, unsigned int* out_size) {
+
+    unsigned int bytes_read = 0;
+    unsigned int bytes_written = 0;
+    unsigned int run = 0;
+    int prev = -1;
+
+    while(bytes_read < in_size) {
+
+        unsigned char byte = in[bytes_read++];
+        if(bytes_written >= out_capacity) {
+            return RLE_OVERFLOW;
+        }
+        out[bytes_written++] = byte;
+
+        run = byte == prev ? run + 1 : 1;
+        prev = byte;
+
+        if(run == RLE_MIN_RUN) {
+            unsigned int repeats = 0;
+            int shift = 0;
+
+            while(1) {
+                if(bytes_read >= in_size || shift > 28) {
+                    return RLE_CORRUPT;
+                }
+
+                unsigned char group = in[bytes_read++];
+                repeats |= (unsigned int) (group & 0x7F) << shift;
+                shift += 7;
+
+                if((group & 0x80) == 0) {
+                    break;
+                }
+            }
+
+            if(out_capacity - bytes_written < repeats) {
+                return RLE_OVERFLOW;
+            }
+
+            memset(out + bytes_written, byte, repeats);
+            bytes_written += repeats;
+
+            run = 0;
+            prev = -1;
+        }
+    }
+
+    (*out_size) = bytes_written;
+    return RLE_SUCCESS;
+}
@@ -0,0 +1,61 @@
+/**
+ * Copyright (c) 2011-2014, Vasileios Daras. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+#ifndef RLE_H
+#define RLE_H
+
+#define RLE_SUCCESS 0
+#define RLE_OVERFLOW -1
+#define RLE_CORRUPT -2
+
+/**
+ * Runs of at least RLE_MIN_RUN equal bytes are written as RLE_MIN_RUN bytes
+ * followed by the number of further repeats, stored as a variable length
+ * integer of 7 bits per byte, least significant group first.
+ */
+#define RLE_MIN_RUN 4
+
+/**
+ * Run-length encodes a buffer.
+ *
+ * @param in Bytes to encode.
+ * @param in_size Number of bytes to encode.
+ * @param out Buffer to encode to.
+ * @param out_capacity Size of the output buffer.
+ * @param out_size(out) Number of bytes written is stored in here.
+ * @return RLE_OVERFLOW if the encoded bytes don't fit in the output buffer,
+ *         RLE_SUCCESS otherwise.
+ */
+int rle_encode(const unsigned char* in, unsigned int in_size, unsigned char* out, unsigned int out_capacity, unsigned int* out_size);
+
+/**
+ * Decodes a run-length encoded buffer.
+ *
+ * @param in Bytes to decode.
+ * @param in_size Number of bytes to decode.
+ * @param out Buffer to decode to.
+ * @param out_capacity Size of the output buffer.
+ * @param out_size(out) Number of bytes written is stored in here.
+ * @return RLE_OVERFLOW if the decoded bytes don't fit in the output buffer,
+ *         RLE_CORRUPT if the input ends in the middle of a run's length,
+ *         RLE_SUCCESS otherwise.
+ */
+int rle_decode(const unsigned char* in, unsigned int in_size, unsigned char* out, unsigned int out_capacity, unsigned int* out_size);
+
+#endif //RLE_H
@@ -0,0 +1,150 @@
+/**
+ * Copyright (c) 2011-2014, Vasileios Daras. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+#include "thread_pool.h"
+#include <stdlib.h>
+#include <unistd.h>
+
+static void* thread_pool_worker(void* data) {
+    thread_pool* pool = (thread_pool*) data;
+
+    pthread_mutex_lock(&pool->lock);
+    while(1) {
+        while(pool->head == NULL && !pool->stopping) {
+            pthread_cond_wait(&pool->task_available, &pool->lock);
+        }
+
+        if(pool->head == NULL) {
+            break;
+        }
+
+        thread_pool_task* task = pool->head;
+        pool->head = task->next;
+        if(pool->head == NULL) {
+            pool->tail = NULL;
+        }
+        pthread_mutex_unlock(&pool->lock);
+
+        task->function(task->arg);
+        free(task);
+
+        pthread_mutex_lock(&pool->lock);
+        pool->pending--;
+        if(pool->pending == 0) {
+            pthread_cond_broadcast(&pool->tasks_done);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return NULL;
+}
+
+int thread_pool_create(thread_pool** pool, int thread_count) {
+    thread_pool* retval = malloc(sizeof(thread_pool));
+    if(retval == NULL) {
+        (*pool) = NULL;
+        return THREAD_POOL_ALLOC_ERROR;
+    }
+
+    retval->threads = malloc(sizeof(pthread_t) * thread_count);
+    if(retval->threads == NULL) {
+        free(retval);
+        (*pool) = NULL;
+        return THREAD_POOL_ALLOC_ERROR;
+    }
+
+    retval->thread_count = 0;
+    retval->head = retval->tail = NULL;
+    retval->pending = 0;
+    retval->stopping = 0;
+    pthread_mutex_init(&retval->lock, NULL);
+    pthread_cond_init(&retval->task_available, NULL);
+    pthread_cond_init(&retval->tasks_done, NULL);
+
+    for(int i = 0; i < thread_count; i++) {
+        if(pthread_create(&retval->threads[i], NULL, thread_pool_worker, retval) != 0) {
+            thread_pool_destroy(&retval);
+            (*pool) = NULL;
+            return THREAD_POOL_THREAD_ERROR;
+        }
+        retval->thread_count++;
+    }
+
+    (*pool) = retval;
+    return THREAD_POOL_SUCCESS;
+}
+
+void thread_pool_destroy(thread_pool** pool) {
+    thread_pool* temp = (*pool);
+
+    thread_pool_wait(temp);
+
+    pthread_mutex_lock(&temp->lock);
+    temp->stopping = 1;
+    pthread_cond_broadcast(&temp->task_available);
+    pthread_mutex_unlock(&temp->lock);
+
+    for(int i = 0; i < temp->thread_count; i++) {
+        pthread_join(temp->threads[i], NULL);
+    }
+
+    pthread_mutex_destroy(&temp->lock);
+    pthread_cond_destroy(&temp->task_available);
+    pthread_cond_destroy(&temp->tasks_done);
+    free(temp->threads);
+    free(temp);
+    (*pool) = NULL;
+}
+
+int thread_pool_submit(thread_pool* pool, void (*function)(void*), void* arg) {
+    thread_pool_task* task = malloc(sizeof(thread_pool_task));
+    if(task == NULL) {
+        return THREAD_POOL_ALLOC_ERROR;
+    }
+
+    task->function = function;
+    task->arg = arg;
+    task->next = NULL;
+
+    pthread_mutex_lock(&pool->lock);
+    if(pool->tail == NULL) {
+        pool->head = task;
+    } else {
+        pool->tail->next = task;
+    }
+    pool->tail = task;
+    pool->pending++;
+    pthread_cond_signal(&pool->task_available);
+    pthread_mutex_unlock(&pool->lock);
+
+    return THREAD_POOL_SUCCESS;
+}
+
+void thread_pool_wait(thread_pool* pool) {
+    pthread_mutex_lock(&pool->lock);
+    while(pool->pending != 0) {
+        pthread_cond_wait(&pool->tasks_done, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+int thread_pool_default_threads() {
+    long processors = sysconf(_SC_NPROCESSORS_ONLN);
+    return processors > 0 ? (int) processors : 1;
+}
@@ -0,0 +1,88 @@
+/**
+ * Copyright (c) 2011-2014, Vasileios Daras. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <pthread.h>
+
+#define THREAD_POOL_SUCCESS 0
+#define THREAD_POOL_ALLOC_ERROR -1
+#define THREAD_POOL_THREAD_ERROR -2
+
+typedef struct thread_pool_task_t {
+    void (*function)(void* arg);
+    void* arg;
+    struct thread_pool_task_t* next;
+} thread_pool_task;
+
+typedef struct {
+    pthread_t* threads;
+    int thread_count;
+
+    thread_pool_task* head;
+    thread_pool_task* tail;
+    int pending;
+    int stopping;
+
+    pthread_mutex_t lock;
+    pthread_cond_t task_available;
+    pthread_cond_t tasks_done;
+} thread_pool;
+
+/**
+ * Creates a thread pool.
+ *
+ * @param pool(out) Created pool is stored here. NULL if creation fails.
+ * @param thread_count Number of worker threads.
+ * @return A flag indicating if creation was successful.
+ */
+int thread_pool_create(thread_pool** pool, int thread_count);
+
+/**
+ * Waits for all submitted tasks to finish and destroys a thread pool.
+ *
+ * @param pool Pool to destroy, set to NULL after the call.
+ */
+void thread_pool_destroy(thread_pool** pool);
+
+/**
+ * Queues a task to run on one of the pool's threads. Tasks start in the
+ * order they are submitted.
+ *
+ * @param pool The pool.
+ * @param function Function to run.
+ * @param arg Argument to pass to the function.
+ * @return A flag indicating if submission was successful.
+ */
+int thread_pool_submit(thread_pool* pool, void (*function)(void*), void* arg);
+
+/**
+ * Waits until all submitted tasks have finished.
+ *
+ * @param pool The pool.
+ */
+void thread_pool_wait(thread_pool* pool);
+
+/**
+ * Returns the number of processors online, at least 1.
+ */
+int thread_pool_default_threads();
+
+#endif //THREAD_POOL_H
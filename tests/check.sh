@@ -0,0 +1,166 @@
+#!/bin/sh
+#
+# Checks that compressed output is reproducible: fixed inputs must compress
+# to the golden files checked in next to them, which pins the stream layout,
+# the little endian tables and the order ties are broken in, and batch mode
+# must write the same bytes whatever the number of threads and memory limit.
+# Then round trips files through the other ways of coding them: the format
+# written before blocks with its threads and index, archives, and the
+# stream interface of the library, through tests/stream_check.
+#
+# Usage: tests/check.sh huffman_encoding [--update]
+# --update rewrites the golden files from the current output, except
+# text.txt.legacy.huf, which nothing writes any more.
+
+EXEC=$(cd "$(dirname "$1")" && pwd)/$(basename "$1")
+UPDATE=$2
+TESTS=$(cd "$(dirname "$0")" && pwd)
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+failed=0
+
+fail() {
+    echo "FAIL: $*"
+    failed=$((failed + 1))
+}
+
+# Golden files are named input.variant.huf.
+golden() {
+    input=$1
+    variant=$2
+    shift 2
+
+    out="$WORK/$input.$variant.huf"
+    expected="$TESTS/golden/$input.$variant.huf"
+    if ! "$EXEC" -c "$@" "$TESTS/data/$input" "$out" >/dev/null; then
+        fail "compressing $input ($variant)"
+        return
+    fi
+
+    if [ "$UPDATE" = "--update" ]; then
+        cp "$out" "$expected"
+    elif ! cmp -s "$out" "$expected"; then
+        fail "$input ($variant) differs from $expected"
+    fi
+
+    if ! "$EXEC" -d "$expected" "$WORK/decoded" >/dev/null || ! cmp -s "$WORK/decoded" "$TESTS/data/$input"; then
+        fail "decompressing $expected"
+    fi
+}
+
+for input in text.txt ties.bin runs.bin neartie.bin; do
+    golden $input plain
+    golden $input order1 --order1
+    golden $input rle --rle
+    golden $input wide --wide
+    golden $input checksum --checksum
+done
+
+# Inputs of several blocks, so that memory limits change the block size.
+mkdir "$WORK/batch"
+for i in 1 2 3 4 5 6 7 8; do
+    for j in 1 2 3 4 5 6 7 8; do
+        cat "$TESTS/data/text.txt" "$TESTS/data/ties.bin" >>"$WORK/batch/mixed.bin"
+    done
+    cat "$TESTS/data/runs.bin" "$TESTS/data/runs.bin" >>"$WORK/batch/runs.bin"
+done
+for i in 1 2 3 4 5; do
+    cat "$WORK/batch/mixed.bin" "$WORK/batch/runs.bin" >>"$WORK/batch/large.bin"
+done
+cp "$TESTS/data/text.txt" "$WORK/batch/small.txt"
+
+for limit in none 512K 1M 3M; do
+    reference=""
+    for threads in 1 2 4 8; do
+        if [ $limit = none ]; then
+            options=""
+        else
+            options="--memory-limit $limit"
+        fi
+
+        rm -f "$WORK"/batch/*.huf
+        if ! "$EXEC" -c --batch -T $threads $options "$WORK"/batch/*.* >/dev/null; then
+            fail "batch compression with -T $threads $options"
+            continue
+        fi
+
+        sums=$(cd "$WORK/batch" && cat large.bin.huf mixed.bin.huf runs.bin.huf small.txt.huf | cksum)
+        if [ -z "$reference" ]; then
+            reference=$sums
+        elif [ "$sums" != "$reference" ]; then
+            fail "batch output with -T $threads $options differs from -T 1"
+        fi
+    done
+done
+
+# The format written before blocks decodes every bit up to the end of the
+# file, so its output goes on past the input for the bits padding the last
+# byte. Repeating the file makes a stream long enough to be decoded in
+# chunks by several threads, which must give the bytes one thread does.
+legacy="$TESTS/golden/text.txt.legacy.huf"
+size=$(wc -c <"$TESTS/data/text.txt")
+if ! "$EXEC" -d "$legacy" "$WORK/legacy" >/dev/null || ! cmp -s -n $size "$WORK/legacy" "$TESTS/data/text.txt"; then
+    fail "decompressing $legacy"
+fi
+
+cp "$legacy" "$WORK/long.huf"
+for i in 1 2 3 4 5 6 7 8 9 10 11; do
+    cat "$WORK/long.huf" "$WORK/long.huf" >"$WORK/twice.huf"
+    mv "$WORK/twice.huf" "$WORK/long.huf"
+done
+if ! "$EXEC" -d -T 1 "$WORK/long.huf" "$WORK/long.1" >/dev/null; then
+    fail "decompressing a long stream without blocks"
+fi
+for threads in 2 4; do
+    if ! "$EXEC" -d -T $threads "$WORK/long.huf" "$WORK/long.$threads" >/dev/null \
+       || ! cmp -s "$WORK/long.$threads" "$WORK/long.1"; then
+        fail "decompressing a long stream without blocks with -T $threads"
+    fi
+done
+
+# An index makes the same stream decode from its checkpoints, and ranges
+# decode from the checkpoint before them.
+if ! "$EXEC" --build-index --interval 4 "$WORK/long.huf" >/dev/null; then
+    fail "building an index"
+fi
+for threads in 1 4; do
+    if ! "$EXEC" -d -T $threads "$WORK/long.huf" "$WORK/indexed" >/dev/null || ! cmp -s "$WORK/indexed" "$WORK/long.1"; then
+        fail "decompressing from an index with -T $threads"
+    fi
+done
+total=$(wc -c <"$WORK/long.1")
+for range in 0:1 4095:2 1000000:300000 $((total - 10)):100; do
+    offset=${range%:*}
+    count=${range#*:}
+    if ! "$EXEC" -d --range $range "$WORK/long.huf" "$WORK/range" >/dev/null; then
+        fail "decompressing range $range"
+    elif ! tail -c +$((offset + 1)) "$WORK/long.1" | head -c $count | cmp -s - "$WORK/range"; then
+        fail "range $range differs from the whole output"
+    fi
+done
+
+mkdir "$WORK/archive"
+members="text.txt ties.bin runs.bin neartie.bin"
+if ! (cd "$TESTS/data" && "$EXEC" -a "$WORK/archive.hfa" $members >/dev/null); then
+    fail "creating an archive"
+fi
+if [ "$("$EXEC" -l "$WORK/archive.hfa" | awk '{ print $3 }' | tr '\n' ' ')" != "$members " ]; then
+    fail "listing an archive"
+fi
+for member in $members; do
+    if ! "$EXEC" -x "$WORK/archive.hfa" $member "$WORK/archive/$member" >/dev/null \
+       || ! cmp -s "$WORK/archive/$member" "$TESTS/data/$member"; then
+        fail "extracting $member from an archive"
+    fi
+done
+
+if ! "$TESTS/stream_check" "$TESTS"/data/* "$WORK/batch/large.bin"; then
+    fail "round trips through streams"
+fi
+
+if [ $failed -ne 0 ]; then
+    echo "$failed checks failed."
+    exit 1
+fi
+echo "All checks passed."
@@ -0,0 +1,222 @@
+/**
+ * Copyright (c) 2011-2014, Vasileios Daras. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+/**
+ * Round trips files through huffman_cstream and huffman_dstream, handing
+ * them input in small pieces and output buffers smaller than a block
+ * header, so that every call stops part way and has to be resumed. The
+ * compressed stream is also checked against huffman_decompress_buffer.
+ *
+ * Usage: stream_check file...
+ */
+
+#include "huffman.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Odd sizes, so that pieces end at a different place in every block. */
+static const size_t IN_PIECE = 4093;
+static const size_t OUT_PIECE = 7;
+static const size_t FEED_PIECE = 13;
+
+typedef struct {
+    unsigned char* bytes;
+    size_t size;
+    size_t cap;
+} buffer;
+
+static int append(buffer* buffer, const unsigned char* bytes, size_t size) {
+    if(buffer->size + size > buffer->cap) {
+        size_t cap = buffer->cap == 0 ? 4096 : buffer->cap;
+        while(cap < buffer->size + size) {
+            cap *= 2;
+        }
+        unsigned char* temp = realloc(buffer->bytes, cap);
+        if(temp == NULL) {
+            return HUFFMAN_ALLOC_ERROR;
+        }
+        buffer->bytes = temp;
+        buffer->cap = cap;
+    }
+
+    memcpy(buffer->bytes + buffer->size, bytes, size);
+    buffer->size += size;
+    return HUFFMAN_SUCCESS;
+}
+
+static int read_file(const char* name, buffer* data) {
+    FILE* in = fopen(name, "rb");
+    if(in == NULL) {
+        return HUFFMAN_IO_ERROR;
+    }
+
+    unsigned char bytes[IN_PIECE];
+    size_t size;
+    int retval = HUFFMAN_SUCCESS;
+    while(retval == HUFFMAN_SUCCESS && (size = fread(bytes, 1, IN_PIECE, in)) != 0) {
+        retval = append(data, bytes, size);
+    }
+    if(retval == HUFFMAN_SUCCESS && ferror(in)) {
+        retval = HUFFMAN_IO_ERROR;
+    }
+
+    fclose(in);
+    return retval;
+}
+
+/**
+ * Compresses data in pieces, flushing half way through.
+ */
+static int compress_pieces(const huffman_options* options, const buffer* data, buffer* compressed) {
+    huffman_cstream* stream;
+    int retval = huffman_cstream_create(&stream, options);
+    if(retval != HUFFMAN_SUCCESS) {
+        return retval;
+    }
+
+    unsigned char out[OUT_PIECE];
+    size_t produced;
+    size_t offset = 0;
+    int flushed = 0;
+    while(retval == HUFFMAN_SUCCESS && offset < data->size) {
+        size_t size = data->size - offset < IN_PIECE ? data->size - offset : IN_PIECE;
+        size_t consumed;
+        retval = huffman_cstream_write(stream, data->bytes + offset, size, &consumed, out, OUT_PIECE, &produced);
+        offset += consumed;
+        if(retval == HUFFMAN_SUCCESS) {
+            retval = append(compressed, out, produced);
+        }
+
+        while(retval == HUFFMAN_SUCCESS && !flushed && offset >= data->size / 2) {
+            retval = huffman_cstream_flush(stream, out, OUT_PIECE, &produced);
+            if(retval == HUFFMAN_SUCCESS) {
+                flushed = 1;
+            } else if(retval == HUFFMAN_STREAM_PENDING) {
+                retval = HUFFMAN_SUCCESS;
+            }
+            if(retval == HUFFMAN_SUCCESS) {
+                retval = append(compressed, out, produced);
+            }
+        }
+    }
+
+    while(retval == HUFFMAN_SUCCESS) {
+        retval = huffman_cstream_end(stream, out, OUT_PIECE, &produced);
+        if(retval == HUFFMAN_STREAM_END || retval == HUFFMAN_STREAM_PENDING) {
+            int status = append(compressed, out, produced);
+            retval = status != HUFFMAN_SUCCESS ? status :
+                     retval == HUFFMAN_STREAM_END ? HUFFMAN_STREAM_END : HUFFMAN_SUCCESS;
+        }
+    }
+
+    huffman_cstream_destroy(&stream);
+    return retval == HUFFMAN_STREAM_END ? HUFFMAN_SUCCESS : retval;
+}
+
+/**
+ * Decompresses a stream fed in pieces into a small output buffer.
+ */
+static int decompress_pieces(const buffer* compressed, buffer* decoded) {
+    huffman_dstream* stream;
+    int retval = huffman_dstream_create(&stream);
+    if(retval != HUFFMAN_SUCCESS) {
+        return retval;
+    }
+
+    unsigned char out[OUT_PIECE];
+    size_t offset = 0;
+    while(retval == HUFFMAN_SUCCESS) {
+        size_t size = compressed->size - offset < FEED_PIECE ? compressed->size - offset : FEED_PIECE;
+        size_t consumed, produced;
+        retval = huffman_dstream_feed(stream, compressed->bytes + offset, size, &consumed, out, OUT_PIECE, &produced);
+        offset += consumed;
+        if(retval == HUFFMAN_SUCCESS || retval == HUFFMAN_STREAM_END) {
+            int status = append(decoded, out, produced);
+            if(status != HUFFMAN_SUCCESS) {
+                retval = status;
+            }
+        }
+        if(retval == HUFFMAN_SUCCESS && consumed == 0 && produced == 0) {
+            /* The input ran out before the end of the stream. */
+            retval = HUFFMAN_ENCODING_ERROR;
+        }
+    }
+
+    huffman_dstream_destroy(&stream);
+    return retval == HUFFMAN_STREAM_END && offset == compressed->size ? HUFFMAN_SUCCESS :
+           retval == HUFFMAN_STREAM_END ? HUFFMAN_ENCODING_ERROR : retval;
+}
+
+static int check(const char* name, const char* variant, const huffman_options* options, const buffer* data) {
+    buffer compressed = { NULL, 0, 0 };
+    buffer decoded = { NULL, 0, 0 };
+    int failed = 0;
+
+    int retval = compress_pieces(options, data, &compressed);
+    if(retval != HUFFMAN_SUCCESS) {
+        printf("FAIL: compressing %s (%s) with a cstream: %s\n", name, variant, huffman_error_string(retval));
+        return 1;
+    }
+
+    retval = decompress_pieces(&compressed, &decoded);
+    if(retval != HUFFMAN_SUCCESS || decoded.size != data->size || memcmp(decoded.bytes, data->bytes, data->size) != 0) {
+        printf("FAIL: decompressing %s (%s) with a dstream\n", name, variant);
+        failed++;
+    }
+
+    unsigned char* whole = malloc(data->size == 0 ? 1 : data->size);
+    size_t whole_size;
+    retval = whole == NULL ? HUFFMAN_ALLOC_ERROR :
+             huffman_decompress_buffer(options, compressed.bytes, compressed.size, whole, data->size, &whole_size);
+    if(retval != HUFFMAN_SUCCESS || whole_size != data->size || memcmp(whole, data->bytes, data->size) != 0) {
+        printf("FAIL: decompressing the cstream output of %s (%s) as a buffer\n", name, variant);
+        failed++;
+    }
+
+    free(whole);
+    free(compressed.bytes);
+    free(decoded.bytes);
+    return failed;
+}
+
+int main(int argc, char** argv) {
+    int failed = 0;
+
+    for(int i = 1; i < argc; i++) {
+        buffer data = { NULL, 0, 0 };
+        if(read_file(argv[i], &data) != HUFFMAN_SUCCESS) {
+            printf("FAIL: reading %s\n", argv[i]);
+            failed++;
+            continue;
+        }
+
+        huffman_options options;
+        huffman_options_init(&options);
+        failed += check(argv[i], "plain", &options, &data);
+
+        options.checksum = 1;
+        options.order1 = 1;
+        failed += check(argv[i], "order1, checksum", &options, &data);
+
+        free(data.bytes);
+    }
+
+    return failed == 0 ? 0 : 1;
+}